@@ -14,6 +14,20 @@ enum {
 	BTS_CTR_PAGING_RCVD,
 	BTS_CTR_PAGING_DROP,
 	BTS_CTR_PAGING_SENT,
+	BTS_CTR_PAGING_IDS_1,
+	BTS_CTR_PAGING_IDS_2,
+	BTS_CTR_PAGING_IDS_3,
+	BTS_CTR_PAGING_IDS_4,
+	/* by enum paging_prio */
+	BTS_CTR_PAGING_DROP_NORMAL,
+	BTS_CTR_PAGING_DROP_EMLPP,
+	BTS_CTR_PAGING_DROP_EMERG,
+	BTS_CTR_PAGING_FIRST_NORMAL,
+	BTS_CTR_PAGING_FIRST_EMLPP,
+	BTS_CTR_PAGING_FIRST_EMERG,
+	BTS_CTR_PAGING_DELAY_NORMAL,
+	BTS_CTR_PAGING_DELAY_EMLPP,
+	BTS_CTR_PAGING_DELAY_EMERG,
 	BTS_CTR_RACH_RCVD,
 	BTS_CTR_RACH_DROP,
 	BTS_CTR_RACH_HO,
@@ -22,6 +36,8 @@ enum {
 	BTS_CTR_AGCH_RCVD,
 	BTS_CTR_AGCH_SENT,
 	BTS_CTR_AGCH_DELETED,
+	BTS_CTR_UL_BURST_MISSED,
+	BTS_CTR_UL_BLOCK_MISSED,
 };
 
 extern void *tall_bts_ctx;
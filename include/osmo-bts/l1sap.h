@@ -62,6 +62,20 @@ struct gsm_lchan *get_lchan_by_chan_nr(struct gsm_bts_trx *trx,
 
 /* allocate a msgb containing a osmo_phsap_prim + optional l2 data */
 struct msgb *l1sap_msgb_alloc(unsigned int l2_len);
+/* reuse a msgb from l1sap_msgb_alloc() for a new primitive */
+void l1sap_msgb_reset(struct msgb *msg);
+/* free a msgb carrying a primitive, or hand it back to its slot */
+void l1sap_msgb_free(struct msgb *msg);
+
+/* Access 5th part of msgb control buffer: whether a msgb from
+ * l1sap_msgb_alloc() is preallocated and owned by some slot */
+#define l1sap_msgb_slot(x) ((x)->cb[4])
+
+enum l1sap_msgb_slot_state {
+	L1SAP_MSGB_NO_SLOT = 0,	/* from the heap, freed as usual */
+	L1SAP_MSGB_SLOT_FREE,	/* owned by a slot, can be handed out */
+	L1SAP_MSGB_SLOT_BUSY,	/* owned by a slot, carries a primitive */
+};
 
 /* any L1 prim received from bts model */
 int l1sap_up(struct gsm_bts_trx *trx, struct osmo_phsap_prim *l1sap);
@@ -8,6 +8,16 @@
 struct paging_state;
 struct gsm_bts;
 
+/* priority class of a page, in ascending order */
+enum paging_prio {
+	PAGING_PRIO_NORMAL,	/* no eMLPP priority */
+	PAGING_PRIO_EMLPP,	/* eMLPP priority level 0 to 4 */
+	PAGING_PRIO_EMERG,	/* eMLPP priority level A or B */
+	_NUM_PAGING_PRIO
+};
+
+enum paging_prio paging_prio_from_emlpp(uint8_t call_prio);
+
 /* initialize paging code */
 struct paging_state *paging_init(struct gsm_bts *bts,
 				 unsigned int num_paging_max,
@@ -33,12 +43,17 @@ int paging_si_update(struct paging_state *ps, struct gsm48_control_channel_descr
 
 /* Add an identity to the paging queue */
 int paging_add_identity(struct paging_state *ps, uint8_t paging_group,
-			const uint8_t *identity_lv, uint8_t chan_needed);
+			const uint8_t *identity_lv, uint8_t chan_needed,
+			enum paging_prio prio);
 
 /* Add an IMM.ASS message to the paging queue */
 int paging_add_imm_ass(struct paging_state *ps, const uint8_t *data,
                        uint8_t len);
 
+/* adapt the lifetime and the queue limits to a PCH load sample (percent),
+ * sampled by paging_gen_msg() itself */
+void paging_update_load(struct paging_state *ps, unsigned int pch_percent);
+
 /* generate paging message for given gsm time */
 int paging_gen_msg(struct paging_state *ps, uint8_t *out_buf, struct gsm_time *gt,
 		   int *is_empty);
@@ -48,5 +63,9 @@ int paging_gen_msg(struct paging_state *ps, uint8_t *out_buf, struct gsm_time *g
 int paging_group_queue_empty(struct paging_state *ps, uint8_t group);
 int paging_queue_length(struct paging_state *ps);
 int paging_buffer_space(struct paging_state *ps);
+void paging_pool_stats(struct paging_state *ps, unsigned int *size,
+		       unsigned int *used, unsigned int *used_max);
+void paging_load_stats(struct paging_state *ps, unsigned int *pch_load,
+		       unsigned int *lifetime, unsigned int *group_len_max);
 
 #endif
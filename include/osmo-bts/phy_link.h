@@ -11,6 +11,8 @@
 
 struct gsm_bts_trx;
 struct virt_um_inst;
+struct trx_dec_pool;
+struct osmo_trx_clock_state;
 
 enum phy_link_type {
 	PHY_LINK_T_NONE,
@@ -44,12 +46,25 @@ struct phy_link {
 			uint16_t base_port_local;
 			uint16_t base_port_remote;
 			struct osmo_fd trx_ofd_clk;
+			/* FN clock of this PHY link, driven by its clock socket */
+			struct osmo_trx_clock_state *clk_s;
+			int transceiver_available;
 			bool trx_ta_loop;
 			bool trx_ms_power_loop;
 			int8_t trx_target_rssi;
 			uint32_t clock_advance;
 			uint32_t rts_advance;
+			/* let clock_advance and rts_advance follow the lateness
+			 * of bursts and prims, within these bounds */
+			bool auto_advance;
+			uint32_t clock_advance_min, clock_advance_max;
+			uint32_t rts_advance_min, rts_advance_max;
 			bool use_legacy_setbsic;
+			bool tx_batch;
+			unsigned int rx_batch;
+			bool clock_discipline;
+			unsigned int ul_dec_threads;	/* UL decoder threads, 0 = decode inline */
+			struct trx_dec_pool *dec;
 		} osmotrx;
 		struct {
 			char *mcast_dev;		/* Network device for multicast */
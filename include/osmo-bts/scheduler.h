@@ -5,6 +5,8 @@
 
 #include <osmo-bts/gsm_data.h>
 
+struct phy_link;
+
 /* These types define the different channels on a multiframe.
  * Each channel has queues and can be activated individually.
  */
@@ -62,15 +64,33 @@ enum trx_burst_type {
 	TRX_BURST_8PSK,
 };
 
+struct l1sched_trx;
+
+typedef int trx_sched_rts_func(struct l1sched_trx *l1t, uint8_t tn,
+			       uint32_t fn, enum trx_chan_type chan);
+
+typedef ubit_t *trx_sched_dl_func(struct l1sched_trx *l1t, uint8_t tn,
+				  uint32_t fn, enum trx_chan_type chan,
+				  uint8_t bid, uint16_t *nbits);
+
+typedef int trx_sched_ul_func(struct l1sched_trx *l1t, uint8_t tn,
+			      uint32_t fn, enum trx_chan_type chan,
+			      uint8_t bid, sbit_t *bits, uint16_t nbits,
+			      int8_t rssi, int16_t toa256);
+
 /* States each channel on a multiframe */
 struct l1sched_chan_state {
 	/* scheduler */
 	uint8_t			active;		/* Channel is active */
+	uint32_t		act_gen;	/* activation, tags decoder jobs */
 	ubit_t			*dl_bursts;	/* burst buffer for TX */
+	uint8_t			dl_valid;	/* dl_bursts holds a block to send */
 	enum trx_burst_type	dl_burst_type;  /* GMSK or 8PSK burst type */
 	sbit_t			*ul_bursts;	/* burst buffer for RX */
 	uint32_t		ul_first_fn;	/* fn of first burst */
 	uint8_t			ul_mask;	/* mask of received bursts */
+	uint8_t			ul_missed;	/* a burst was missed in overload */
+	uint8_t			ul_ring;	/* TCH block being received in ul_bursts */
 
 	/* RSSI / TOA */
 	uint8_t			rssi_num;	/* number of RSSI values */
@@ -122,13 +142,81 @@ struct l1sched_chan_state {
 	uint8_t			ho_rach_detect;	/* if rach detection is on */
 };
 
+/*! number of FN buckets of the downlink primitive ring of a timeslot.  Must
+ *  be larger than the range in which prims are accepted (100 frames ahead)
+ *  and a power of two, so that it divides GSM_HYPERFRAME. */
+#define TRX_SCHED_PRIM_RING	128
+
+/*! number of RTS primitives preallocated per timeslot.  A timeslot starts
+ *  at most two blocks every four frames and each stays in the prim ring for
+ *  rts-advance frames, so this covers rts-advance up to 30; beyond that the
+ *  primitives come from the heap. */
+#define TRX_SCHED_RTS_SLOTS	16
+
+/*! number of bins of the downlink prim slack histogram, see
+ *  trx_sched_slack_bin() */
+#define TRX_SCHED_SLACK_BINS	8
+
+/*! number of uplink keystreams kept per timeslot, must cover the clock
+ *  advance and be a power of two, so that it divides GSM_HYPERFRAME */
+#define TRX_SCHED_KS_RING	64
+
+/* uplink keystream of a frame, generated along with the downlink one */
+struct l1sched_ks {
+	uint32_t		fn;
+	uint8_t			algo;		/* A5/x, 0 if unused */
+	uint8_t			key[8];		/* only 8 byte keys are supported */
+	ubit_t			ks[114];
+};
+
+/*! longest multiframe period of all channel combinations */
+#define TRX_SCHED_MF_PERIOD_MAX	104
+
+/* Precompiled dispatch of one frame of a timeslot's multiframe, so that
+ * the per-burst path does not need to look at the frame layout and the
+ * channel descriptions.  Rebuilt by trx_sched_set_pchan() and
+ * trx_sched_set_lchan() only. */
+struct l1sched_frame_plan {
+	trx_sched_rts_func	*rts_fn;	/* NULL unless RTS on this frame */
+	trx_sched_dl_func	*dl_fn;
+	trx_sched_ul_func	*ul_fn;
+	struct l1sched_chan_state *dl_cs;
+	struct l1sched_chan_state *ul_cs;
+	uint8_t			dl_chan;	/* enum trx_chan_type */
+	uint8_t			dl_bid;
+	uint8_t			ul_chan;	/* enum trx_chan_type */
+	uint8_t			ul_bid;
+	uint8_t			dl_active;	/* channel is active or auto-active */
+	uint8_t			ul_active;
+};
+
 struct l1sched_ts {
 	uint8_t 		mf_index;	/* selected multiframe index */
 	uint32_t 		mf_last_fn;	/* last received frame number */
 	uint8_t			mf_period;	/* period of multiframe */
 	const struct trx_sched_frame *mf_frames; /* pointer to frame layout */
 
-	struct llist_head	dl_prims;	/* Queue primitives for TX */
+	/* Queue primitives for TX, indexed by fn % TRX_SCHED_PRIM_RING */
+	struct llist_head	dl_prims[TRX_SCHED_PRIM_RING];
+	unsigned int		dl_prims_dropped;	/* stale prims dropped */
+	unsigned int		dl_prims_unreported;	/* ... and not logged yet */
+	/* uplink bursts missed because frames were skipped, see
+	 * trx_sched_ul_burst() */
+	unsigned int		ul_bursts_missed;
+	unsigned int		ul_bursts_unreported;	/* ... and not logged yet */
+	uint32_t		ul_missed_report_fn;	/* when they were logged */
+
+	/* preallocated msgbs for PH-RTS.ind / TCH-RTS.ind, see sched_rts_msgb() */
+	struct msgb		*rts_slot[TRX_SCHED_RTS_SLOTS];
+
+	/* uplink keystreams, indexed by fn % TRX_SCHED_KS_RING */
+	struct l1sched_ks	ul_ks[TRX_SCHED_KS_RING];
+
+	/* dispatch plan, indexed by fn % mf_period */
+	struct l1sched_frame_plan mf_plan[TRX_SCHED_MF_PERIOD_MAX] __attribute__((aligned(64)));
+
+	/* this timeslot's slice of the burst buffer arena of the TRX */
+	uint8_t			*bursts_base;
 
 	/* Channel states for all logical channels */
 	struct l1sched_chan_state chan_state[_TRX_CHAN_MAX];
@@ -137,6 +225,24 @@ struct l1sched_ts {
 struct l1sched_trx {
 	struct gsm_bts_trx	*trx;
 	struct l1sched_ts       ts[TRX_NR_TS];
+	/* burst buffers of all logical channels, carved per timeslot
+	 * according to its channel combination */
+	void			*bursts_arena;
+	/* set by the backend while it asks for a downlink burst: where
+	 * the burst should be composed, e.g. its outgoing datagram */
+	ubit_t			*dl_burst_out;
+	/* set by the backend before it asks for the bursts of a frame, so
+	 * that the slack of downlink prims can be measured */
+	uint32_t		dl_fn;
+	uint8_t			dl_fn_valid;
+	/* frames by which downlink prims arrived ahead of the frame being
+	 * composed, binned by trx_sched_slack_bin().  The minimum is reset
+	 * by the backend, INT_MAX if no prim arrived since. */
+	uint64_t		dl_prim_slack[TRX_SCHED_SLACK_BINS];
+	int			dl_prim_slack_min;
+	/* counts channel activations, so that a block still being decoded
+	 * can be told from the ones of a later activation */
+	uint32_t		act_gen;
 };
 
 struct l1sched_ts *l1sched_trx_get_ts(struct l1sched_trx *l1t, uint8_t tn);
@@ -149,6 +255,10 @@ extern uint32_t trx_rts_advance;
 extern uint32_t transceiver_last_fn;
 
 
+/*! \brief Histogram bin of a slack or lag in frames: <=0, 1, 2, 3-4, 5-8,
+ *  9-16, 17-32, more */
+unsigned int trx_sched_slack_bin(int frames);
+
 /*! \brief Initialize the scheduler data structures */
 int trx_sched_init(struct l1sched_trx *l1t, struct gsm_bts_trx *trx);
 
@@ -162,7 +272,7 @@ int trx_sched_ph_data_req(struct l1sched_trx *l1t, struct osmo_phsap_prim *l1sap
 int trx_sched_tch_req(struct l1sched_trx *l1t, struct osmo_phsap_prim *l1sap);
 
 /*! \brief PHY informs us of new (current) GSM frame number */
-int trx_sched_clock(struct gsm_bts *bts, uint32_t fn);
+int trx_sched_clock(struct phy_link *plink, uint32_t fn);
 
 /*! \brief handle an UL burst received by PHY */
 int trx_sched_ul_burst(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
@@ -6,18 +6,6 @@
 			gsm_ts_name(&(l1t)->trx->ts[tn]),	\
 			chan >=0 ? trx_chan_desc[chan].name : "", ## args)
 
-typedef int trx_sched_rts_func(struct l1sched_trx *l1t, uint8_t tn,
-			       uint32_t fn, enum trx_chan_type chan);
-
-typedef ubit_t *trx_sched_dl_func(struct l1sched_trx *l1t, uint8_t tn,
-				  uint32_t fn, enum trx_chan_type chan,
-				  uint8_t bid, uint16_t *nbits);
-
-typedef int trx_sched_ul_func(struct l1sched_trx *l1t, uint8_t tn,
-			      uint32_t fn, enum trx_chan_type chan,
-			      uint8_t bid, sbit_t *bits, uint16_t nbits,
-			      int8_t rssi, int16_t toa256);
-
 struct trx_chan_desc {
 	/*! \brief Is this on a PDCH (PS) ? */
 	int			pdch;
@@ -91,4 +79,15 @@ int rx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 const ubit_t *_sched_dl_burst(struct l1sched_trx *l1t, uint8_t tn,
 			      uint32_t fn, uint16_t *nbits);
 int _sched_rts(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn);
+void _sched_ks_xor(ubit_t *bits, const ubit_t *ks);
+void _sched_ks_negate(sbit_t *bits, const ubit_t *ks);
+void _sched_dl_encrypt(struct l1sched_ts *l1ts, struct l1sched_chan_state *l1cs,
+		       uint32_t fn, ubit_t *bits);
+void _sched_ul_decrypt(struct l1sched_ts *l1ts, struct l1sched_chan_state *l1cs,
+		       uint32_t fn, sbit_t *bits);
+void _sched_ul_ring_burst(struct l1sched_chan_state *chan_state,
+			  enum trx_chan_type chan, uint8_t bid,
+			  const sbit_t *bits);
+sbit_t *_sched_ul_ring_block(struct l1sched_chan_state *chan_state,
+			     enum trx_chan_type chan);
 void _sched_act_rach_det(struct l1sched_trx *l1t, uint8_t tn, uint8_t ss, int activate);
@@ -86,6 +86,19 @@ static const struct rate_ctr_desc bts_ctr_desc[] = {
 	[BTS_CTR_PAGING_RCVD] =		{"paging:rcvd", "Received paging requests (Abis)"},
 	[BTS_CTR_PAGING_DROP] =		{"paging:drop", "Dropped paging requests (Abis)"},
 	[BTS_CTR_PAGING_SENT] =		{"paging:sent", "Sent paging requests (Um)"},
+	[BTS_CTR_PAGING_IDS_1] =	{"paging:ids1", "Sent paging blocks with one identity (Um)"},
+	[BTS_CTR_PAGING_IDS_2] =	{"paging:ids2", "Sent paging blocks with two identities (Um)"},
+	[BTS_CTR_PAGING_IDS_3] =	{"paging:ids3", "Sent paging blocks with three identities (Um)"},
+	[BTS_CTR_PAGING_IDS_4] =	{"paging:ids4", "Sent paging blocks with four identities (Um)"},
+	[BTS_CTR_PAGING_DROP_NORMAL] =	{"paging:drop:normal", "Dropped normal paging requests"},
+	[BTS_CTR_PAGING_DROP_EMLPP] =	{"paging:drop:emlpp", "Dropped eMLPP priority paging requests"},
+	[BTS_CTR_PAGING_DROP_EMERG] =	{"paging:drop:emerg", "Dropped emergency paging requests"},
+	[BTS_CTR_PAGING_FIRST_NORMAL] =	{"paging:first:normal", "Normal paging requests sent the first time (Um)"},
+	[BTS_CTR_PAGING_FIRST_EMLPP] =	{"paging:first:emlpp", "eMLPP priority paging requests sent the first time (Um)"},
+	[BTS_CTR_PAGING_FIRST_EMERG] =	{"paging:first:emerg", "Emergency paging requests sent the first time (Um)"},
+	[BTS_CTR_PAGING_DELAY_NORMAL] =	{"paging:delay:normal", "Total delay of normal paging requests until sent (ms)"},
+	[BTS_CTR_PAGING_DELAY_EMLPP] =	{"paging:delay:emlpp", "Total delay of eMLPP priority paging requests until sent (ms)"},
+	[BTS_CTR_PAGING_DELAY_EMERG] =	{"paging:delay:emerg", "Total delay of emergency paging requests until sent (ms)"},
 
 	[BTS_CTR_RACH_RCVD] =		{"rach:rcvd", "Received RACH requests (Um)"},
 	[BTS_CTR_RACH_DROP] =		{"rach:drop", "Dropped RACH requests (Um)"},
@@ -96,6 +109,9 @@ static const struct rate_ctr_desc bts_ctr_desc[] = {
 	[BTS_CTR_AGCH_RCVD] =		{"agch:rcvd", "Received AGCH requests (Abis)"},
 	[BTS_CTR_AGCH_SENT] =		{"agch:sent", "Sent AGCH requests (Abis)"},
 	[BTS_CTR_AGCH_DELETED] =	{"agch:delete", "Sent AGCH DELETE IND (Abis)"},
+
+	[BTS_CTR_UL_BURST_MISSED] =	{"ul:burst_missed", "Uplink bursts of skipped frames (overload)"},
+	[BTS_CTR_UL_BLOCK_MISSED] =	{"ul:block_missed", "Uplink blocks indicated bad without decoding (overload)"},
 };
 static const struct rate_ctr_group_desc bts_ctrg_desc = {
 	"bts",
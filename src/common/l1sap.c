@@ -163,9 +163,11 @@ static void queue_limit_to(const char *prefix, struct llist_head *queue, unsigne
 /* allocate a msgb containing a osmo_phsap_prim + optional l2 data
  * in order to wrap femtobts header arround l2 data, there must be enough space
  * in front and behind data pointer */
+#define L1SAP_MSGB_HEADROOM	128
+
 struct msgb *l1sap_msgb_alloc(unsigned int l2_len)
 {
-	int headroom = 128;
+	int headroom = L1SAP_MSGB_HEADROOM;
 	int size = headroom + sizeof(struct osmo_phsap_prim) + l2_len;
 	struct msgb *msg = msgb_alloc_headroom(size, headroom, "l1sap_prim");
 
@@ -177,6 +179,26 @@ struct msgb *l1sap_msgb_alloc(unsigned int l2_len)
 	return msg;
 }
 
+/* bring a msgb from l1sap_msgb_alloc() back into its initial state, so a
+ * preallocated msgb can carry one primitive after another */
+void l1sap_msgb_reset(struct msgb *msg)
+{
+	msgb_reset(msg);
+	msgb_reserve(msg, L1SAP_MSGB_HEADROOM);
+	msg->l1h = msgb_put(msg, sizeof(struct osmo_phsap_prim));
+}
+
+/* free a msgb carrying a primitive.  A preallocated msgb is not freed,
+ * only marked free in its slot, so its owner can hand it out again. */
+void l1sap_msgb_free(struct msgb *msg)
+{
+	if (msg && l1sap_msgb_slot(msg) == L1SAP_MSGB_SLOT_BUSY) {
+		l1sap_msgb_slot(msg) = L1SAP_MSGB_SLOT_FREE;
+		return;
+	}
+	msgb_free(msg);
+}
+
 int add_l1sap_header(struct gsm_bts_trx *trx, struct msgb *rmsg,
 		     struct gsm_lchan *lchan, uint8_t chan_nr, uint32_t fn,
 		     uint16_t ber10k, int16_t lqual_cb)
@@ -1371,7 +1393,7 @@ int l1sap_up(struct gsm_bts_trx *trx, struct osmo_phsap_prim *l1sap)
 
 	/* Special return value '1' means: do not free */
 	if (rc != 1)
-		msgb_free(msg);
+		l1sap_msgb_free(msg);
 
 	return rc;
 }
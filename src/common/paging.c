@@ -20,7 +20,6 @@
  */
 
 /* TODO:
-	* eMLPP priprity
 	* add P1/P2/P3 rest octets
  */
 
@@ -28,7 +27,6 @@
 #include <stdint.h>
 #include <errno.h>
 #include <string.h>
-#include <time.h>
 
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/linuxlist.h>
@@ -47,6 +45,23 @@
 #define MAX_PAGING_BLOCKS_CCCH	9
 #define MAX_BS_PA_MFRMS		9
 
+/* buckets of the identity hash, see paging_hash() */
+#define PAGING_HASH_BITS	10
+#define PAGING_HASH_SIZE	(1 << PAGING_HASH_BITS)
+
+/* expiry timing wheel, see paging_wheel_advance().  A tick is four 51
+ * multiframes (12240/13 ms, ~0.94 s), which divides the hyperframe. */
+#define PAGING_WHEEL_TICK_FN	(4 * 51)
+#define PAGING_WHEEL_TICKS	(GSM_HYPERFRAME / PAGING_WHEEL_TICK_FN)
+#define PAGING_WHEEL_SLOTS	64
+
+/* smoothed PCH load (percent) up to which the configured lifetime and
+ * queue size apply, and from which pages are sent only once and a group
+ * holds no more than PAGING_GROUP_LEN_MIN records, see paging_load_scale() */
+#define PAGING_LOAD_LOW		50
+#define PAGING_LOAD_HIGH	90
+#define PAGING_GROUP_LEN_MIN	4	/* one paging block worth */
+
 enum paging_record_type {
 	PAGING_RECORD_PAGING,
 	PAGING_RECORD_IMM_ASS
@@ -55,9 +70,21 @@ enum paging_record_type {
 struct paging_record {
 	struct llist_head list;
 	enum paging_record_type type;
+	uint8_t pooled;		/* from paging_state.pool_free */
 	union {
 		struct {
-			time_t expiration_time;
+			/* in paging_state.paging_hash for as long as the
+			 * record is queued, to find duplicates */
+			struct llist_head hash_list;
+			/* in paging_state.wheel until it expires */
+			struct llist_head wheel_list;
+			uint32_t expire_tick;
+			uint32_t start_tick;	/* queued or refreshed */
+			uint32_t queued_fn;	/* to measure the delay */
+			uint8_t sent;		/* was paged at least once */
+			uint8_t expired;	/* free it once it was paged */
+			uint8_t prio;		/* enum paging_prio */
+			uint8_t group;
 			uint8_t chan_needed;
 			uint8_t identity_lv[9];
 		} paging;
@@ -79,9 +106,194 @@ struct paging_state {
 
 	/* total number of currently active paging records in queue */
 	unsigned int num_paging;
-	struct llist_head paging_queue[MAX_PAGING_BLOCKS_CCCH*MAX_BS_PA_MFRMS];
+	/* per paging group, a queue of paging records by priority class,
+	 * served by weighted round robin, see paging_wrr_pick() */
+	struct llist_head paging_queue[_NUM_PAGING_PRIO][MAX_PAGING_BLOCKS_CCCH*MAX_BS_PA_MFRMS];
+	int paging_wrr[MAX_PAGING_BLOCKS_CCCH*MAX_BS_PA_MFRMS][_NUM_PAGING_PRIO];
+	/* IMM.ASS from the PCU, sent ahead of any paging */
+	struct llist_head imm_ass_queue[MAX_PAGING_BLOCKS_CCCH*MAX_BS_PA_MFRMS];
+	/* paging records of all the queues above, by identity */
+	struct llist_head paging_hash[PAGING_HASH_SIZE];
+
+	/* paging records are taken from slabs allocated up front, enough
+	 * for num_paging_max, see paging_pool_grow() */
+	struct llist_head pool_free;
+	unsigned int pool_size;
+	unsigned int pool_used;
+	unsigned int pool_used_max;
+
+	/* paging records by expiry tick, driven by the frame numbers of
+	 * paging_gen_msg() rather than by the wall clock */
+	struct llist_head wheel[PAGING_WHEEL_SLOTS];
+	uint32_t wheel_tick;		/* monotonic */
+	uint32_t wheel_fn_tick;		/* last FN / PAGING_WHEEL_TICK_FN */
+	int wheel_valid;
+	uint32_t last_fn;		/* of the last paging block */
+
+	/* paging blocks since the last PCH load sample, counted like
+	 * bts->load.ccch, which is reset at the load indication period */
+	unsigned int load_blocks;
+	unsigned int load_used;
+	unsigned int pch_load;		/* smoothed, in percent */
+	/* paging records per group, limited under PCH load */
+	unsigned int group_len[MAX_PAGING_BLOCKS_CCCH*MAX_BS_PA_MFRMS];
+};
+
+/* share of the paging blocks of a group each class gets while all of them
+ * have records queued */
+static const int paging_prio_weight[_NUM_PAGING_PRIO] = {
+	[PAGING_PRIO_NORMAL]	= 1,
+	[PAGING_PRIO_EMLPP]	= 4,
+	[PAGING_PRIO_EMERG]	= 16,
+};
+
+static const char *paging_prio_names[_NUM_PAGING_PRIO] = {
+	[PAGING_PRIO_NORMAL]	= "normal",
+	[PAGING_PRIO_EMLPP]	= "eMLPP",
+	[PAGING_PRIO_EMERG]	= "emergency",
 };
 
+/* priority class of a page by the call priority of its RSL eMLPP Priority
+ * IE (3GPP TS 48.058 9.3.49): 0 is no priority, 1 to 5 are the subscriber
+ * levels 4 to 0, 6 and 7 are the levels B and A reserved for emergency and
+ * network use (A > B > 0 > 1 > 2 > 3 > 4, 3GPP TS 22.067) */
+enum paging_prio paging_prio_from_emlpp(uint8_t call_prio)
+{
+	switch (call_prio & 0x07) {
+	case 0:
+		return PAGING_PRIO_NORMAL;
+	case 6:
+	case 7:
+		return PAGING_PRIO_EMERG;
+	default:
+		return PAGING_PRIO_EMLPP;
+	}
+}
+
+/* make sure the pool holds at least size records.  It never shrinks, the
+ * records may still be queued. */
+static int paging_pool_grow(struct paging_state *ps, unsigned int size)
+{
+	struct paging_record *slab;
+	unsigned int i, num;
+
+	if (size <= ps->pool_size)
+		return 0;
+
+	num = size - ps->pool_size;
+	slab = talloc_array(ps, struct paging_record, num);
+	if (!slab) {
+		LOGP(DPAG, LOGL_ERROR, "Cannot grow the paging record pool "
+			"from %u to %u\n", ps->pool_size, size);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < num; i++)
+		llist_add_tail(&slab[i].list, &ps->pool_free);
+	ps->pool_size += num;
+
+	return 0;
+}
+
+static struct paging_record *paging_record_alloc(struct paging_state *ps)
+{
+	struct paging_record *pr;
+
+	if (llist_empty(&ps->pool_free))
+		return NULL;
+
+	pr = llist_entry(ps->pool_free.next, struct paging_record, list);
+	llist_del(&pr->list);
+	memset(pr, 0, sizeof(*pr));
+	pr->pooled = 1;
+
+	ps->pool_used++;
+	if (ps->pool_used > ps->pool_used_max)
+		ps->pool_used_max = ps->pool_used;
+
+	return pr;
+}
+
+/* scale a limit from its configured value at low PCH load down to its
+ * tightest value at high PCH load */
+static unsigned int paging_load_scale(struct paging_state *ps, unsigned int relaxed,
+				      unsigned int tight)
+{
+	if (ps->pch_load <= PAGING_LOAD_LOW || relaxed <= tight)
+		return relaxed;
+	if (ps->pch_load >= PAGING_LOAD_HIGH)
+		return tight;
+	return tight + (relaxed - tight) * (PAGING_LOAD_HIGH - ps->pch_load) /
+		(PAGING_LOAD_HIGH - PAGING_LOAD_LOW);
+}
+
+/* the lifetime of a paging record in seconds, shortened under load so that
+ * fresh pages get the blocks which would retransmit stale ones */
+static unsigned int paging_lifetime_eff(struct paging_state *ps)
+{
+	return paging_load_scale(ps, ps->paging_lifetime, 0);
+}
+
+/* the number of records a paging group may hold */
+static unsigned int paging_group_len_max(struct paging_state *ps)
+{
+	return paging_load_scale(ps, ps->num_paging_max, PAGING_GROUP_LEN_MIN);
+}
+
+/* the number of ticks a paging record lives, rounded up */
+static uint32_t paging_lifetime_ticks(struct paging_state *ps)
+{
+	return (paging_lifetime_eff(ps) * 13000 + 12239) / 12240;
+}
+
+static void paging_wheel_add(struct paging_state *ps, struct paging_record *pr)
+{
+	llist_add_tail(&pr->u.paging.wheel_list,
+		       &ps->wheel[pr->u.paging.expire_tick % PAGING_WHEEL_SLOTS]);
+}
+
+/* expired, by the lifetime as it is now: a record which was put on the
+ * wheel with a longer one is caught when it is paged */
+static int paging_expired(struct paging_state *ps, struct paging_record *pr)
+{
+	return pr->u.paging.expired ||
+		(int32_t)(pr->u.paging.start_tick + paging_lifetime_ticks(ps) -
+			  ps->wheel_tick) <= 0;
+}
+
+/* (re)start the lifetime of a paging record */
+static void paging_record_start(struct paging_state *ps, struct paging_record *pr)
+{
+	pr->u.paging.start_tick = ps->wheel_tick;
+	pr->u.paging.expire_tick = ps->wheel_tick + paging_lifetime_ticks(ps);
+}
+
+/* feed a sample of the PCH load, in percent.  It is smoothed, so that the
+ * limits tighten within a few samples of an overload and relax as it fades. */
+void paging_update_load(struct paging_state *ps, unsigned int pch_percent)
+{
+	unsigned int lifetime = paging_lifetime_eff(ps);
+	unsigned int group_len_max = paging_group_len_max(ps);
+
+	ps->pch_load = (ps->pch_load + pch_percent) / 2;
+
+	if (paging_lifetime_eff(ps) != lifetime || paging_group_len_max(ps) != group_len_max)
+		LOGP(DPAG, LOGL_INFO, "PCH load %u%%, paging lifetime now %us, "
+			"group queue limit %u\n", ps->pch_load,
+			paging_lifetime_eff(ps), paging_group_len_max(ps));
+}
+
+/* sample the PCH load of the paging blocks since the last sample */
+static void paging_load_sample(struct paging_state *ps)
+{
+	if (!ps->load_blocks)
+		return;
+
+	paging_update_load(ps, ps->load_used * 100 / ps->load_blocks);
+	ps->load_blocks = 0;
+	ps->load_used = 0;
+}
+
 unsigned int paging_get_lifetime(struct paging_state *ps)
 {
 	return ps->paging_lifetime;
@@ -100,6 +312,7 @@ void paging_set_lifetime(struct paging_state *ps, unsigned int lifetime)
 void paging_set_queue_max(struct paging_state *ps, unsigned int queue_max)
 {
 	ps->num_paging_max = queue_max;
+	paging_pool_grow(ps, queue_max);
 }
 
 static int tmsi_mi_to_uint(uint32_t *out, const uint8_t *tmsi_lv)
@@ -114,6 +327,115 @@ static int tmsi_mi_to_uint(uint32_t *out, const uint8_t *tmsi_lv)
 	return 0;
 }
 
+/* bucket of an identity in paging_state.paging_hash.  TMSIs are random
+ * already, so they are used as they are; other identities (IMSI, IMEI)
+ * are hashed over their digits, FNV-1a. */
+static unsigned int paging_hash(const uint8_t *identity_lv)
+{
+	uint32_t h;
+	unsigned int i;
+
+	if (tmsi_mi_to_uint(&h, identity_lv) < 0) {
+		h = 2166136261U;
+		for (i = 0; i <= identity_lv[0]; i++)
+			h = (h ^ identity_lv[i]) * 16777619U;
+	}
+
+	return (h * 2654435761U) >> (32 - PAGING_HASH_BITS);
+}
+
+/* find the paging record of an identity in a paging group */
+static struct paging_record *paging_hash_find(struct paging_state *ps, uint8_t group,
+					      const uint8_t *identity_lv)
+{
+	struct llist_head *bucket = &ps->paging_hash[paging_hash(identity_lv)];
+	struct paging_record *pr;
+
+	llist_for_each_entry(pr, bucket, u.paging.hash_list) {
+		if (pr->u.paging.group == group &&
+		    identity_lv[0] == pr->u.paging.identity_lv[0] &&
+		    !memcmp(identity_lv+1, pr->u.paging.identity_lv+1,
+							identity_lv[0]))
+			return pr;
+	}
+
+	return NULL;
+}
+
+/* free a record which is no longer queued */
+static void paging_record_free(struct paging_state *ps, struct paging_record *pr)
+{
+	if (pr->type == PAGING_RECORD_PAGING) {
+		llist_del(&pr->u.paging.hash_list);
+		llist_del(&pr->u.paging.wheel_list);
+		ps->group_len[pr->u.paging.group]--;
+	}
+
+	if (!pr->pooled) {
+		talloc_free(pr);
+		return;
+	}
+	llist_add(&pr->list, &ps->pool_free);
+	ps->pool_used--;
+}
+
+/* expire the paging records of a slot of the wheel.  A record which was
+ * never paged is only marked, so that it is paged at least once. */
+static void paging_wheel_expire(struct paging_state *ps, unsigned int slot)
+{
+	struct paging_record *pr, *pr2;
+	LLIST_HEAD(due);
+
+	llist_splice_init(&ps->wheel[slot], &due);
+
+	llist_for_each_entry_safe(pr, pr2, &due, u.paging.wheel_list) {
+		/* refreshed by a duplicate, beyond one turn of the wheel,
+		 * or the lifetime was raised since */
+		if (!paging_expired(ps, pr)) {
+			llist_del(&pr->u.paging.wheel_list);
+			pr->u.paging.expire_tick = pr->u.paging.start_tick +
+						   paging_lifetime_ticks(ps);
+			paging_wheel_add(ps, pr);
+			continue;
+		}
+
+		if (!pr->u.paging.sent) {
+			llist_del_init(&pr->u.paging.wheel_list);
+			pr->u.paging.expired = 1;
+			continue;
+		}
+
+		llist_del(&pr->list);
+		paging_record_free(ps, pr);
+		ps->num_paging--;
+		LOGP(DPAG, LOGL_INFO, "Expired paging record, queue_len=%u\n",
+			ps->num_paging);
+	}
+}
+
+/* advance the wheel to the frame number of a paging block */
+static void paging_wheel_advance(struct paging_state *ps, uint32_t fn)
+{
+	uint32_t fn_tick = fn / PAGING_WHEEL_TICK_FN;
+	uint32_t delta, i;
+
+	if (!ps->wheel_valid) {
+		ps->wheel_fn_tick = fn_tick;
+		ps->wheel_valid = 1;
+		return;
+	}
+
+	delta = (fn_tick + PAGING_WHEEL_TICKS - ps->wheel_fn_tick) % PAGING_WHEEL_TICKS;
+	if (!delta)
+		return;
+	ps->wheel_fn_tick = fn_tick;
+	ps->wheel_tick += delta;
+
+	/* after a jump, one turn of the wheel covers all records */
+	for (i = 0; i < delta && i < PAGING_WHEEL_SLOTS; i++)
+		paging_wheel_expire(ps, (ps->wheel_tick - i) % PAGING_WHEEL_SLOTS);
+}
+
 /* paging block numbers in a simple non-combined CCCH */
 static const uint8_t block_by_tdma51[51] = {
 	255, 255,		/* FCCH, SCH */
@@ -173,11 +495,72 @@ int paging_buffer_space(struct paging_state *ps)
 		return ps->num_paging_max - ps->num_paging;
 }
 
+static void paging_drop(struct paging_state *ps, enum paging_prio prio)
+{
+	rate_ctr_inc2(ps->bts->ctrs, BTS_CTR_PAGING_DROP);
+	rate_ctr_inc2(ps->bts->ctrs, BTS_CTR_PAGING_DROP_NORMAL + prio);
+}
+
+/* make room for a page of a priority class in a full queue, by dropping
+ * the last record of a lower class, preferably of the same group */
+static int paging_evict(struct paging_state *ps, uint8_t paging_group,
+			enum paging_prio prio)
+{
+	unsigned int num_groups = ARRAY_SIZE(ps->paging_queue[0]);
+	struct llist_head *queue;
+	struct paging_record *pr;
+	unsigned int c, i;
+
+	for (c = PAGING_PRIO_NORMAL; c < prio; c++) {
+		for (i = 0; i < num_groups; i++) {
+			queue = &ps->paging_queue[c][(paging_group + i) % num_groups];
+			if (llist_empty(queue))
+				continue;
+			pr = llist_entry(queue->prev, struct paging_record, list);
+			llist_del(&pr->list);
+			paging_record_free(ps, pr);
+			ps->num_paging--;
+			paging_drop(ps, c);
+			LOGP(DPAG, LOGL_NOTICE, "Dropping %s paging for %s paging, "
+				"queue full (%u)\n", paging_prio_names[c],
+				paging_prio_names[prio], ps->num_paging + 1);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* make room in a paging group at its limit by dropping the record due to be
+ * retransmitted next, of the lowest class.  Records which were not paged
+ * yet are kept. */
+static int paging_evict_sent(struct paging_state *ps, uint8_t paging_group)
+{
+	struct paging_record *pr;
+	unsigned int c;
+
+	for (c = PAGING_PRIO_NORMAL; c < _NUM_PAGING_PRIO; c++) {
+		llist_for_each_entry(pr, &ps->paging_queue[c][paging_group], list) {
+			if (!pr->u.paging.sent)
+				continue;
+			llist_del(&pr->list);
+			paging_record_free(ps, pr);
+			ps->num_paging--;
+			LOGP(DPAG, LOGL_INFO, "Dropping paging already sent, group %u "
+				"at its limit\n", paging_group);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 /* Add an identity to the paging queue */
 int paging_add_identity(struct paging_state *ps, uint8_t paging_group,
-			const uint8_t *identity_lv, uint8_t chan_needed)
+			const uint8_t *identity_lv, uint8_t chan_needed,
+			enum paging_prio prio)
 {
-	struct llist_head *group_q = &ps->paging_queue[paging_group];
+	struct llist_head *group_q = &ps->paging_queue[prio][paging_group];
 	int blocks = gsm48_number_of_paging_subchannels(&ps->chan_desc);
 	struct paging_record *pr;
 
@@ -186,52 +569,76 @@ int paging_add_identity(struct paging_state *ps, uint8_t paging_group,
 	if (paging_group >= blocks) {
 		LOGP(DPAG, LOGL_ERROR, "BSC Send PAGING for group %u, but number of paging "
 			"sub-channels is only %u\n", paging_group, blocks);
-		rate_ctr_inc2(ps->bts->ctrs, BTS_CTR_PAGING_DROP);
+		paging_drop(ps, prio);
 		return -EINVAL;
 	}
 
-	if (ps->num_paging >= ps->num_paging_max) {
-		LOGP(DPAG, LOGL_NOTICE, "Dropping paging, queue full (%u)\n",
-			ps->num_paging);
-		rate_ctr_inc2(ps->bts->ctrs, BTS_CTR_PAGING_DROP);
-		return -ENOSPC;
-	}
+	if (*identity_lv + 1 > sizeof(pr->u.paging.identity_lv))
+		return -E2BIG;
 
 	/* Check if we already have this identity */
-	llist_for_each_entry(pr, group_q, list) {
-		if (pr->type != PAGING_RECORD_PAGING)
-			continue;
-		if (identity_lv[0] == pr->u.paging.identity_lv[0] &&
-		    !memcmp(identity_lv+1, pr->u.paging.identity_lv+1,
-							identity_lv[0])) {
-			LOGP(DPAG, LOGL_INFO, "Ignoring duplicate paging\n");
-			pr->u.paging.expiration_time =
-					time(NULL) + ps->paging_lifetime;
-			return -EEXIST;
+	pr = paging_hash_find(ps, paging_group, identity_lv);
+	if (pr) {
+		LOGP(DPAG, LOGL_INFO, "Ignoring duplicate paging\n");
+		paging_record_start(ps, pr);
+		if (pr->u.paging.expired) {
+			pr->u.paging.expired = 0;
+			paging_wheel_add(ps, pr);
 		}
+		/* but take the higher priority */
+		if (prio > pr->u.paging.prio) {
+			pr->u.paging.prio = prio;
+			llist_del(&pr->list);
+			llist_add(&pr->list, group_q);
+		}
+		return -EEXIST;
 	}
 
-	pr = talloc_zero(ps, struct paging_record);
-	if (!pr)
-		return -ENOMEM;
-	pr->type = PAGING_RECORD_PAGING;
+	/* under PCH load a group is limited, in favour of pages which were
+	 * not sent yet */
+	if (paging_group_len_max(ps) < ps->num_paging_max &&
+	    ps->group_len[paging_group] >= paging_group_len_max(ps) &&
+	    !paging_evict_sent(ps, paging_group)) {
+		LOGP(DPAG, LOGL_NOTICE, "Dropping %s paging, group %u at its limit "
+			"of %u under PCH load %u%%\n", paging_prio_names[prio],
+			paging_group, paging_group_len_max(ps), ps->pch_load);
+		paging_drop(ps, prio);
+		return -ENOSPC;
+	}
 
-	if (*identity_lv + 1 > sizeof(pr->u.paging.identity_lv)) {
-		talloc_free(pr);
-		return -E2BIG;
+	if (ps->num_paging >= ps->num_paging_max && !paging_evict(ps, paging_group, prio)) {
+		LOGP(DPAG, LOGL_NOTICE, "Dropping %s paging, queue full (%u)\n",
+			paging_prio_names[prio], ps->num_paging);
+		paging_drop(ps, prio);
+		return -ENOSPC;
 	}
 
+	pr = paging_record_alloc(ps);
+	if (!pr) {
+		LOGP(DPAG, LOGL_ERROR, "Dropping paging, no record left in the pool (%u)\n",
+			ps->pool_size);
+		paging_drop(ps, prio);
+		return -ENOMEM;
+	}
+	pr->type = PAGING_RECORD_PAGING;
+
 	LOGP(DPAG, LOGL_INFO, "Add paging to queue (group=%u, queue_len=%u)\n",
 		paging_group, ps->num_paging+1);
 
-	pr->u.paging.expiration_time = time(NULL) + ps->paging_lifetime;
+	paging_record_start(ps, pr);
+	pr->u.paging.queued_fn = ps->last_fn;
+	pr->u.paging.prio = prio;
+	pr->u.paging.group = paging_group;
 	pr->u.paging.chan_needed = chan_needed;
 	memcpy(&pr->u.paging.identity_lv, identity_lv, identity_lv[0]+1);
+	llist_add(&pr->u.paging.hash_list, &ps->paging_hash[paging_hash(identity_lv)]);
+	paging_wheel_add(ps, pr);
 
 	/* enqueue the new identity to the HEAD of the queue,
 	 * to ensure it will be paged quickly at least once.  */
 	llist_add(&pr->list, group_q);
 	ps->num_paging++;
+	ps->group_len[paging_group]++;
 
 	return 0;
 }
@@ -255,8 +662,10 @@ int paging_add_imm_ass(struct paging_state *ps, const uint8_t *data,
 	imsi += (*(data++)) - '0';
 	paging_group = gsm0502_calc_paging_group(&ps->chan_desc, imsi);
 
-	group_q = &ps->paging_queue[paging_group];
+	group_q = &ps->imm_ass_queue[paging_group];
 
+	/* not from the pool: IMM.ASS are rare, and don't count against
+	 * num_paging_max which the pool is sized for */
 	pr = talloc_zero(ps, struct paging_record);
 	if (!pr)
 		return -ENOMEM;
@@ -266,8 +675,8 @@ int paging_add_imm_ass(struct paging_state *ps, const uint8_t *data,
 		paging_group);
 	memcpy(pr->u.imm_ass.msg, data, GSM_MACBLOCK_LEN);
 
-	/* enqueue the new message to the HEAD of the queue */
-	llist_add(&pr->list, group_q);
+	/* enqueue the new message, they are sent in order */
+	llist_add_tail(&pr->list, group_q);
 
 	return 0;
 }
@@ -352,54 +761,145 @@ static int fill_paging_type_3(uint8_t *out_buf, const uint8_t *tmsi1_lv, uint8_t
 
 static const uint8_t empty_id_lv[] = { 0x01, 0xF0 };
 
-static struct paging_record *dequeue_pr(struct llist_head *group_q)
-{
-	struct paging_record *pr;
+/* number of paging records at the head of a group queue which are
+ * considered for packing a paging block, see paging_select() */
+#define PAGING_LOOKAHEAD	16
 
-	pr = llist_entry(group_q->next, struct paging_record, list);
-	llist_del(&pr->list);
+static int pr_is_tmsi(struct paging_record *pr)
+{
+	uint32_t tmsi;
 
-	return pr;
+	return tmsi_mi_to_uint(&tmsi, pr->u.paging.identity_lv) == 0;
 }
 
-static int pr_is_imsi(struct paging_record *pr)
+/* take the paging records for the next block off the queues of a group:
+ * as many identities as the records at the head of the queues allow to
+ * pack into Paging Request Type 3 (4 TMSI), 2 (2 TMSI + 1 any) or 1 (2
+ * any).  The record at the head of the first queue is always among them,
+ * so records which are skipped for packing only move closer to the head,
+ * and none of them starves.
+ * \param[in] queues the queues to look into, in order
+ * \param[out] pr the records, TMSIs first as the message types need them
+ * \returns the number of records, 0 if the first queue is empty */
+static unsigned int paging_select(struct llist_head *queues[], unsigned int num_queues,
+				  struct paging_record *pr[4])
 {
-	if ((pr->u.paging.identity_lv[1] & 7) == GSM_MI_TYPE_IMSI)
-		return 1;
-	else
+	struct paging_record *win[PAGING_LOOKAHEAD], *cur;
+	unsigned int tmsi[4], other = 0;
+	unsigned int n = 0, num_tmsi = 0, num_pr, i, q;
+	int have_other = 0;
+
+	if (llist_empty(queues[0]))
 		return 0;
+
+	for (q = 0; q < num_queues; q++) {
+		llist_for_each_entry(cur, queues[q], list) {
+			if (n == ARRAY_SIZE(win))
+				break;
+			if (pr_is_tmsi(cur)) {
+				if (num_tmsi < ARRAY_SIZE(tmsi))
+					tmsi[num_tmsi++] = n;
+			} else if (!have_other && n > 0) {
+				/* the first one but the head */
+				other = n;
+				have_other = 1;
+			}
+			win[n++] = cur;
+		}
+	}
+
+	if (num_tmsi == 4 && tmsi[0] == 0) {
+		/* Type 3: the head and the next three TMSIs */
+		for (i = 0; i < 4; i++)
+			pr[i] = win[tmsi[i]];
+		num_pr = 4;
+	} else if (num_tmsi >= 2 && tmsi[0] != 0) {
+		/* Type 2: two TMSIs, the head (not a TMSI) as third */
+		pr[0] = win[tmsi[0]];
+		pr[1] = win[tmsi[1]];
+		pr[2] = win[0];
+		num_pr = 3;
+	} else if (num_tmsi >= 2 && n >= 3) {
+		/* Type 2: the head and the next TMSI, the first other
+		 * record as third */
+		pr[0] = win[0];
+		pr[1] = win[tmsi[1]];
+		if (have_other)
+			pr[2] = win[other];
+		else
+			pr[2] = win[tmsi[2]];
+		num_pr = 3;
+	} else {
+		/* Type 1: the head and the next record, if any */
+		pr[0] = win[0];
+		pr[1] = n > 1 ? win[1] : NULL;
+		num_pr = n > 1 ? 2 : 1;
+	}
+
+	for (i = 0; i < num_pr; i++)
+		llist_del(&pr[i]->list);
+
+	return num_pr;
 }
 
-static void sort_pr_tmsi_imsi(struct paging_record *pr[], unsigned int n)
+/* pick the priority class of a group to page next, by smooth weighted
+ * round robin among the classes with records queued
+ * \returns the class, or -1 if there is none */
+static int paging_wrr_pick(struct paging_state *ps, unsigned int group)
 {
-	int i, j;
-	struct paging_record *t;
-
-	if (n < 2)
-		return;
+	int *cur = ps->paging_wrr[group];
+	int total = 0, best = -1;
+	int c;
 
-	/* simple bubble sort */
-	for (i = n-2; i >= 0; i--) {
-		for (j=0; j<=i ; j++) {
-			if (pr_is_imsi(pr[j]) > pr_is_imsi(pr[j+1])) {
-				t = pr[j];
-				pr[j] = pr[j+1];
-				pr[j+1] = t;
-			}
+	for (c = _NUM_PAGING_PRIO - 1; c >= 0; c--) {
+		if (llist_empty(&ps->paging_queue[c][group])) {
+			cur[c] = 0;
+			continue;
 		}
+		cur[c] += paging_prio_weight[c];
+		total += paging_prio_weight[c];
+		if (best < 0 || cur[c] > cur[best])
+			best = c;
 	}
+
+	if (best >= 0)
+		cur[best] -= total;
+
+	return best;
+}
+
+/* account for the first transmission of a page */
+static void paging_sent_first(struct paging_state *ps, struct paging_record *pr,
+			      uint32_t fn)
+{
+	uint32_t frames = (fn + GSM_HYPERFRAME - pr->u.paging.queued_fn) % GSM_HYPERFRAME;
+	enum paging_prio prio = pr->u.paging.prio;
+
+	rate_ctr_inc2(ps->bts->ctrs, BTS_CTR_PAGING_FIRST_NORMAL + prio);
+	/* a TDMA frame is 60/13 ms */
+	rate_ctr_add(&ps->bts->ctrs->ctr[BTS_CTR_PAGING_DELAY_NORMAL + prio],
+		     (frames * 60 + 6) / 13);
 }
 
 /* generate paging message for given gsm time */
 int paging_gen_msg(struct paging_state *ps, uint8_t *out_buf, struct gsm_time *gt,
 		   int *is_empty)
 {
-	struct llist_head *group_q;
-	int group;
+	struct llist_head *queues[_NUM_PAGING_PRIO];
+	struct llist_head *imm_ass_q;
+	uint32_t tick = ps->wheel_tick;
+	int group, prio;
 	int len;
 
 	*is_empty = 0;
+
+	paging_wheel_advance(ps, gt->fn);
+	if (ps->wheel_tick != tick)
+		paging_load_sample(ps);
+	ps->last_fn = gt->fn;
+
 	ps->bts->load.ccch.pch_total += 1;
+	ps->load_blocks++;
 
 	group = get_pag_subch_nr(ps, gt);
 	if (group < 0) {
@@ -409,61 +909,50 @@ int paging_gen_msg(struct paging_state *ps, uint8_t *out_buf, struct gsm_time *g
 		return -1;
 	}
 
-	group_q = &ps->paging_queue[group];
+	imm_ass_q = &ps->imm_ass_queue[group];
+	prio = llist_empty(imm_ass_q) ? paging_wrr_pick(ps, group) : -1;
 
 	/* There is nobody to be paged, send Type1 with two empty ID */
-	if (llist_empty(group_q)) {
+	if (prio < 0 && llist_empty(imm_ass_q)) {
 		//DEBUGP(DPAG, "Tx PAGING TYPE 1 (empty)\n");
 		len = fill_paging_type_1(out_buf, empty_id_lv, 0,
 					 NULL, 0);
 		*is_empty = 1;
 	} else {
 		struct paging_record *pr[4];
-		unsigned int num_pr = 0, imm_ass = 0;
-		time_t now = time(NULL);
-		unsigned int i, num_imsi = 0;
+		unsigned int num_pr, i;
+		int c;
 
 		ps->bts->load.ccch.pch_used += 1;
+		ps->load_used++;
 
-		/* get (if we have) up to four paging records */
-		for (i = 0; i < ARRAY_SIZE(pr); i++) {
-			if (llist_empty(group_q))
-				break;
-			pr[i] = dequeue_pr(group_q);
-
-			/* check for IMM.ASS */
-			if (pr[i]->type == PAGING_RECORD_IMM_ASS) {
-				imm_ass = 1;
-				break;
-			}
-
-			num_pr++;
-
-			/* count how many IMSIs are among them */
-			if (pr_is_imsi(pr[i]))
-				num_imsi++;
-		}
-
-		/* if we have an IMMEDIATE ASSIGNMENT */
-		if (imm_ass) {
-			/* re-add paging records */
-			for (i = 0; i < num_pr; i++)
-				llist_add(&pr[i]->list, group_q);
+		/* an IMMEDIATE ASSIGNMENT is sent ahead of any paging,
+		 * without taking a turn of the round robin */
+		if (!llist_empty(imm_ass_q)) {
+			struct paging_record *imm_ass;
 
 			/* get message and free record */
-			memcpy(out_buf, pr[num_pr]->u.imm_ass.msg,
-							GSM_MACBLOCK_LEN);
-			pcu_tx_pch_data_cnf(gt->fn, pr[num_pr]->u.imm_ass.msg,
+			imm_ass = llist_entry(imm_ass_q->next, struct paging_record, list);
+			llist_del(&imm_ass->list);
+			memcpy(out_buf, imm_ass->u.imm_ass.msg, GSM_MACBLOCK_LEN);
+			pcu_tx_pch_data_cnf(gt->fn, imm_ass->u.imm_ass.msg,
 							GSM_MACBLOCK_LEN);
-			talloc_free(pr[num_pr]);
+			paging_record_free(ps, imm_ass);
 			return GSM_MACBLOCK_LEN;
 		}
 
-		/* make sure the TMSIs are ahead of the IMSIs in the array */
-		sort_pr_tmsi_imsi(pr, num_pr);
+		/* the picked class first, the block is filled up from the
+		 * others in the order of their priority */
+		queues[0] = &ps->paging_queue[prio][group];
+		i = 1;
+		for (c = _NUM_PAGING_PRIO - 1; c >= 0; c--) {
+			if (c != prio)
+				queues[i++] = &ps->paging_queue[c][group];
+		}
 
-		if (num_pr == 4 && num_imsi == 0) {
-			/* No IMSI: easy case, can use TYPE 3 */
+		num_pr = paging_select(queues, ARRAY_SIZE(queues), pr);
+		switch (num_pr) {
+		case 4:
 			DEBUGP(DPAG, "Tx PAGING TYPE 3 (4 TMSI)\n");
 			len = fill_paging_type_3(out_buf,
 						 pr[0]->u.paging.identity_lv,
@@ -474,8 +963,9 @@ int paging_gen_msg(struct paging_state *ps, uint8_t *out_buf, struct gsm_time *g
 						 pr[2]->u.paging.chan_needed,
 						 pr[3]->u.paging.identity_lv,
 						 pr[3]->u.paging.chan_needed);
-		} else if (num_pr >= 3 && num_imsi <= 1) {
-			/* 3 or 4, of which only up to 1 is IMSI */
+			rate_ctr_inc2(ps->bts->ctrs, BTS_CTR_PAGING_IDS_4);
+			break;
+		case 3:
 			DEBUGP(DPAG, "Tx PAGING TYPE 2 (2 TMSI,1 xMSI)\n");
 			len = fill_paging_type_2(out_buf,
 						 pr[0]->u.paging.identity_lv,
@@ -483,52 +973,42 @@ int paging_gen_msg(struct paging_state *ps, uint8_t *out_buf, struct gsm_time *g
 						 pr[1]->u.paging.identity_lv,
 						 pr[1]->u.paging.chan_needed,
 						 pr[2]->u.paging.identity_lv);
-			if (num_pr == 4) {
-				/* re-add #4 for next time */
-				llist_add(&pr[3]->list, group_q);
-				pr[3] = NULL;
-			}
-		} else if (num_pr == 1) {
-			DEBUGP(DPAG, "Tx PAGING TYPE 1 (1 xMSI,1 empty)\n");
-			len = fill_paging_type_1(out_buf,
-						 pr[0]->u.paging.identity_lv,
-						 pr[0]->u.paging.chan_needed,
-						 NULL, 0);
-		} else {
-			/* 2 (any type) or
-			 * 3 or 4, of which only 2 will be sent */
+			rate_ctr_inc2(ps->bts->ctrs, BTS_CTR_PAGING_IDS_3);
+			break;
+		case 2:
 			DEBUGP(DPAG, "Tx PAGING TYPE 1 (2 xMSI)\n");
 			len = fill_paging_type_1(out_buf,
 						 pr[0]->u.paging.identity_lv,
 						 pr[0]->u.paging.chan_needed,
 						 pr[1]->u.paging.identity_lv,
 						 pr[1]->u.paging.chan_needed);
-			if (num_pr >= 3) {
-				/* re-add #4 for next time */
-				llist_add(&pr[2]->list, group_q);
-				pr[2] = NULL;
-			}
-			if (num_pr == 4) {
-				/* re-add #4 for next time */
-				llist_add(&pr[3]->list, group_q);
-				pr[3] = NULL;
-			}
+			rate_ctr_inc2(ps->bts->ctrs, BTS_CTR_PAGING_IDS_2);
+			break;
+		default:
+			DEBUGP(DPAG, "Tx PAGING TYPE 1 (1 xMSI,1 empty)\n");
+			len = fill_paging_type_1(out_buf,
+						 pr[0]->u.paging.identity_lv,
+						 pr[0]->u.paging.chan_needed,
+						 NULL, 0);
+			rate_ctr_inc2(ps->bts->ctrs, BTS_CTR_PAGING_IDS_1);
+			break;
 		}
 
 		for (i = 0; i < num_pr; i++) {
-			/* skip those that we might have re-added above */
-			if (pr[i] == NULL)
-				continue;
 			rate_ctr_inc2(ps->bts->ctrs, BTS_CTR_PAGING_SENT);
+			if (!pr[i]->u.paging.sent)
+				paging_sent_first(ps, pr[i], gt->fn);
+			pr[i]->u.paging.sent = 1;
 			/* check if we can expire the paging record,
 			 * or if we need to re-queue it */
-			if (pr[i]->u.paging.expiration_time <= now) {
-				talloc_free(pr[i]);
+			if (paging_expired(ps, pr[i])) {
+				paging_record_free(ps, pr[i]);
 				ps->num_paging--;
 				LOGP(DPAG, LOGL_INFO, "Removed paging record, queue_len=%u\n",
 					ps->num_paging);
 			} else
-				llist_add_tail(&pr[i]->list, group_q);
+				llist_add_tail(&pr[i]->list,
+					&ps->paging_queue[pr[i]->u.paging.prio][group]);
 		}
 	}
 	memset(out_buf+len, 0x2B, GSM_MACBLOCK_LEN-len);
@@ -566,7 +1046,7 @@ struct paging_state *paging_init(struct gsm_bts *bts,
 				 unsigned int paging_lifetime)
 {
 	struct paging_state *ps;
-	unsigned int i;
+	unsigned int i, c;
 
 	ps  = talloc_zero(bts, struct paging_state);
 	if (!ps)
@@ -576,8 +1056,21 @@ struct paging_state *paging_init(struct gsm_bts *bts,
 	ps->paging_lifetime = paging_lifetime;
 	ps->num_paging_max = num_paging_max;
 
-	for (i = 0; i < ARRAY_SIZE(ps->paging_queue); i++)
-		INIT_LLIST_HEAD(&ps->paging_queue[i]);
+	for (i = 0; i < ARRAY_SIZE(ps->imm_ass_queue); i++) {
+		for (c = 0; c < _NUM_PAGING_PRIO; c++)
+			INIT_LLIST_HEAD(&ps->paging_queue[c][i]);
+		INIT_LLIST_HEAD(&ps->imm_ass_queue[i]);
+	}
+	for (i = 0; i < ARRAY_SIZE(ps->paging_hash); i++)
+		INIT_LLIST_HEAD(&ps->paging_hash[i]);
+	for (i = 0; i < ARRAY_SIZE(ps->wheel); i++)
+		INIT_LLIST_HEAD(&ps->wheel[i]);
+
+	INIT_LLIST_HEAD(&ps->pool_free);
+	if (paging_pool_grow(ps, num_paging_max) < 0) {
+		talloc_free(ps);
+		return NULL;
+	}
 
 	if (!initialized) {
 		osmo_signal_register_handler(SS_GLOBAL, paging_signal_cbfn, NULL);
@@ -592,19 +1085,26 @@ void paging_config(struct paging_state *ps,
 {
 	ps->num_paging_max = num_paging_max;
 	ps->paging_lifetime = paging_lifetime;
+	paging_pool_grow(ps, num_paging_max);
 }
 
 void paging_reset(struct paging_state *ps)
 {
-	int i;
-
-	for (i = 0; i < ARRAY_SIZE(ps->paging_queue); i++) {
-		struct llist_head *queue = &ps->paging_queue[i];
-		struct paging_record *pr, *pr2;
-		llist_for_each_entry_safe(pr, pr2, queue, list) {
+	struct paging_record *pr, *pr2;
+	int i, c;
+
+	for (i = 0; i < ARRAY_SIZE(ps->imm_ass_queue); i++) {
+		for (c = 0; c < _NUM_PAGING_PRIO; c++) {
+			struct llist_head *queue = &ps->paging_queue[c][i];
+			llist_for_each_entry_safe(pr, pr2, queue, list) {
+				llist_del(&pr->list);
+				paging_record_free(ps, pr);
+				ps->num_paging--;
+			}
+		}
+		llist_for_each_entry_safe(pr, pr2, &ps->imm_ass_queue[i], list) {
 			llist_del(&pr->list);
-			talloc_free(pr);
-			ps->num_paging--;
+			paging_record_free(ps, pr);
 		}
 	}
 
@@ -612,6 +1112,10 @@ void paging_reset(struct paging_state *ps)
 		LOGP(DPAG, LOGL_NOTICE, "num_paging != 0 after flushing all records?!?\n");
 
 	ps->num_paging = 0;
+
+	ps->load_blocks = 0;
+	ps->load_used = 0;
+	ps->pch_load = 0;
 }
 
 /**
@@ -619,12 +1123,34 @@ void paging_reset(struct paging_state *ps)
  */
 int paging_group_queue_empty(struct paging_state *ps, uint8_t grp)
 {
-	if (grp >= ARRAY_SIZE(ps->paging_queue))
+	int c;
+
+	if (grp >= ARRAY_SIZE(ps->imm_ass_queue))
 		return 1;
-	return llist_empty(&ps->paging_queue[grp]);
+	for (c = 0; c < _NUM_PAGING_PRIO; c++) {
+		if (!llist_empty(&ps->paging_queue[c][grp]))
+			return 0;
+	}
+	return llist_empty(&ps->imm_ass_queue[grp]);
 }
 
 int paging_queue_length(struct paging_state *ps)
 {
 	return ps->num_paging;
 }
+
+void paging_pool_stats(struct paging_state *ps, unsigned int *size,
+		       unsigned int *used, unsigned int *used_max)
+{
+	*size = ps->pool_size;
+	*used = ps->pool_used;
+	*used_max = ps->pool_used_max;
+}
+
+void paging_load_stats(struct paging_state *ps, unsigned int *pch_load,
+		       unsigned int *lifetime, unsigned int *group_len_max)
+{
+	*pch_load = ps->pch_load;
+	*lifetime = paging_lifetime_eff(ps);
+	*group_len_max = paging_group_len_max(ps);
+}
@@ -447,6 +447,7 @@ static int rsl_rx_paging_cmd(struct gsm_bts_trx *trx, struct msgb *msg)
 	struct tlv_parsed tp;
 	struct gsm_bts *bts = trx->bts;
 	uint8_t chan_needed = 0, paging_group;
+	enum paging_prio prio = PAGING_PRIO_NORMAL;
 	const uint8_t *identity_lv;
 	int rc;
 
@@ -462,7 +463,11 @@ static int rsl_rx_paging_cmd(struct gsm_bts_trx *trx, struct msgb *msg)
 	if (TLVP_PRES_LEN(&tp, RSL_IE_CHAN_NEEDED, 1))
 		chan_needed = *TLVP_VAL(&tp, RSL_IE_CHAN_NEEDED);
 
-	rc = paging_add_identity(bts->paging_state, paging_group, identity_lv, chan_needed);
+	if (TLVP_PRES_LEN(&tp, RSL_IE_EMLPP_PRIO, 1))
+		prio = paging_prio_from_emlpp(*TLVP_VAL(&tp, RSL_IE_EMLPP_PRIO));
+
+	rc = paging_add_identity(bts->paging_state, paging_group, identity_lv, chan_needed,
+				 prio);
 	if (rc < 0) {
 		/* FIXME: notfiy the BSC on other errors? */
 		if (rc == -ENOSPC)
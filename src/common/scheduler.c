@@ -25,13 +25,15 @@
 #include <errno.h>
 #include <stdint.h>
 #include <ctype.h>
+#include <limits.h>
 
 #include <osmocom/core/msgb.h>
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/bits.h>
-#include <osmocom/gsm/a5.h>
+#include <osmocom/core/rate_ctr.h>
 
 #include <osmo-bts/gsm_data.h>
+#include <osmo-bts/bts.h>
 #include <osmo-bts/logging.h>
 #include <osmo-bts/rsl.h>
 #include <osmo-bts/l1sap.h>
@@ -202,6 +204,263 @@ const struct value_string trx_chan_type_names[] = {
  	{ 0, NULL }
 };
 
+/* The msgbs of PH-RTS.ind and TCH-RTS.ind are taken from a few slots
+ * preallocated per timeslot.  Whoever is done with them later (l1sap_up(),
+ * the prim ring, a backend) frees them by l1sap_msgb_free(), which only
+ * marks them free in their slot. */
+static struct msgb *sched_rts_msgb(struct l1sched_ts *l1ts)
+{
+	struct msgb *msg;
+	unsigned int i;
+
+	for (i = 0; i < TRX_SCHED_RTS_SLOTS; i++) {
+		msg = l1ts->rts_slot[i];
+		if (!msg || l1sap_msgb_slot(msg) == L1SAP_MSGB_SLOT_FREE)
+			break;
+	}
+	/* all slots in use, get one from the heap */
+	if (i == TRX_SCHED_RTS_SLOTS)
+		return l1sap_msgb_alloc(200);
+
+	if (!msg) {
+		msg = l1sap_msgb_alloc(200);
+		if (!msg)
+			return NULL;
+		talloc_set_name_const(msg, "l1sched_rts_slot");
+		l1ts->rts_slot[i] = msg;
+	} else
+		l1sap_msgb_reset(msg);
+
+	l1sap_msgb_slot(msg) = L1SAP_MSGB_SLOT_BUSY;
+
+	return msg;
+}
+
+/* free the RTS slots of a timeslot, none of them may be queued anymore */
+static void sched_rts_slots_free(struct l1sched_ts *l1ts)
+{
+	unsigned int i;
+
+	for (i = 0; i < TRX_SCHED_RTS_SLOTS; i++) {
+		if (!l1ts->rts_slot[i])
+			continue;
+		msgb_free(l1ts->rts_slot[i]);
+		l1ts->rts_slot[i] = NULL;
+	}
+}
+
+/* burst buffers are cache line aligned */
+#define SCHED_BURSTS_ALIGN(len)	(((len) + 63) & ~63)
+
+/* size of the burst buffer of a logical channel */
+static unsigned int sched_bursts_size(enum trx_chan_type chan, int ul)
+{
+	switch (chan) {
+	case TRXC_IDLE:
+	case TRXC_FCCH:
+	case TRXC_SCH:
+	case TRXC_RACH:
+		return 0;
+	case TRXC_TCHF:
+		/* 8 bursts, interleaved over two blocks.  In uplink the
+		 * de-interleaving ring: 2 blocks and the mirror of one. */
+		return ul ? 3 * 464 : 928;
+	case TRXC_TCHH_0:
+	case TRXC_TCHH_1:
+		/* 6 bursts; in uplink 3 blocks and the mirror of two */
+		return ul ? 5 * 232 : 696;
+	case TRXC_PDTCH:
+		return 1392;	/* 4 8PSK bursts, GSM0503_EGPRS_BURSTS_NBITS */
+	default:
+		return 464;	/* 4 bursts */
+	}
+}
+
+/* assign the burst buffers of the logical channels of a multiframe layout
+ * from base, if given.  Returns the number of bytes they take. */
+static size_t sched_bursts_carve(struct l1sched_ts *l1ts,
+				 const struct trx_sched_frame *frames,
+				 uint8_t period, uint8_t *base)
+{
+	uint64_t dl_seen = 0, ul_seen = 0;
+	size_t len = 0;
+	unsigned int size;
+	int i;
+
+	for (i = 0; i < period; i++) {
+		enum trx_chan_type dl_chan = frames[i].dl_chan;
+		enum trx_chan_type ul_chan = frames[i].ul_chan;
+
+		if (!(dl_seen & (1ULL << dl_chan)) && trx_chan_desc[dl_chan].dl_fn) {
+			dl_seen |= 1ULL << dl_chan;
+			size = sched_bursts_size(dl_chan, 0);
+			if (size && base)
+				l1ts->chan_state[dl_chan].dl_bursts = (ubit_t *)(base + len);
+			len += SCHED_BURSTS_ALIGN(size);
+		}
+		if (!(ul_seen & (1ULL << ul_chan)) && trx_chan_desc[ul_chan].ul_fn) {
+			ul_seen |= 1ULL << ul_chan;
+			size = sched_bursts_size(ul_chan, 1);
+			if (size && base)
+				l1ts->chan_state[ul_chan].ul_bursts = (sbit_t *)(base + len);
+			len += SCHED_BURSTS_ALIGN(size);
+		}
+	}
+
+	return len;
+}
+
+/* (re)assign the burst buffers of a timeslot to its current layout */
+static void sched_bursts_assign(struct l1sched_ts *l1ts)
+{
+	int i;
+
+	for (i = 0; i < _TRX_CHAN_MAX; i++) {
+		l1ts->chan_state[i].dl_bursts = NULL;
+		l1ts->chan_state[i].ul_bursts = NULL;
+		l1ts->chan_state[i].dl_valid = 0;
+	}
+	if (l1ts->bursts_base && l1ts->mf_frames)
+		sched_bursts_carve(l1ts, l1ts->mf_frames, l1ts->mf_period,
+				   l1ts->bursts_base);
+}
+
+/* clear the burst buffers of a logical channel, to start with burst 0 */
+static void sched_bursts_clear(struct l1sched_chan_state *chan_state,
+			       enum trx_chan_type chan)
+{
+	if (chan_state->dl_bursts)
+		memset(chan_state->dl_bursts, 0, sched_bursts_size(chan, 0));
+	if (chan_state->ul_bursts)
+		memset(chan_state->ul_bursts, 0, sched_bursts_size(chan, 1));
+	chan_state->dl_valid = 0;
+	chan_state->ul_ring = 0;
+}
+
+/* allocate the burst buffer arena of a TRX.  Each timeslot gets a slice
+ * large enough for the biggest channel combination it may be set to, so
+ * nothing has to be allocated when the combination changes. */
+static int sched_bursts_alloc(struct l1sched_trx *l1t)
+{
+	size_t ts_len[TRX_NR_TS], total = 0, len;
+	uint8_t *base;
+	uint8_t tn;
+	int pchan, i;
+
+	for (tn = 0; tn < ARRAY_SIZE(l1t->ts); tn++) {
+		ts_len[tn] = 0;
+		for (pchan = 0; pchan < _GSM_PCHAN_MAX; pchan++) {
+			i = find_sched_mframe_idx(pchan, tn);
+			if (i < 0)
+				continue;
+			len = sched_bursts_carve(NULL, trx_sched_multiframes[i].frames,
+						 trx_sched_multiframes[i].period, NULL);
+			if (len > ts_len[tn])
+				ts_len[tn] = len;
+		}
+		total += ts_len[tn];
+	}
+
+	l1t->bursts_arena = talloc_zero_size(tall_bts_ctx, total + 63);
+	if (!l1t->bursts_arena)
+		return -ENOMEM;
+	talloc_set_name_const(l1t->bursts_arena, "l1sched_bursts");
+
+	base = (uint8_t *)SCHED_BURSTS_ALIGN((uintptr_t)l1t->bursts_arena);
+	for (tn = 0; tn < ARRAY_SIZE(l1t->ts); tn++) {
+		struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+
+		l1ts->bursts_base = base;
+		sched_bursts_assign(l1ts);
+		base += ts_len[tn];
+	}
+
+	return 0;
+}
+
+/*
+ * uplink de-interleaving ring of TCH/F and TCH/H
+ *
+ * A TCH/F block is interleaved over the 4 bursts of the previous and the
+ * 4 bursts of its own block, a TCH/H block over 3 blocks of 2 bursts.  The
+ * decoders expect those bursts in order in one buffer.  Instead of shifting
+ * the buffer after each block, the blocks are kept in a ring, followed by a
+ * mirror of all but the last block of the ring:
+ *
+ *   TCH/F   | 0 | 1 | 0'|          windows 0 1, 1 0'
+ *   TCH/H   | 0 | 1 | 2 | 0'| 1'|  windows 0 1 2, 1 2 0', 2 0' 1'
+ *
+ * so the window ending with the block just received is always contiguous.
+ * Bursts of mirrored blocks are stored twice, which is still less than
+ * moving the whole window on every block.
+ */
+
+/* number of blocks in the ring and bursts per block */
+static void sched_ul_ring_geometry(enum trx_chan_type chan,
+				   unsigned int *blocks, unsigned int *bursts)
+{
+	if (chan == TRXC_TCHF) {
+		*blocks = 2;
+		*bursts = 4;
+	} else {
+		*blocks = 3;
+		*bursts = 2;
+	}
+}
+
+/*! store the data bits of an uplink TCH/F or TCH/H burst in the ring
+ *  \param[in] chan_state state of the logical channel
+ *  \param[in] chan TRXC_TCHF, TRXC_TCHH_0 or TRXC_TCHH_1
+ *  \param[in] bid burst index within the block
+ *  \param[in] bits soft bits of the normal burst */
+void _sched_ul_ring_burst(struct l1sched_chan_state *chan_state,
+			  enum trx_chan_type chan, uint8_t bid,
+			  const sbit_t *bits)
+{
+	unsigned int blocks, bursts;
+	sbit_t *burst;
+
+	sched_ul_ring_geometry(chan, &blocks, &bursts);
+
+	burst = chan_state->ul_bursts + (chan_state->ul_ring * bursts + bid) * 116;
+	memcpy(burst, bits + 3, 58);
+	memcpy(burst + 58, bits + 87, 58);
+
+	if (chan_state->ul_ring < blocks - 1)
+		memcpy(burst + blocks * bursts * 116, burst, 116);
+}
+
+/*! complete the block being received and advance the ring.  Bursts of the
+ *  block that were not received are cleared, as erasures.
+ *  \param[in] chan_state state of the logical channel, ul_mask holds the
+ *		bursts received
+ *  \param[in] chan TRXC_TCHF, TRXC_TCHH_0 or TRXC_TCHH_1
+ *  \returns the interleaved bursts ending with this block, in order; valid
+ *	     until the next burst of the channel is stored */
+sbit_t *_sched_ul_ring_block(struct l1sched_chan_state *chan_state,
+			     enum trx_chan_type chan)
+{
+	unsigned int blocks, bursts, bid;
+	unsigned int pos = chan_state->ul_ring;
+	sbit_t *block;
+
+	sched_ul_ring_geometry(chan, &blocks, &bursts);
+
+	block = chan_state->ul_bursts + pos * bursts * 116;
+	for (bid = 0; bid < bursts; bid++) {
+		if (chan_state->ul_mask & (1 << bid))
+			continue;
+		memset(block + bid * 116, 0, 116);
+		if (pos < blocks - 1)
+			memset(block + (blocks * bursts + bid) * 116, 0, 116);
+	}
+
+	chan_state->ul_ring = (pos + 1) % blocks;
+
+	/* the oldest block of the window is the next one to be overwritten */
+	return chan_state->ul_bursts + chan_state->ul_ring * bursts * 116;
+}
+
 /*
  * init / exit
  */
@@ -223,7 +482,14 @@ int trx_sched_init(struct l1sched_trx *l1t, struct gsm_bts_trx *trx)
 
 		l1ts->mf_index = 0;
 		l1ts->mf_last_fn = 0;
-		INIT_LLIST_HEAD(&l1ts->dl_prims);
+		for (i = 0; i < ARRAY_SIZE(l1ts->dl_prims); i++)
+			INIT_LLIST_HEAD(&l1ts->dl_prims[i]);
+		l1ts->dl_prims_dropped = 0;
+		l1ts->dl_prims_unreported = 0;
+		l1ts->ul_bursts_missed = 0;
+		l1ts->ul_bursts_unreported = 0;
+		l1ts->ul_missed_report_fn = 0;
+		memset(l1ts->ul_ks, 0, sizeof(l1ts->ul_ks));
 		for (i = 0; i < ARRAY_SIZE(l1ts->chan_state); i++) {
 			struct l1sched_chan_state *chan_state;
 			chan_state = &l1ts->chan_state[i];
@@ -231,6 +497,14 @@ int trx_sched_init(struct l1sched_trx *l1t, struct gsm_bts_trx *trx)
 		}
 	}
 
+	l1t->dl_fn_valid = 0;
+	memset(l1t->dl_prim_slack, 0, sizeof(l1t->dl_prim_slack));
+	l1t->dl_prim_slack_min = INT_MAX;
+
+	/* the burst buffers persist until trx_sched_exit() */
+	if (!l1t->bursts_arena)
+		return sched_bursts_alloc(l1t);
+
 	return 0;
 }
 
@@ -244,24 +518,21 @@ void trx_sched_exit(struct l1sched_trx *l1t)
 
 	for (tn = 0; tn < ARRAY_SIZE(l1t->ts); tn++) {
 		struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
-		msgb_queue_flush(&l1ts->dl_prims);
-		for (i = 0; i < _TRX_CHAN_MAX; i++) {
-			struct l1sched_chan_state *chan_state;
-			chan_state = &l1ts->chan_state[i];
-			if (chan_state->dl_bursts) {
-				talloc_free(chan_state->dl_bursts);
-				chan_state->dl_bursts = NULL;
-			}
-			if (chan_state->ul_bursts) {
-				talloc_free(chan_state->ul_bursts);
-				chan_state->ul_bursts = NULL;
-			}
+		for (i = 0; i < ARRAY_SIZE(l1ts->dl_prims); i++) {
+			struct msgb *msg;
+			while ((msg = msgb_dequeue(&l1ts->dl_prims[i])))
+				l1sap_msgb_free(msg);
 		}
+		sched_rts_slots_free(l1ts);
+		l1ts->bursts_base = NULL;
+		sched_bursts_assign(l1ts);
 		/* clear lchan channel states */
 		ts = &l1t->trx->ts[tn];
 		for (i = 0; i < ARRAY_SIZE(ts->lchan); i++)
 			lchan_set_state(&ts->lchan[i], LCHAN_S_NONE);
 	}
+	talloc_free(l1t->bursts_arena);
+	l1t->bursts_arena = NULL;
 }
 
 /* close all logical channels and reset timeslots */
@@ -271,6 +542,70 @@ void trx_sched_reset(struct l1sched_trx *l1t)
 	trx_sched_init(l1t, l1t->trx);
 }
 
+/* drop a prim which was not picked up in its frame */
+static void sched_drop_prim(struct l1sched_ts *l1ts, struct msgb *msg)
+{
+	llist_del(&msg->list);
+	l1sap_msgb_free(msg);
+	l1ts->dl_prims_dropped++;
+	l1ts->dl_prims_unreported++;
+}
+
+/* expire the prims of the previous frame on a timeslot.  They are only
+ * reported once per ring cycle, rather than logged one by one. */
+static void sched_expire_prims(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+	struct llist_head *bucket;
+	struct msgb *msg, *msg2;
+
+	/* GSM_HYPERFRAME is a multiple of the ring size, so this also holds
+	 * when wrapping around at fn == 0 */
+	bucket = &l1ts->dl_prims[(fn + TRX_SCHED_PRIM_RING - 1) % TRX_SCHED_PRIM_RING];
+	llist_for_each_entry_safe(msg, msg2, bucket, list)
+		sched_drop_prim(l1ts, msg);
+
+	if (l1ts->dl_prims_unreported && (fn % TRX_SCHED_PRIM_RING) == 0) {
+		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, -1, fn,
+		     "Dropped %u prims which were out of range (100), or whose "
+		     "channel is already disabled. If this happens in "
+		     "conjunction with PCU, increase 'rts-advance' by 5.\n",
+		     l1ts->dl_prims_unreported);
+		l1ts->dl_prims_unreported = 0;
+	}
+}
+
+unsigned int trx_sched_slack_bin(int frames)
+{
+	unsigned int bin = 0;
+
+	if (frames <= 0)
+		return 0;
+	/* 1 -> 1, 2 -> 2, 3..4 -> 3, 5..8 -> 4, ... */
+	for (frames--; frames && bin < TRX_SCHED_SLACK_BINS - 2; frames >>= 1)
+		bin++;
+	return bin + 1;
+}
+
+/* put a prim into the bucket of the frame it is meant for, and account
+ * for how far ahead of the frame being composed it arrived */
+static void sched_enqueue_prim(struct l1sched_trx *l1t, struct l1sched_ts *l1ts,
+			       uint32_t fn, struct msgb *msg)
+{
+	int slack;
+
+	msgb_enqueue(&l1ts->dl_prims[fn % TRX_SCHED_PRIM_RING], msg);
+
+	if (!l1t->dl_fn_valid)
+		return;
+	slack = (fn + GSM_HYPERFRAME - l1t->dl_fn) % GSM_HYPERFRAME;
+	if (slack > GSM_HYPERFRAME / 2)
+		slack -= GSM_HYPERFRAME;
+	l1t->dl_prim_slack[trx_sched_slack_bin(slack)]++;
+	if (slack < l1t->dl_prim_slack_min)
+		l1t->dl_prim_slack_min = slack;
+}
+
 struct msgb *_sched_dequeue_prim(struct l1sched_trx *l1t, int8_t tn, uint32_t fn,
 				 enum trx_chan_type chan)
 {
@@ -280,8 +615,8 @@ struct msgb *_sched_dequeue_prim(struct l1sched_trx *l1t, int8_t tn, uint32_t fn
 	uint8_t chan_nr, link_id;
 	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
 
-	/* get prim of current fn from queue */
-	llist_for_each_entry_safe(msg, msg2, &l1ts->dl_prims, list) {
+	/* get prim of current fn from its bucket */
+	llist_for_each_entry_safe(msg, msg2, &l1ts->dl_prims[fn % TRX_SCHED_PRIM_RING], list) {
 		l1sap = msgb_l1sap_prim(msg);
 		if (l1sap->oph.operation != PRIM_OP_REQUEST) {
 wrong_type:
@@ -289,37 +624,29 @@ wrong_type:
 free_msg:
 			/* unlink and free message */
 			llist_del(&msg->list);
-			msgb_free(msg);
+			l1sap_msgb_free(msg);
 			return NULL;
 		}
 		switch (l1sap->oph.primitive) {
 		case PRIM_PH_DATA:
 			chan_nr = l1sap->u.data.chan_nr;
 			link_id = l1sap->u.data.link_id;
-			prim_fn = ((l1sap->u.data.fn + GSM_HYPERFRAME - fn) % GSM_HYPERFRAME);
+			prim_fn = l1sap->u.data.fn;
 			break;
 		case PRIM_TCH:
 			chan_nr = l1sap->u.tch.chan_nr;
 			link_id = 0;
-			prim_fn = ((l1sap->u.tch.fn + GSM_HYPERFRAME - fn) % GSM_HYPERFRAME);
+			prim_fn = l1sap->u.tch.fn;
 			break;
 		default:
 			goto wrong_type;
 		}
-		if (prim_fn > 100) {
-			LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, chan, fn,
-			     "Prim %u is out of range (100), or channel %s with "
-			     "type %s is already disabled. If this happens in "
-			     "conjunction with PCU, increase 'rts-advance' by 5.\n",
-			     prim_fn, get_lchan_by_chan_nr(l1t->trx, chan_nr)->name,
-			     get_value_string(trx_chan_type_names, chan));
-			/* unlink and free message */
-			llist_del(&msg->list);
-			msgb_free(msg);
+		/* anything else in this bucket is a multiple of the ring size
+		 * away, so it is beyond the range of 100 frames */
+		if (prim_fn != fn) {
+			sched_drop_prim(l1ts, msg);
 			continue;
 		}
-		if (prim_fn > 0)
-			continue;
 
 		goto found_msg;
 	}
@@ -431,11 +758,11 @@ int trx_sched_ph_data_req(struct l1sched_trx *l1t, struct osmo_phsap_prim *l1sap
 
 	/* ignore empty frame */
 	if (!msgb_l2len(l1sap->oph.msg)) {
-		msgb_free(l1sap->oph.msg);
+		l1sap_msgb_free(l1sap->oph.msg);
 		return 0;
 	}
 
-	msgb_enqueue(&l1ts->dl_prims, l1sap->oph.msg);
+	sched_enqueue_prim(l1t, l1ts, l1sap->u.data.fn, l1sap->oph.msg);
 
 	return 0;
 }
@@ -453,11 +780,11 @@ int trx_sched_tch_req(struct l1sched_trx *l1t, struct osmo_phsap_prim *l1sap)
 
 	/* ignore empty frame */
 	if (!msgb_l2len(l1sap->oph.msg)) {
-		msgb_free(l1sap->oph.msg);
+		l1sap_msgb_free(l1sap->oph.msg);
 		return 0;
 	}
 
-	msgb_enqueue(&l1ts->dl_prims, l1sap->oph.msg);
+	sched_enqueue_prim(l1t, l1ts, l1sap->u.tch.fn, l1sap->oph.msg);
 
 	return 0;
 }
@@ -474,6 +801,7 @@ static int rts_data_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	uint8_t chan_nr, link_id;
 	struct msgb *msg;
 	struct osmo_phsap_prim *l1sap;
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
 
 	/* get data for RTS indication */
 	chan_nr = trx_chan_desc[chan].chan_nr | tn;
@@ -489,7 +817,7 @@ static int rts_data_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 		"PH-RTS.ind: chan_nr=0x%02x link_id=0x%02x\n", chan_nr, link_id);
 
 	/* generate prim */
-	msg = l1sap_msgb_alloc(200);
+	msg = sched_rts_msgb(l1ts);
 	if (!msg)
 		return -ENOMEM;
 	l1sap = msgb_l1sap_prim(msg);
@@ -526,7 +854,7 @@ static int rts_tch_common(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	/* only send, if FACCH is selected */
 	if (facch) {
 		/* generate prim */
-		msg = l1sap_msgb_alloc(200);
+		msg = sched_rts_msgb(l1ts);
 		if (!msg)
 			return -ENOMEM;
 		l1sap = msgb_l1sap_prim(msg);
@@ -542,7 +870,7 @@ static int rts_tch_common(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	/* dont send, if TCH is in signalling only mode */
 	if (l1ts->chan_state[chan].rsl_cmode != RSL_CMOD_SPD_SIGN) {
 		/* generate prim */
-		msg = l1sap_msgb_alloc(200);
+		msg = sched_rts_msgb(l1ts);
 		if (!msg)
 			return -ENOMEM;
 		l1sap = msgb_l1sap_prim(msg);
@@ -574,6 +902,44 @@ static int rts_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	return rts_tch_common(l1t, tn, fn, chan, ((fn % 26) >> 2) & 1);
 }
 
+/* refresh the active flags of the dispatch plan of a timeslot */
+static void sched_plan_update_active(struct l1sched_ts *l1ts)
+{
+	int i;
+
+	for (i = 0; i < l1ts->mf_period; i++) {
+		struct l1sched_frame_plan *plan = &l1ts->mf_plan[i];
+		plan->dl_active = trx_chan_desc[plan->dl_chan].auto_active
+				|| plan->dl_cs->active;
+		plan->ul_active = trx_chan_desc[plan->ul_chan].auto_active
+				|| plan->ul_cs->active;
+	}
+}
+
+/* compile the dispatch plan of a timeslot from its multiframe layout */
+static void sched_plan_compile(struct l1sched_ts *l1ts)
+{
+	int i;
+
+	for (i = 0; i < l1ts->mf_period; i++) {
+		const struct trx_sched_frame *frame = &l1ts->mf_frames[i];
+		struct l1sched_frame_plan *plan = &l1ts->mf_plan[i];
+
+		plan->dl_chan = frame->dl_chan;
+		plan->dl_bid = frame->dl_bid;
+		plan->ul_chan = frame->ul_chan;
+		plan->ul_bid = frame->ul_bid;
+		/* RTS only on bid == 0 */
+		plan->rts_fn = frame->dl_bid ? NULL : trx_chan_desc[frame->dl_chan].rts_fn;
+		plan->dl_fn = trx_chan_desc[frame->dl_chan].dl_fn;
+		plan->ul_fn = trx_chan_desc[frame->ul_chan].ul_fn;
+		plan->dl_cs = &l1ts->chan_state[frame->dl_chan];
+		plan->ul_cs = &l1ts->chan_state[frame->ul_chan];
+	}
+
+	sched_plan_update_active(l1ts);
+}
+
 /* set multiframe scheduler to given pchan */
 int trx_sched_set_pchan(struct l1sched_trx *l1t, uint8_t tn,
 	enum gsm_phys_chan_config pchan)
@@ -590,6 +956,8 @@ int trx_sched_set_pchan(struct l1sched_trx *l1t, uint8_t tn,
 	l1ts->mf_index = i;
 	l1ts->mf_period = trx_sched_multiframes[i].period;
 	l1ts->mf_frames = trx_sched_multiframes[i].frames;
+	sched_bursts_assign(l1ts);
+	sched_plan_compile(l1ts);
 	LOGP(DL1C, LOGL_NOTICE, "Configuring multiframe with %s trx=%d ts=%d\n",
 		trx_sched_multiframes[i].name, l1t->trx->nr, tn);
 	return 0;
@@ -622,23 +990,25 @@ int trx_sched_set_lchan(struct l1sched_trx *l1t, uint8_t chan_nr, uint8_t link_i
 			LOGP(DL1C, LOGL_NOTICE, "%s %s on trx=%d ts=%d\n",
 				(active) ? "Activating" : "Deactivating",
 				trx_chan_desc[i].name, l1t->trx->nr, tn);
-			if (active)
+			if (active) {
+				/* the burst buffers belong to the timeslot */
+				ubit_t *dl_bursts = chan_state->dl_bursts;
+				sbit_t *ul_bursts = chan_state->ul_bursts;
 				memset(chan_state, 0, sizeof(*chan_state));
-			chan_state->active = active;
-			/* free burst memory, to cleanly start with burst 0 */
-			if (chan_state->dl_bursts) {
-				talloc_free(chan_state->dl_bursts);
-				chan_state->dl_bursts = NULL;
-			}
-			if (chan_state->ul_bursts) {
-				talloc_free(chan_state->ul_bursts);
-				chan_state->ul_bursts = NULL;
+				chan_state->dl_bursts = dl_bursts;
+				chan_state->ul_bursts = ul_bursts;
+				chan_state->act_gen = ++l1t->act_gen;
 			}
+			chan_state->active = active;
+			/* clear burst memory, to cleanly start with burst 0 */
+			sched_bursts_clear(chan_state, i);
 			if (!active)
 				chan_state->ho_rach_detect = 0;
 		}
 	}
 
+	sched_plan_update_active(l1ts);
+
 	/* disable handover detection (on deactivation) */
 	if (!active)
 		_sched_act_rach_det(l1t, tn, ss, 0);
@@ -756,38 +1126,24 @@ int trx_sched_set_cipher(struct l1sched_trx *l1t, uint8_t chan_nr, int downlink,
 int _sched_rts(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn)
 {
 	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
-	const struct trx_sched_frame *frame;
-	uint8_t offset, period, bid;
-	trx_sched_rts_func *func;
-	enum trx_chan_type chan;
+	const struct l1sched_frame_plan *plan;
 
 	/* no multiframe set */
 	if (!l1ts->mf_index)
 		return 0;
 
 	/* get frame from multiframe */
-	period = l1ts->mf_period;
-	offset = fn % period;
-	frame = l1ts->mf_frames + offset;
-
-	chan = frame->dl_chan;
-	bid = frame->dl_bid;
-	func = trx_chan_desc[frame->dl_chan].rts_fn;
-
-	/* only on bid == 0 */
-	if (bid != 0)
-		return 0;
+	plan = &l1ts->mf_plan[fn % l1ts->mf_period];
 
-	/* no RTS function */
-	if (!func)
+	/* no RTS function, or not on bid == 0 */
+	if (!plan->rts_fn)
 		return 0;
 
 	/* check if channel is active */
-	if (!trx_chan_desc[chan].auto_active
-	 && !l1ts->chan_state[chan].active)
+	if (!plan->dl_active)
 	 	return -EINVAL;
 
-	return func(l1t, tn, fn, frame->dl_chan);
+	return plan->rts_fn(l1t, tn, fn, plan->dl_chan);
 }
 
 /* process downlink burst */
@@ -796,47 +1152,32 @@ const ubit_t *_sched_dl_burst(struct l1sched_trx *l1t, uint8_t tn,
 {
 	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
 	struct l1sched_chan_state *l1cs;
-	const struct trx_sched_frame *frame;
-	uint8_t offset, period, bid;
-	trx_sched_dl_func *func;
-	enum trx_chan_type chan;
+	const struct l1sched_frame_plan *plan;
 	ubit_t *bits = NULL;
 
+	/* anything queued for the previous frame is stale now */
+	sched_expire_prims(l1t, tn, fn);
+
 	if (!l1ts->mf_index)
 		goto no_data;
 
 	/* get frame from multiframe */
-	period = l1ts->mf_period;
-	offset = fn % period;
-	frame = l1ts->mf_frames + offset;
-
-	chan = frame->dl_chan;
-	bid = frame->dl_bid;
-	func = trx_chan_desc[chan].dl_fn;
-
-	l1cs = &l1ts->chan_state[chan];
+	plan = &l1ts->mf_plan[fn % l1ts->mf_period];
+	l1cs = plan->dl_cs;
 
 	/* check if channel is active */
-	if (!trx_chan_desc[chan].auto_active && !l1cs->active) {
+	if (!plan->dl_active) {
 		if (nbits)
 			*nbits = GSM_BURST_LEN;
 		goto no_data;
 	}
 
 	/* get burst from function */
-	bits = func(l1t, tn, fn, chan, bid, nbits);
+	bits = plan->dl_fn(l1t, tn, fn, plan->dl_chan, plan->dl_bid, nbits);
 
 	/* encrypt */
-	if (bits && l1cs->dl_encr_algo) {
-		ubit_t ks[114];
-		int i;
-
-		osmo_a5(l1cs->dl_encr_algo, l1cs->dl_encr_key, fn, ks, NULL);
-		for (i = 0; i < 57; i++) {
-			bits[i + 3] ^= ks[i];
-			bits[i + 88] ^= ks[i + 57];
-		}
-	}
+	if (bits && l1cs->dl_encr_algo)
+		_sched_dl_encrypt(l1ts, l1cs, fn, bits);
 
 no_data:
 	/* in case of C0, we need a dummy burst to maintain RF power */
@@ -853,17 +1194,39 @@ no_data:
 	return bits;
 }
 
+/* account for uplink bursts of frames we skipped.  Like stale prims, they
+ * are reported once per ring cycle rather than logged one by one, which
+ * would only add to the overload. */
+static void sched_ul_missed(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
+			    unsigned int missed)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+	struct gsm_bts *bts = l1t->trx->bts;
+
+	l1ts->ul_bursts_missed += missed;
+	l1ts->ul_bursts_unreported += missed;
+	if (bts->ctrs)
+		rate_ctr_add(&bts->ctrs->ctr[BTS_CTR_UL_BURST_MISSED], missed);
+
+	if ((fn + GSM_HYPERFRAME - l1ts->ul_missed_report_fn) % GSM_HYPERFRAME
+	    < TRX_SCHED_PRIM_RING)
+		return;
+	LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, -1, fn, "Missed %u uplink bursts "
+	     "of skipped frames (system overload?), indicated bad without "
+	     "decoding\n", l1ts->ul_bursts_unreported);
+	l1ts->ul_bursts_unreported = 0;
+	l1ts->ul_missed_report_fn = fn;
+}
+
 /* process uplink burst */
 int trx_sched_ul_burst(struct l1sched_trx *l1t, uint8_t tn, uint32_t current_fn,
 	sbit_t *bits, uint16_t nbits, int8_t rssi, int16_t toa256)
 {
 	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
 	struct l1sched_chan_state *l1cs;
-	const struct trx_sched_frame *frame;
-	uint8_t offset, period, bid;
-	trx_sched_ul_func *func;
-	enum trx_chan_type chan;
+	const struct l1sched_frame_plan *plan;
 	uint32_t fn, elapsed;
+	unsigned int missed = 0;
 
 	if (!l1ts->mf_index)
 		return -EINVAL;
@@ -883,51 +1246,34 @@ int trx_sched_ul_burst(struct l1sched_trx *l1t, uint8_t tn, uint32_t current_fn,
 
 	while (42) {
 		/* get frame from multiframe */
-		period = l1ts->mf_period;
-		offset = fn % period;
-		frame = l1ts->mf_frames + offset;
-
-		chan = frame->ul_chan;
-		bid = frame->ul_bid;
-		func = trx_chan_desc[chan].ul_fn;
-
-		l1cs = &l1ts->chan_state[chan];
+		plan = &l1ts->mf_plan[fn % l1ts->mf_period];
+		l1cs = plan->ul_cs;
 
 		/* check if channel is active */
-		if (!trx_chan_desc[chan].auto_active && !l1cs->active)
+		if (!plan->ul_active)
 			goto next_frame;
 
 		/* omit bursts which have no handler, like IDLE bursts */
-		if (!func)
+		if (!plan->ul_fn)
 			goto next_frame;
 
 		/* put burst to function */
 		if (fn == current_fn) {
 			/* decrypt */
-			if (bits && l1cs->ul_encr_algo) {
-				ubit_t ks[114];
-				int i;
-
-				osmo_a5(l1cs->ul_encr_algo,
-					l1cs->ul_encr_key,
-					fn, NULL, ks);
-				for (i = 0; i < 57; i++) {
-					if (ks[i])
-						bits[i + 3] = - bits[i + 3];
-					if (ks[i + 57])
-						bits[i + 88] = - bits[i + 88];
-				}
-			}
-
-			func(l1t, tn, fn, chan, bid, bits, nbits, rssi, toa256);
-		} else if (chan != TRXC_RACH && !l1cs->ho_rach_detect) {
-			sbit_t spare[GSM_BURST_LEN];
-			memset(spare, 0, GSM_BURST_LEN);
-			/* We missed a couple of frame numbers (system overload?) and are now
-			 * substituting some zero-filled bursts for those bursts we missed */
-			LOGPFN(DL1P, LOGL_ERROR, fn, "Substituting all-zero burst (current_fn=%u, "
-				"elapsed=%u\n", current_fn, elapsed);
-			func(l1t, tn, fn, chan, bid, spare, GSM_BURST_LEN, -128, 0);
+			if (bits && l1cs->ul_encr_algo)
+				_sched_ul_decrypt(l1ts, l1cs, fn, bits);
+
+			plan->ul_fn(l1t, tn, fn, plan->ul_chan, plan->ul_bid,
+				    bits, nbits, rssi, toa256);
+		} else if (plan->ul_chan != TRXC_RACH && !l1cs->ho_rach_detect) {
+			/* We missed a couple of frame numbers (system overload?).
+			 * Rather than substituting all-zero bursts, which would
+			 * only be decoded to garbage, pass no bits at all: the
+			 * handler takes note of the gap and indicates the block
+			 * as bad without spending any time on decoding it. */
+			plan->ul_fn(l1t, tn, fn, plan->ul_chan, plan->ul_bid,
+				    NULL, GSM_BURST_LEN, -128, 0);
+			missed++;
 		}
 
 next_frame:
@@ -940,6 +1286,9 @@ next_frame:
 
 	l1ts->mf_last_fn = fn;
 
+	if (missed)
+		sched_ul_missed(l1t, tn, current_fn, missed);
+
 	return 0;
 }
 
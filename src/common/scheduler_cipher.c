@@ -0,0 +1,167 @@
+/* A5 ciphering of bursts for the L1 scheduler */
+
+/* This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <osmocom/core/bits.h>
+#include <osmocom/gsm/a5.h>
+
+#include <osmo-bts/gsm_data.h>
+#include <osmo-bts/scheduler.h>
+#include <osmo-bts/scheduler_backend.h>
+
+/* number of bits in each half of a normal burst covered by the keystream */
+#define KS_HALF	57
+
+/* XOR one half of the keystream onto the burst */
+static inline void ks_xor(ubit_t *dst, const ubit_t *ks)
+{
+	int i = 0;
+
+#if defined(__AVX2__)
+	for (; i + 32 <= KS_HALF; i += 32) {
+		__m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+		__m256i k = _mm256_loadu_si256((const __m256i *)(ks + i));
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(d, k));
+	}
+#endif
+#if defined(__SSE2__)
+	for (; i + 16 <= KS_HALF; i += 16) {
+		__m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+		__m128i k = _mm_loadu_si128((const __m128i *)(ks + i));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(d, k));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 16 <= KS_HALF; i += 16)
+		vst1q_u8(dst + i, veorq_u8(vld1q_u8(dst + i), vld1q_u8(ks + i)));
+#endif
+	/* remainder, eight bits at a time */
+	for (; i + 8 <= KS_HALF; i += 8) {
+		uint64_t d, k;
+		memcpy(&d, dst + i, 8);
+		memcpy(&k, ks + i, 8);
+		d ^= k;
+		memcpy(dst + i, &d, 8);
+	}
+	for (; i < KS_HALF; i++)
+		dst[i] ^= ks[i];
+}
+
+/* negate the soft bits of one half of the burst where the keystream is 1.
+ * With m = -ks (0 or all ones), (b ^ m) - m is b or -b without a branch. */
+static inline void ks_negate(sbit_t *dst, const ubit_t *ks)
+{
+	int i = 0;
+
+#if defined(__AVX2__)
+	const __m256i zero256 = _mm256_setzero_si256();
+	for (; i + 32 <= KS_HALF; i += 32) {
+		__m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+		__m256i m = _mm256_sub_epi8(zero256,
+			_mm256_loadu_si256((const __m256i *)(ks + i)));
+		d = _mm256_sub_epi8(_mm256_xor_si256(d, m), m);
+		_mm256_storeu_si256((__m256i *)(dst + i), d);
+	}
+#endif
+#if defined(__SSE2__)
+	const __m128i zero128 = _mm_setzero_si128();
+	for (; i + 16 <= KS_HALF; i += 16) {
+		__m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+		__m128i m = _mm_sub_epi8(zero128,
+			_mm_loadu_si128((const __m128i *)(ks + i)));
+		d = _mm_sub_epi8(_mm_xor_si128(d, m), m);
+		_mm_storeu_si128((__m128i *)(dst + i), d);
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 16 <= KS_HALF; i += 16) {
+		int8x16_t d = vld1q_s8(dst + i);
+		int8x16_t m = vnegq_s8(vreinterpretq_s8_u8(vld1q_u8(ks + i)));
+		vst1q_s8(dst + i, vsubq_s8(veorq_s8(d, m), m));
+	}
+#endif
+	for (; i < KS_HALF; i++) {
+		int8_t m = -(int8_t)ks[i];
+		dst[i] = (int8_t)((dst[i] ^ m) - m);
+	}
+}
+
+/*! apply the keystream to the two 57 bit data fields of a normal burst */
+void _sched_ks_xor(ubit_t *bits, const ubit_t *ks)
+{
+	ks_xor(bits + 3, ks);
+	ks_xor(bits + 88, ks + KS_HALF);
+}
+
+/*! apply the keystream to the two 57 soft bit data fields of a normal burst */
+void _sched_ks_negate(sbit_t *bits, const ubit_t *ks)
+{
+	ks_negate(bits + 3, ks);
+	ks_negate(bits + 88, ks + KS_HALF);
+}
+
+/* Downlink and uplink keystream of a frame come out of the same A5 run.
+ * If both directions use the same algorithm and key, the uplink keystream
+ * is generated along with the downlink one and kept until the uplink
+ * burst of that frame arrives, which is clock-advance frames later. */
+
+/*! encrypt a downlink burst of a frame */
+void _sched_dl_encrypt(struct l1sched_ts *l1ts, struct l1sched_chan_state *l1cs,
+		       uint32_t fn, ubit_t *bits)
+{
+	struct l1sched_ks *ul = NULL;
+	ubit_t ks[114];
+
+	if (l1cs->ul_encr_algo == l1cs->dl_encr_algo
+	 && l1cs->ul_encr_key_len == l1cs->dl_encr_key_len
+	 && !memcmp(l1cs->ul_encr_key, l1cs->dl_encr_key, sizeof(ul->key)))
+		ul = &l1ts->ul_ks[fn % TRX_SCHED_KS_RING];
+
+	osmo_a5(l1cs->dl_encr_algo, l1cs->dl_encr_key, fn, ks, ul ? ul->ks : NULL);
+	if (ul) {
+		ul->fn = fn;
+		ul->algo = l1cs->dl_encr_algo;
+		memcpy(ul->key, l1cs->dl_encr_key, sizeof(ul->key));
+	}
+
+	_sched_ks_xor(bits, ks);
+}
+
+/*! decrypt an uplink burst of a frame */
+void _sched_ul_decrypt(struct l1sched_ts *l1ts, struct l1sched_chan_state *l1cs,
+		       uint32_t fn, sbit_t *bits)
+{
+	struct l1sched_ks *ul = &l1ts->ul_ks[fn % TRX_SCHED_KS_RING];
+	ubit_t ks[114];
+
+	if (ul->fn == fn && ul->algo == l1cs->ul_encr_algo
+	 && !memcmp(ul->key, l1cs->ul_encr_key, sizeof(ul->key))) {
+		_sched_ks_negate(bits, ul->ks);
+		return;
+	}
+
+	osmo_a5(l1cs->ul_encr_algo, l1cs->ul_encr_key, fn, NULL, ks);
+	_sched_ks_negate(bits, ks);
+}
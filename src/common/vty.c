@@ -821,6 +821,8 @@ static void bts_dump_vty_features(struct vty *vty, struct gsm_bts *bts)
 static void bts_dump_vty(struct vty *vty, struct gsm_bts *bts)
 {
 	struct gsm_bts_trx *trx;
+	unsigned int pool_size, pool_used, pool_used_max;
+	unsigned int pch_load, pag_lifetime, pag_group_len;
 
 	vty_out(vty, "BTS %u is of %s type in band %s, has CI %u LAC %u, "
 		"BSIC %u and %u TRX%s",
@@ -856,6 +858,12 @@ static void bts_dump_vty(struct vty *vty, struct gsm_bts *bts)
 	vty_out(vty, "  Paging: queue length %d, buffer space %d%s",
 		paging_queue_length(bts->paging_state), paging_buffer_space(bts->paging_state),
 		VTY_NEWLINE);
+	paging_pool_stats(bts->paging_state, &pool_size, &pool_used, &pool_used_max);
+	vty_out(vty, "  Paging: record pool %u, in use %u, peak %u%s",
+		pool_size, pool_used, pool_used_max, VTY_NEWLINE);
+	paging_load_stats(bts->paging_state, &pch_load, &pag_lifetime, &pag_group_len);
+	vty_out(vty, "  Paging: PCH load %u%%, lifetime %us, group queue limit %u%s",
+		pch_load, pag_lifetime, pag_group_len, VTY_NEWLINE);
 	vty_out(vty, "  OML Link state: %s.%s",
 		bts->oml_link ? "connected" : "disconnected", VTY_NEWLINE);
 
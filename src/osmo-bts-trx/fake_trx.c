@@ -0,0 +1,656 @@
+/* Fake transceiver for load testing OsmoBTS-TRX without radio hardware */
+
+/* This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Speaks the transceiver side of the protocol in trx_if.c: the clock
+ * socket on the base port, a control and a data socket per TRX above it.
+ * Every control command is acknowledged with its own parameters.  The
+ * GSM frame clock is run from a timerfd, and a CLOCK indication is sent
+ * every few frames.
+ *
+ * Downlink bursts are held until their frame is due, and then looped
+ * back as uplink bursts of the same timeslot and frame number, with the
+ * configured RSSI and TOA and gaussian noise on the soft bits.  Uplink
+ * bursts can be dropped, or reordered by holding them back by one frame.
+ *
+ * Downlink bursts arriving after their frame are counted as late; the
+ * statistics printed periodically show how many frames ahead of the
+ * clock osmo-bts-trx delivers its bursts, which is its scheduling
+ * headroom.
+ *
+ *   osmo-bts-trx-fake [-t trx] [-r rssi] [-o toa256] [-s sigma] ...
+ *
+ * osmo-bts-trx is used with its default ports on the same host.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/linuxlist.h>
+#include <osmocom/core/select.h>
+#include <osmocom/core/socket.h>
+#include <osmocom/core/bits.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/gsm/gsm_utils.h>
+
+#include <osmo-bts/scheduler.h>
+
+#include "trx_if.h"
+
+#define FRAME_DURATION_nS	4615384
+
+/*! number of frames downlink bursts may arrive ahead of their frame */
+#define FAKE_DL_FRAMES		128
+
+/*! a downlink burst waiting for its frame */
+struct fake_burst {
+	uint32_t fn;
+	int valid;
+	uint16_t nbits;
+	ubit_t bits[EGPRS_BURST_LEN];
+};
+
+/*! statistics of one TRX, for the current interval and in total */
+struct fake_stats {
+	uint64_t dl;		/* downlink bursts in time */
+	uint64_t dl_late;	/* downlink bursts after their frame */
+	uint64_t dl_early;	/* more than FAKE_DL_FRAMES ahead */
+	uint64_t dl_dup;	/* a second burst for the same frame and TS */
+	uint64_t dl_bad;	/* invalid length or TS */
+	int64_t headroom_sum;	/* frames ahead of the clock, of dl */
+	int headroom_min;
+	uint64_t ul;		/* uplink bursts sent */
+	uint64_t ul_lost;	/* uplink bursts dropped */
+	uint64_t ul_reordered;	/* uplink bursts sent one frame late */
+};
+
+struct fake_trx {
+	unsigned int num;
+	struct osmo_fd ofd_ctrl;
+	struct osmo_fd ofd_data;
+	int poweron;
+	int packed;		/* downlink bursts are packed (SETPACKED) */
+
+	/* downlink bursts, by frame and timeslot */
+	struct fake_burst dl[FAKE_DL_FRAMES][8];
+
+	/* uplink bursts held back to be sent after the next frame's */
+	uint8_t held[8][EGPRS_BURST_LEN + 10];
+	int held_len[8];
+	unsigned int held_num;
+
+	struct fake_stats cur, total;
+};
+
+static struct {
+	const char *bind_ip;
+	const char *remote_ip;
+	uint16_t base_port;		/* of the transceiver */
+	uint16_t base_port_bts;		/* of osmo-bts-trx */
+	unsigned int num_trx;
+	int8_t rssi;
+	int16_t toa256;
+	unsigned int sigma;		/* noise, in soft bit steps 0..254 */
+	unsigned int loss;		/* percent of uplink bursts dropped */
+	unsigned int reorder;		/* percent of uplink bursts reordered */
+	unsigned int clock_interval;	/* frames between CLOCK indications */
+	unsigned int stats_interval;	/* seconds between statistics */
+	int no_packed;			/* reject SETPACKED */
+} cfg = {
+	.bind_ip = "127.0.0.1",
+	.remote_ip = "127.0.0.1",
+	.base_port = 5700,
+	.base_port_bts = 5800,
+	.num_trx = 1,
+	.rssi = -60,
+	.toa256 = 0,
+	.sigma = 0,
+	.loss = 0,
+	.reorder = 0,
+	.clock_interval = 216,
+	.stats_interval = 10,
+};
+
+static void *tall_fake_ctx;
+static struct fake_trx **fake_trx;
+static struct osmo_fd ofd_clk;
+static struct osmo_fd ofd_timer;
+static uint32_t cur_fn;
+static uint64_t frames, frames_missed;
+static volatile int quit;
+
+/* frames from a to b, negative if b is before a */
+static int fn_delta(uint32_t a, uint32_t b)
+{
+	int d = (b + GSM_HYPERFRAME - a) % GSM_HYPERFRAME;
+
+	if (d > GSM_HYPERFRAME / 2)
+		d -= GSM_HYPERFRAME;
+	return d;
+}
+
+static int percent(unsigned int p)
+{
+	return p && (unsigned int)(random() % 100) < p;
+}
+
+/* approximately gaussian, mean 0 and standard deviation 1 (Irwin-Hall) */
+static double gauss(void)
+{
+	double sum = 0;
+	int i;
+
+	for (i = 0; i < 12; i++)
+		sum += (double)random() / RAND_MAX;
+	return sum - 6.0;
+}
+
+static int udp_open(struct osmo_fd *ofd, uint16_t port, uint16_t port_bts,
+		    int (*cb)(struct osmo_fd *fd, unsigned int what), void *data)
+{
+	int rc;
+
+	ofd->cb = cb;
+	ofd->data = data;
+	rc = osmo_sock_init2_ofd(ofd, AF_UNSPEC, SOCK_DGRAM, IPPROTO_UDP,
+				 cfg.bind_ip, port, cfg.remote_ip, port_bts,
+				 OSMO_SOCK_F_BIND | OSMO_SOCK_F_CONNECT);
+	if (rc < 0)
+		fprintf(stderr, "Cannot open UDP port %u: %s\n", port,
+			strerror(-rc));
+	return rc;
+}
+
+
+/*
+ * control
+ */
+
+static int ctrl_read_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct fake_trx *ft = ofd->data;
+	char buf[1500], rsp[1600], *cmd, *params;
+	int len, status = 0;
+
+	len = recv(ofd->fd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0)
+		return 0;
+	buf[len] = '\0';
+
+	if (strncmp(buf, "CMD ", 4)) {
+		fprintf(stderr, "TRX%u: unknown control message '%s'\n",
+			ft->num, buf);
+		return 0;
+	}
+	cmd = buf + 4;
+	params = strchr(cmd, ' ');
+	if (params)
+		*params++ = '\0';
+	else
+		params = "";
+
+	if (!strcmp(cmd, "POWERON")) {
+		ft->poweron = 1;
+	} else if (!strcmp(cmd, "POWEROFF")) {
+		ft->poweron = 0;
+		ft->packed = 0;
+	} else if (!strcmp(cmd, "SETPACKED")) {
+		if (cfg.no_packed)
+			status = 1;
+		else
+			ft->packed = atoi(params);
+	}
+
+	/* the response carries the parameters of the command */
+	len = snprintf(rsp, sizeof(rsp), "RSP %s %d%s%s", cmd, status,
+		       params[0] ? " " : "", params);
+	send(ofd->fd, rsp, len + 1, 0);
+
+	return 0;
+}
+
+
+/*
+ * data
+ */
+
+static int data_read_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct fake_trx *ft = ofd->data;
+	uint8_t buf[TRX_MAX_BURST_LEN];
+	struct fake_burst *b;
+	uint16_t nbits;
+	uint32_t fn;
+	uint8_t tn;
+	int len, d;
+
+	len = recv(ofd->fd, buf, sizeof(buf), 0);
+	if (len <= 0)
+		return 0;
+
+	if (len < 6) {
+		ft->cur.dl_bad++;
+		return 0;
+	}
+
+	/* TN, FN, power, then the bits, one per byte or packed */
+	nbits = ft->packed ? (len - 6) * 8 : len - 6;
+	if (ft->packed && nbits == (GSM_BURST_LEN + 4))
+		nbits = GSM_BURST_LEN;
+	else if (ft->packed && nbits == (EGPRS_BURST_LEN + 4))
+		nbits = EGPRS_BURST_LEN;
+	tn = buf[0];
+	if (tn >= 8 ||
+	    (nbits != GSM_BURST_LEN && nbits != EGPRS_BURST_LEN)) {
+		ft->cur.dl_bad++;
+		return 0;
+	}
+	fn = (buf[1] << 24) | (buf[2] << 16) | (buf[3] << 8) | buf[4];
+
+	d = fn_delta(cur_fn, fn);
+	if (d < 0) {
+		ft->cur.dl_late++;
+		return 0;
+	}
+	if (d >= FAKE_DL_FRAMES) {
+		ft->cur.dl_early++;
+		return 0;
+	}
+
+	ft->cur.dl++;
+	ft->cur.headroom_sum += d;
+	if (d < ft->cur.headroom_min)
+		ft->cur.headroom_min = d;
+
+	b = &ft->dl[fn % FAKE_DL_FRAMES][tn];
+	if (b->valid && b->fn == fn)
+		ft->cur.dl_dup++;
+	b->fn = fn;
+	b->valid = 1;
+	b->nbits = nbits;
+	if (ft->packed)
+		osmo_pbit2ubit(b->bits, buf + 6, nbits);
+	else
+		memcpy(b->bits, buf + 6, nbits);
+
+	return 0;
+}
+
+/* loop a downlink burst back as uplink burst: TN, FN, RSSI as -dBm,
+ * TOA in 1/256 symbols, soft bits 0 (certain 0) ..254 (certain 1) */
+static int ul_burst_build(uint8_t *buf, const struct fake_burst *b, uint8_t tn)
+{
+	int i, v;
+
+	buf[0] = tn;
+	buf[1] = (b->fn >> 24) & 0xff;
+	buf[2] = (b->fn >> 16) & 0xff;
+	buf[3] = (b->fn >>  8) & 0xff;
+	buf[4] = (b->fn >>  0) & 0xff;
+	buf[5] = -cfg.rssi;
+	buf[6] = (cfg.toa256 >> 8) & 0xff;
+	buf[7] = cfg.toa256 & 0xff;
+
+	for (i = 0; i < b->nbits; i++) {
+		v = b->bits[i] ? 254 : 0;
+		if (cfg.sigma)
+			v += (int)(gauss() * cfg.sigma);
+		buf[8 + i] = v < 0 ? 0 : (v > 254 ? 254 : v);
+	}
+	/* padding, as sent by osmo-trx */
+	buf[8 + i] = buf[9 + i] = 0;
+
+	return b->nbits + 10;
+}
+
+/* send the uplink bursts of the frame that is due */
+static void fake_trx_frame(struct fake_trx *ft, uint32_t fn)
+{
+	uint8_t buf[EGPRS_BURST_LEN + 10];
+	uint8_t held[8][EGPRS_BURST_LEN + 10];
+	int held_len[8];
+	unsigned int held_num, i;
+	uint8_t tn;
+	int len;
+
+	/* what was held back in the last frame goes after this frame */
+	held_num = ft->held_num;
+	memcpy(held, ft->held, sizeof(held));
+	memcpy(held_len, ft->held_len, sizeof(held_len));
+	ft->held_num = 0;
+
+	for (tn = 0; tn < 8; tn++) {
+		struct fake_burst *b = &ft->dl[fn % FAKE_DL_FRAMES][tn];
+
+		if (!b->valid || b->fn != fn)
+			continue;
+		b->valid = 0;
+		if (!ft->poweron)
+			continue;
+
+		if (percent(cfg.loss)) {
+			ft->cur.ul_lost++;
+			continue;
+		}
+		if (percent(cfg.reorder)) {
+			ft->held_len[ft->held_num] =
+				ul_burst_build(ft->held[ft->held_num], b, tn);
+			ft->held_num++;
+			ft->cur.ul_reordered++;
+			continue;
+		}
+		len = ul_burst_build(buf, b, tn);
+		if (send(ft->ofd_data.fd, buf, len, 0) == len)
+			ft->cur.ul++;
+	}
+
+	for (i = 0; i < held_num; i++) {
+		if (send(ft->ofd_data.fd, held[i], held_len[i], 0) == held_len[i])
+			ft->cur.ul++;
+	}
+}
+
+
+/*
+ * statistics
+ */
+
+static void stats_add(struct fake_stats *total, const struct fake_stats *cur)
+{
+	total->dl += cur->dl;
+	total->dl_late += cur->dl_late;
+	total->dl_early += cur->dl_early;
+	total->dl_dup += cur->dl_dup;
+	total->dl_bad += cur->dl_bad;
+	total->headroom_sum += cur->headroom_sum;
+	if (cur->headroom_min < total->headroom_min)
+		total->headroom_min = cur->headroom_min;
+	total->ul += cur->ul;
+	total->ul_lost += cur->ul_lost;
+	total->ul_reordered += cur->ul_reordered;
+}
+
+static void stats_print(const char *what, unsigned int num,
+			const struct fake_stats *s)
+{
+	uint64_t dl_all = s->dl + s->dl_late;
+
+	printf("%s TRX%u: dl %llu late %llu (%.3f%%) early %llu dup %llu "
+	       "bad %llu, headroom min %d avg %.1f frames, ul %llu lost %llu "
+	       "reordered %llu\n", what, num,
+	       (unsigned long long)s->dl, (unsigned long long)s->dl_late,
+	       dl_all ? 100.0 * s->dl_late / dl_all : 0.0,
+	       (unsigned long long)s->dl_early, (unsigned long long)s->dl_dup,
+	       (unsigned long long)s->dl_bad,
+	       s->dl ? s->headroom_min : 0,
+	       s->dl ? (double)s->headroom_sum / s->dl : 0.0,
+	       (unsigned long long)s->ul, (unsigned long long)s->ul_lost,
+	       (unsigned long long)s->ul_reordered);
+}
+
+static void stats_interval(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < cfg.num_trx; i++) {
+		struct fake_trx *ft = fake_trx[i];
+
+		stats_print("interval", i, &ft->cur);
+		stats_add(&ft->total, &ft->cur);
+		memset(&ft->cur, 0, sizeof(ft->cur));
+		ft->cur.headroom_min = FAKE_DL_FRAMES;
+	}
+	fflush(stdout);
+}
+
+
+/*
+ * clock
+ */
+
+static int timer_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	uint64_t expire_count, stats_frames;
+	char buf[32];
+	unsigned int i;
+	int len;
+
+	if (read(ofd->fd, &expire_count, sizeof(expire_count)) != sizeof(expire_count))
+		return 0;
+
+	/* we are a transceiver, frames we were too slow for are lost */
+	if (expire_count > 1)
+		frames_missed += expire_count - 1;
+
+	stats_frames = (uint64_t)cfg.stats_interval * 1000000000 / FRAME_DURATION_nS;
+
+	while (expire_count--) {
+		cur_fn = (cur_fn + 1) % GSM_HYPERFRAME;
+		frames++;
+
+		for (i = 0; i < cfg.num_trx; i++)
+			fake_trx_frame(fake_trx[i], cur_fn);
+
+		if (frames % cfg.clock_interval == 0) {
+			len = snprintf(buf, sizeof(buf), "IND CLOCK %u", cur_fn);
+			send(ofd_clk.fd, buf, len + 1, 0);
+		}
+
+		if (stats_frames && frames % stats_frames == 0)
+			stats_interval();
+	}
+
+	return 0;
+}
+
+static int timer_start(void)
+{
+	struct itimerspec its = {
+		.it_value = { .tv_sec = 0, .tv_nsec = FRAME_DURATION_nS },
+		.it_interval = { .tv_sec = 0, .tv_nsec = FRAME_DURATION_nS },
+	};
+
+	ofd_timer.fd = timerfd_create(CLOCK_MONOTONIC, 0);
+	if (ofd_timer.fd < 0)
+		return -errno;
+	ofd_timer.when = BSC_FD_READ;
+	ofd_timer.cb = timer_cb;
+	if (timerfd_settime(ofd_timer.fd, 0, &its, NULL) < 0)
+		return -errno;
+
+	return osmo_fd_register(&ofd_timer);
+}
+
+/* the clock socket needs no reading, but the BTS may send to it */
+static int clk_read_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	char buf[1500];
+
+	if (recv(ofd->fd, buf, sizeof(buf), 0) < 0)
+		return 0;
+	return 0;
+}
+
+
+static void signal_handler(int signal)
+{
+	quit = 1;
+}
+
+static void print_help(void)
+{
+	printf("Usage: osmo-bts-trx-fake [options]\n"
+	       "  -t, --trx N            number of TRX (default 1)\n"
+	       "  -i, --bind-ip IP       local address (default 127.0.0.1)\n"
+	       "  -R, --remote-ip IP     address of osmo-bts-trx (default 127.0.0.1)\n"
+	       "  -p, --base-port PORT   transceiver base port (default 5700)\n"
+	       "  -P, --bts-port PORT    osmo-bts-trx base port (default 5800)\n"
+	       "  -r, --rssi DBM         uplink RSSI (default -60)\n"
+	       "  -o, --toa256 N         uplink TOA in 1/256 symbols (default 0)\n"
+	       "  -s, --sigma N          noise on the soft bits 0..254 (default 0)\n"
+	       "  -l, --loss PERCENT     uplink bursts dropped (default 0)\n"
+	       "  -x, --reorder PERCENT  uplink bursts held back by one frame\n"
+	       "                         (default 0)\n"
+	       "  -c, --clock N          frames between CLOCK indications\n"
+	       "                         (default 216)\n"
+	       "  -S, --stats N          seconds between statistics (default 10,\n"
+	       "                         0 disables)\n"
+	       "  -u, --unpacked         reject SETPACKED\n"
+	       "  -z, --seed N           random seed (default 1)\n");
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i, seed = 1;
+
+	while (1) {
+		static const struct option long_options[] = {
+			{ "help", 0, 0, 'h' },
+			{ "trx", 1, 0, 't' },
+			{ "bind-ip", 1, 0, 'i' },
+			{ "remote-ip", 1, 0, 'R' },
+			{ "base-port", 1, 0, 'p' },
+			{ "bts-port", 1, 0, 'P' },
+			{ "rssi", 1, 0, 'r' },
+			{ "toa256", 1, 0, 'o' },
+			{ "sigma", 1, 0, 's' },
+			{ "loss", 1, 0, 'l' },
+			{ "reorder", 1, 0, 'x' },
+			{ "clock", 1, 0, 'c' },
+			{ "stats", 1, 0, 'S' },
+			{ "unpacked", 0, 0, 'u' },
+			{ "seed", 1, 0, 'z' },
+			{ 0, 0, 0, 0 }
+		};
+		int opt = getopt_long(argc, argv, "ht:i:R:p:P:r:o:s:l:x:c:S:uz:",
+				      long_options, NULL);
+
+		if (opt == -1)
+			break;
+		switch (opt) {
+		case 't':
+			cfg.num_trx = atoi(optarg);
+			break;
+		case 'i':
+			cfg.bind_ip = optarg;
+			break;
+		case 'R':
+			cfg.remote_ip = optarg;
+			break;
+		case 'p':
+			cfg.base_port = atoi(optarg);
+			break;
+		case 'P':
+			cfg.base_port_bts = atoi(optarg);
+			break;
+		case 'r':
+			cfg.rssi = atoi(optarg);
+			break;
+		case 'o':
+			cfg.toa256 = atoi(optarg);
+			break;
+		case 's':
+			cfg.sigma = atoi(optarg);
+			break;
+		case 'l':
+			cfg.loss = atoi(optarg);
+			break;
+		case 'x':
+			cfg.reorder = atoi(optarg);
+			break;
+		case 'c':
+			cfg.clock_interval = atoi(optarg);
+			break;
+		case 'S':
+			cfg.stats_interval = atoi(optarg);
+			break;
+		case 'u':
+			cfg.no_packed = 1;
+			break;
+		case 'z':
+			seed = atoi(optarg);
+			break;
+		default:
+			print_help();
+			exit(opt == 'h' ? 0 : 2);
+		}
+	}
+	if (cfg.num_trx < 1 || cfg.num_trx > 255 || cfg.clock_interval < 1 ||
+	    cfg.loss > 100 || cfg.reorder > 100) {
+		print_help();
+		exit(2);
+	}
+
+	srandom(seed);
+
+	tall_fake_ctx = talloc_named_const(NULL, 1, "fake transceiver");
+	fake_trx = talloc_zero_array(tall_fake_ctx, struct fake_trx *, cfg.num_trx);
+	OSMO_ASSERT(fake_trx);
+
+	/* same port layout as compute_port() in trx_if.c */
+	if (udp_open(&ofd_clk, cfg.base_port, cfg.base_port_bts,
+		     clk_read_cb, NULL) < 0)
+		exit(1);
+	for (i = 0; i < cfg.num_trx; i++) {
+		struct fake_trx *ft = talloc_zero(fake_trx, struct fake_trx);
+
+		OSMO_ASSERT(ft);
+		ft->num = i;
+		ft->cur.headroom_min = ft->total.headroom_min = FAKE_DL_FRAMES;
+		if (udp_open(&ft->ofd_ctrl, cfg.base_port + (i << 1) + 1,
+			     cfg.base_port_bts + (i << 1) + 1, ctrl_read_cb, ft) < 0)
+			exit(1);
+		if (udp_open(&ft->ofd_data, cfg.base_port + (i << 1) + 2,
+			     cfg.base_port_bts + (i << 1) + 2, data_read_cb, ft) < 0)
+			exit(1);
+		fake_trx[i] = ft;
+	}
+
+	if (timer_start() < 0) {
+		fprintf(stderr, "Cannot start frame clock: %s\n", strerror(errno));
+		exit(1);
+	}
+
+	signal(SIGINT, &signal_handler);
+	signal(SIGTERM, &signal_handler);
+
+	printf("Fake transceiver with %u TRX on %s:%u, osmo-bts-trx on %s:%u\n",
+	       cfg.num_trx, cfg.bind_ip, cfg.base_port, cfg.remote_ip,
+	       cfg.base_port_bts);
+	fflush(stdout);
+
+	while (!quit)
+		osmo_select_main(0);
+
+	for (i = 0; i < cfg.num_trx; i++) {
+		stats_add(&fake_trx[i]->total, &fake_trx[i]->cur);
+		stats_print("total", i, &fake_trx[i]->total);
+	}
+	printf("%llu frames, %llu missed by the fake transceiver\n",
+	       (unsigned long long)frames, (unsigned long long)frames_missed);
+
+	talloc_free(tall_fake_ctx);
+	return 0;
+}
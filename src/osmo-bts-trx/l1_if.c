@@ -58,6 +58,32 @@ static const uint8_t transceiver_chan_types[_GSM_PCHAN_MAX] = {
 	[GSM_PCHAN_UNKNOWN]             = 0,
 };
 
+/* shared by osmo-bts-trx and osmo-bts-trx-bench */
+void bts_model_phy_link_set_defaults(struct phy_link *plink)
+{
+	plink->u.osmotrx.local_ip = talloc_strdup(plink, "127.0.0.1");
+	plink->u.osmotrx.remote_ip = talloc_strdup(plink, "127.0.0.1");
+	plink->u.osmotrx.base_port_local = 5800;
+	plink->u.osmotrx.base_port_remote = 5700;
+	plink->u.osmotrx.clock_advance = 20;
+	plink->u.osmotrx.rts_advance = 5;
+	plink->u.osmotrx.trx_ta_loop = true;
+	plink->u.osmotrx.trx_ms_power_loop = false;
+	plink->u.osmotrx.trx_target_rssi = -10;
+	plink->u.osmotrx.rx_batch = 1;
+	/* opt-in, it changes the FN timer period of existing setups */
+	plink->u.osmotrx.clock_discipline = false;
+}
+
+void bts_model_phy_instance_set_defaults(struct phy_instance *pinst)
+{
+	struct trx_l1h *l1h;
+	l1h = talloc_zero(tall_bts_ctx, struct trx_l1h);
+	l1h->phy_inst = pinst;
+	pinst->u.osmotrx.hdl = l1h;
+
+	l1h->config.power_oml = 1;
+}
 
 static void check_transceiver_availability_trx(struct trx_l1h *l1h, int avail)
 {
@@ -94,14 +120,14 @@ static void check_transceiver_availability_trx(struct trx_l1h *l1h, int avail)
 	}
 }
 
-int check_transceiver_availability(struct gsm_bts *bts, int avail)
+int check_transceiver_availability(struct phy_link *plink, int avail)
 {
-	struct gsm_bts_trx *trx;
+	struct phy_instance *pinst;
 
-	llist_for_each_entry(trx, &bts->trx_list, list) {
-		struct phy_instance *pinst = trx_phy_instance(trx);
-		struct trx_l1h *l1h = pinst->u.osmotrx.hdl;
-		check_transceiver_availability_trx(l1h, avail);
+	llist_for_each_entry(pinst, &plink->instances, list) {
+		if (!pinst->trx)
+			continue;
+		check_transceiver_availability_trx(pinst->u.osmotrx.hdl, avail);
 	}
 	return 0;
 }
@@ -139,7 +165,7 @@ int l1if_provision_transceiver_trx(struct trx_l1h *l1h)
 {
 	uint8_t tn;
 
-	if (!transceiver_available)
+	if (!l1h->phy_inst->phy_link->u.osmotrx.transceiver_available)
 		return -EIO;
 
 	if (l1h->config.poweron
@@ -160,6 +186,10 @@ int l1if_provision_transceiver_trx(struct trx_l1h *l1h)
 			trx_if_cmd_setbsic(l1h, l1h->config.bsic);
 			l1h->config.bsic_sent = 1;
 		}
+		if (l1h->config.packed && !l1h->config.packed_sent) {
+			trx_if_cmd_setpacked(l1h, 1);
+			l1h->config.packed_sent = 1;
+		}
 
 		if (!l1h->config.poweron_sent) {
 			trx_if_cmd_poweron(l1h);
@@ -202,6 +232,9 @@ int l1if_provision_transceiver_trx(struct trx_l1h *l1h)
 		l1h->config.power_sent = 0;
 		l1h->config.maxdly_sent = 0;
 		l1h->config.maxdlynb_sent = 0;
+		l1h->config.packed_sent = 0;
+		/* the transceiver expects unpacked bursts after POWEROFF */
+		l1h->trxd_packed = 0;
 		for (tn = 0; tn < TRX_NR_TS; tn++)
 			l1h->config.slottype_sent[tn] = 0;
 	}
@@ -209,13 +242,12 @@ int l1if_provision_transceiver_trx(struct trx_l1h *l1h)
 	return 0;
 }
 
-int l1if_provision_transceiver(struct gsm_bts *bts)
+int l1if_provision_transceiver(struct phy_link *plink)
 {
-	struct gsm_bts_trx *trx;
+	struct phy_instance *pinst;
 	uint8_t tn;
 
-	llist_for_each_entry(trx, &bts->trx_list, list) {
-		struct phy_instance *pinst = trx_phy_instance(trx);
+	llist_for_each_entry(pinst, &plink->instances, list) {
 		struct trx_l1h *l1h = pinst->u.osmotrx.hdl;
 		l1h->config.arfcn_sent = 0;
 		l1h->config.tsc_sent = 0;
@@ -225,6 +257,9 @@ int l1if_provision_transceiver(struct gsm_bts *bts)
 		l1h->config.power_sent = 0;
 		l1h->config.maxdly_sent = 0;
 		l1h->config.maxdlynb_sent = 0;
+		l1h->config.packed_sent = 0;
+		/* a (re)started transceiver expects unpacked bursts */
+		l1h->trxd_packed = 0;
 		for (tn = 0; tn < TRX_NR_TS; tn++)
 			l1h->config.slottype_sent[tn] = 0;
 		l1if_provision_transceiver_trx(l1h);
@@ -316,8 +351,9 @@ static uint8_t trx_set_bts(struct gsm_bts *bts, struct tlv_parsed *new_attr)
 			l1h->config.bsic_sent = 0;
 			l1if_provision_transceiver_trx(l1h);
 		}
+		check_transceiver_availability_trx(l1h,
+			pinst->phy_link->u.osmotrx.transceiver_available);
 	}
-	check_transceiver_availability(bts, transceiver_available);
 
 
 	return 0;
@@ -38,6 +38,9 @@ struct trx_config {
 	int			maxdlynb;
 	int			maxdlynb_sent;
 
+	int			packed;		/* ask for packed TRXD bursts */
+	int			packed_sent;
+
 	uint8_t			slotmask;
 
 	int			slottype_valid[TRX_NR_TS];
@@ -45,6 +48,63 @@ struct trx_config {
 	int			slottype_sent[TRX_NR_TS];
 };
 
+/*! state of the PI loop disciplining the FN timer to the TRX clock */
+struct trx_clock_disc {
+	/*! FN timer interval currently in use (ns) */
+	int64_t interval_ns;
+	/*! integrator: frequency correction per frame (ns) */
+	double freq_ns;
+	/*! estimated offset of the TRX clock against the host clock (ppm) */
+	double ppm;
+	/*! smoothed residual phase error at clock indications (us) */
+	double jitter_us;
+	/*! number of loop updates since the clock was (re)started */
+	unsigned int updates;
+};
+
+/*! state of the auto-tuning of clock_advance and rts_advance */
+struct trx_adv_tune {
+	/*! advances the current ones are moved to, one frame at a time */
+	uint32_t clock_advance_target;
+	uint32_t rts_advance_target;
+	/*! last frames composed and requested, to fill in or skip frames
+	 *  while an advance is moved */
+	uint32_t last_dl_fn;
+	uint32_t last_rts_fn;
+	int last_valid;
+	/*! current measurement window */
+	unsigned int win_frames;
+	int64_t win_lag_us_max;
+	/*! windows in a row in which an advance could have been lower */
+	unsigned int quiet_fn, quiet_rts;
+	/*! how late frames were composed, binned by trx_sched_slack_bin() */
+	uint64_t lag_hist[TRX_SCHED_SLACK_BINS];
+	/*! frames composed later than the clock advance allowed */
+	uint64_t late_frames;
+	unsigned int raised, lowered;
+};
+
+/*! number of slots of the encoded block cache, must be a power of two */
+#define TRX_ENC_CACHE_SIZE	64
+
+/*! a 23 byte block and its 4 interleaved bursts of coded bits, packed */
+struct trx_enc_cache_entry {
+	uint8_t			l2[GSM_MACBLOCK_LEN];
+	uint8_t			valid;
+	/* hits since the block was cached, protects it from being
+	 * evicted by blocks which are only sent once (paging) */
+	uint8_t			credit;
+	pbit_t			bits[464 / 8];
+};
+
+/*! coded BCCH/CCCH/SACCH blocks, most of which are sent over and over */
+struct trx_enc_cache {
+	struct trx_enc_cache_entry entry[TRX_ENC_CACHE_SIZE];
+};
+
+struct trx_tx_batch;
+struct trx_rx_batch;
+
 struct trx_l1h {
 	struct llist_head	trx_ctrl_list;
 	/* Latest RSPed cmd, used to catch duplicate RSPs from sent retransmissions */
@@ -57,16 +117,37 @@ struct trx_l1h {
 	struct osmo_timer_list	trx_ctrl_timer;
 	struct osmo_fd		trx_ofd_data;
 
+	/* downlink bursts of the current frame (NULL if not batching) */
+	struct trx_tx_batch	*tx_batch;
+	/* longest time a batch took to send (us), since last shown */
+	uint32_t		tx_send_us_max;
+
+	/* uplink bursts read by one recvmmsg() */
+	struct trx_rx_batch	*rx_batch;
+	/* largest number of bursts read in one wakeup, since last shown */
+	unsigned int		rx_batch_max;
+
+	struct rate_ctr_group	*ctrs;
+
+	/* already encoded blocks of BCCH, CCCH and SACCH */
+	struct trx_enc_cache	enc_cache;
+
 	/* transceiver config */
 	struct trx_config	config;
+	/* the transceiver accepted packed downlink bursts */
+	int			trxd_packed;
 	uint8_t			ho_rach_detect[TRX_NR_TS][TS_MAX_LCHAN];
 
 	struct l1sched_trx	l1s;
 };
 
-int check_transceiver_availability(struct gsm_bts *bts, int avail);
+int check_transceiver_availability(struct phy_link *plink, int avail);
+const struct trx_clock_disc *trx_sched_clock_disc(struct phy_link *plink);
+void trx_sched_clock_stop(struct phy_link *plink);
+const struct trx_adv_tune *trx_sched_adv_tune(struct phy_link *plink);
+int trx_sched_fn(struct phy_link *plink, uint32_t fn);
 int l1if_provision_transceiver_trx(struct trx_l1h *l1h);
-int l1if_provision_transceiver(struct gsm_bts *bts);
+int l1if_provision_transceiver(struct phy_link *plink);
 int l1if_mph_time_ind(struct gsm_bts *bts, uint32_t fn);
 int l1if_process_meas_res(struct gsm_bts_trx *trx, uint8_t tn, uint32_t fn, uint8_t chan_nr,
 	int n_errors, int n_bits_total, float rssi, int16_t toa256);
@@ -118,29 +118,6 @@ int bts_model_init(struct gsm_bts *bts)
 	return 0;
 }
 
-void bts_model_phy_link_set_defaults(struct phy_link *plink)
-{
-	plink->u.osmotrx.local_ip = talloc_strdup(plink, "127.0.0.1");
-	plink->u.osmotrx.remote_ip = talloc_strdup(plink, "127.0.0.1");
-	plink->u.osmotrx.base_port_local = 5800;
-	plink->u.osmotrx.base_port_remote = 5700;
-	plink->u.osmotrx.clock_advance = 20;
-	plink->u.osmotrx.rts_advance = 5;
-	plink->u.osmotrx.trx_ta_loop = true;
-	plink->u.osmotrx.trx_ms_power_loop = false;
-	plink->u.osmotrx.trx_target_rssi = -10;
-}
-
-void bts_model_phy_instance_set_defaults(struct phy_instance *pinst)
-{
-	struct trx_l1h *l1h;
-	l1h = talloc_zero(tall_bts_ctx, struct trx_l1h);
-	l1h->phy_inst = pinst;
-	pinst->u.osmotrx.hdl = l1h;
-
-	l1h->config.power_oml = 1;
-}
-
 int main(int argc, char **argv)
 {
 	return bts_main(argc, argv);
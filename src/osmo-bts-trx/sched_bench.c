@@ -0,0 +1,450 @@
+/* Synthetic load benchmark of the OsmoBTS-TRX L1 scheduler */
+
+/* This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Sets up the scheduler of N TRX with the given channel combinations and
+ * all their logical channels active, then drives trx_sched_fn() and
+ * trx_sched_ul_burst() with pre-generated bursts as fast as possible.
+ * There is no transceiver: no sockets, no timerfd, bursts are dropped by
+ * trx_if_send_burst().  TCH run AMR, PDCH get an MCS-9 block for every
+ * downlink block and 8PSK bursts in uplink.  The uplink bursts are noise,
+ * so decoding takes the bad frame paths.
+ *
+ *   osmo-bts-trx-bench [-t trx] [-n frames] [-c pchan,pchan,...]
+ *
+ * with up to 8 pchans (ccch, ccch+sdcch4, sdcch8, tchf, tchh, pdch, none)
+ * for the timeslots of every TRX.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/application.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/gsm/protocol/gsm_04_08.h>
+#include <osmocom/gsm/protocol/gsm_08_58.h>
+
+#include <osmo-bts/gsm_data.h>
+#include <osmo-bts/phy_link.h>
+#include <osmo-bts/logging.h>
+#include <osmo-bts/bts.h>
+#include <osmo-bts/bts_model.h>
+#include <osmo-bts/l1sap.h>
+#include <osmo-bts/scheduler.h>
+#include <osmo-bts/scheduler_backend.h>
+
+#include "l1_if.h"
+#include "trx_if.h"
+
+/* normally defined along with bts_main(), which is not linked */
+int quit = 0;
+
+/* what osmo-bts-trx's main.c provides to the common code; the PHY
+ * defaults come from l1_if.c */
+uint32_t trx_get_hlayer1(struct gsm_bts_trx *trx)
+{
+	return 0;
+}
+
+int bts_model_init(struct gsm_bts *bts)
+{
+	bts->variant = BTS_OSMO_TRX;
+	return 0;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TICKS_UNIT "cycles"
+static inline uint64_t ticks(void)
+{
+	return __rdtsc();
+}
+#else
+#define TICKS_UNIT "ns"
+static inline uint64_t ticks(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * per handler accounting: the dispatch plan of every timeslot is pointed
+ * at wrappers, which time the handler of the logical channel
+ */
+
+enum { H_RTS, H_DL, H_UL, _H_MAX };
+static const char *h_name[_H_MAX] = { "rts", "dl", "ul" };
+
+static struct {
+	uint64_t calls;
+	uint64_t ticks;
+} h_stat[_TRX_CHAN_MAX][_H_MAX];
+
+static int bench_rts_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
+			enum trx_chan_type chan)
+{
+	uint64_t t = ticks();
+	int rc = trx_chan_desc[chan].rts_fn(l1t, tn, fn, chan);
+
+	h_stat[chan][H_RTS].ticks += ticks() - t;
+	h_stat[chan][H_RTS].calls++;
+	return rc;
+}
+
+static ubit_t *bench_dl_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
+			   enum trx_chan_type chan, uint8_t bid, uint16_t *nbits)
+{
+	uint64_t t = ticks();
+	ubit_t *bits = trx_chan_desc[chan].dl_fn(l1t, tn, fn, chan, bid, nbits);
+
+	h_stat[chan][H_DL].ticks += ticks() - t;
+	h_stat[chan][H_DL].calls++;
+	return bits;
+}
+
+static int bench_ul_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
+		       enum trx_chan_type chan, uint8_t bid, sbit_t *bits,
+		       uint16_t nbits, int8_t rssi, int16_t toa256)
+{
+	uint64_t t = ticks();
+	int rc = trx_chan_desc[chan].ul_fn(l1t, tn, fn, chan, bid, bits, nbits,
+					   rssi, toa256);
+
+	h_stat[chan][H_UL].ticks += ticks() - t;
+	h_stat[chan][H_UL].calls++;
+	return rc;
+}
+
+static void plan_wrap(struct l1sched_ts *l1ts)
+{
+	int i;
+
+	for (i = 0; i < l1ts->mf_period; i++) {
+		struct l1sched_frame_plan *plan = &l1ts->mf_plan[i];
+		if (plan->rts_fn)
+			plan->rts_fn = bench_rts_fn;
+		if (plan->dl_fn)
+			plan->dl_fn = bench_dl_fn;
+		if (plan->ul_fn)
+			plan->ul_fn = bench_ul_fn;
+	}
+}
+
+/*
+ * setup
+ */
+
+static const struct value_string pchan_names[] = {
+	{ GSM_PCHAN_NONE,		"none" },
+	{ GSM_PCHAN_CCCH,		"ccch" },
+	{ GSM_PCHAN_CCCH_SDCCH4,	"ccch+sdcch4" },
+	{ GSM_PCHAN_SDCCH8_SACCH8C,	"sdcch8" },
+	{ GSM_PCHAN_TCH_F,		"tchf" },
+	{ GSM_PCHAN_TCH_H,		"tchh" },
+	{ GSM_PCHAN_PDCH,		"pdch" },
+	{ 0, NULL }
+};
+
+static enum gsm_phys_chan_config ts_pchan[TRX_NR_TS] = {
+	GSM_PCHAN_CCCH_SDCCH4,
+	GSM_PCHAN_SDCCH8_SACCH8C,
+	GSM_PCHAN_TCH_F,
+	GSM_PCHAN_TCH_F,
+	GSM_PCHAN_TCH_F,
+	GSM_PCHAN_TCH_F,
+	GSM_PCHAN_PDCH,
+	GSM_PCHAN_PDCH,
+};
+
+static int parse_pchans(char *list)
+{
+	char *tok, *save = NULL;
+	uint8_t tn = 0;
+	int pchan;
+
+	for (tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		if (tn == TRX_NR_TS)
+			return -1;
+		pchan = get_string_value(pchan_names, tok);
+		if (pchan < 0) {
+			fprintf(stderr, "Unknown channel combination '%s'\n", tok);
+			return -1;
+		}
+		ts_pchan[tn++] = pchan;
+	}
+	for (; tn < TRX_NR_TS; tn++)
+		ts_pchan[tn] = GSM_PCHAN_NONE;
+
+	return 0;
+}
+
+/* activate all logical channels of a timeslot, TCH in AMR */
+static void setup_ts(struct l1sched_trx *l1t, uint8_t tn)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+	int pdch = ts_pchan[tn] == GSM_PCHAN_PDCH;
+	int i;
+
+	if (trx_sched_set_pchan(l1t, tn, ts_pchan[tn]) < 0)
+		return;
+
+	for (i = 0; i < _TRX_CHAN_MAX; i++) {
+		if (trx_chan_desc[i].auto_active || trx_chan_desc[i].pdch != pdch)
+			continue;
+		trx_sched_set_lchan(l1t, trx_chan_desc[i].chan_nr | tn,
+				    trx_chan_desc[i].link_id, 1);
+		if (i == TRXC_TCHF || i == TRXC_TCHH_0 || i == TRXC_TCHH_1)
+			trx_sched_set_mode(l1t, trx_chan_desc[i].chan_nr | tn,
+					   RSL_CMOD_SPD_SPEECH,
+					   GSM48_CMODE_SPEECH_AMR,
+					   4, 0, 2, 4, 7, 3, 0);
+	}
+
+	plan_wrap(l1ts);
+}
+
+/* queue an MCS-9 block for every PDTCH block whose RTS is due at fn,
+ * instead of a PCU */
+static void feed_pdtch(struct l1sched_trx *l1t, uint32_t fn)
+{
+	uint8_t tn;
+
+	for (tn = 0; tn < TRX_NR_TS; tn++) {
+		struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+		const struct l1sched_frame_plan *plan;
+		struct osmo_phsap_prim *l1sap;
+		struct msgb *msg;
+
+		if (ts_pchan[tn] != GSM_PCHAN_PDCH || !l1ts->mf_period)
+			continue;
+		plan = &l1ts->mf_plan[fn % l1ts->mf_period];
+		if (!plan->rts_fn || plan->dl_chan != TRXC_PDTCH)
+			continue;
+
+		msg = l1sap_msgb_alloc(155);
+		l1sap = msgb_l1sap_prim(msg);
+		osmo_prim_init(&l1sap->oph, SAP_GSM_PH, PRIM_PH_DATA,
+			       PRIM_OP_REQUEST, msg);
+		l1sap->u.data.chan_nr = trx_chan_desc[TRXC_PDTCH].chan_nr | tn;
+		l1sap->u.data.link_id = trx_chan_desc[TRXC_PDTCH].link_id;
+		l1sap->u.data.fn = fn;
+		msg->l2h = msgb_put(msg, 155);
+		/* header with CPS 0, then some payload */
+		memset(msg->l2h, 0, 5);
+		memset(msg->l2h + 5, 0x2b, 150);
+
+		trx_sched_ph_data_req(l1t, l1sap);
+	}
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void print_help(void)
+{
+	printf("Usage: osmo-bts-trx-bench [-t trx] [-n frames] [-c pchan,...]\n"
+	       "  -t, --trx N          number of TRX (default 1)\n"
+	       "  -n, --frames N       number of TDMA frames (default 10000)\n"
+	       "  -c, --pchans LIST    channel combinations of TS0..7, out of\n"
+	       "                       none, ccch, ccch+sdcch4, sdcch8, tchf,\n"
+	       "                       tchh, pdch (default ccch+sdcch4,sdcch8,\n"
+	       "                       tchf,tchf,tchf,tchf,pdch,pdch)\n");
+}
+
+int main(int argc, char **argv)
+{
+	static sbit_t gmsk[GSM_BURST_LEN], psk[EGPRS_BURST_LEN];
+	unsigned int num_trx = 1, num_frames = 10000;
+	struct phy_instance *pinst;
+	struct phy_link *plink;
+	struct gsm_bts *bts;
+	uint64_t t_start, t_total, t_handlers = 0;
+	uint32_t *lat, fn = 0;
+	unsigned int i, c, h;
+	uint8_t tn;
+	double fn_s;
+
+	while (1) {
+		static const struct option long_options[] = {
+			{ "help", 0, 0, 'h' },
+			{ "trx", 1, 0, 't' },
+			{ "frames", 1, 0, 'n' },
+			{ "pchans", 1, 0, 'c' },
+			{ 0, 0, 0, 0 }
+		};
+		int opt = getopt_long(argc, argv, "ht:n:c:", long_options, NULL);
+
+		if (opt == -1)
+			break;
+		switch (opt) {
+		case 't':
+			num_trx = atoi(optarg);
+			break;
+		case 'n':
+			num_frames = atoi(optarg);
+			break;
+		case 'c':
+			if (parse_pchans(optarg) < 0)
+				exit(2);
+			break;
+		default:
+			print_help();
+			exit(opt == 'h' ? 0 : 2);
+		}
+	}
+	if (num_trx < 1 || num_trx > 255 || num_frames < 1) {
+		print_help();
+		exit(2);
+	}
+
+	tall_bts_ctx = talloc_named_const(NULL, 1, "OsmoBTS context");
+	msgb_talloc_ctx_init(tall_bts_ctx, 0);
+	osmo_init_logging2(tall_bts_ctx, &bts_log_info);
+	log_set_log_level(osmo_stderr_target, LOGL_FATAL);
+
+	bts = gsm_bts_alloc(tall_bts_ctx, 0);
+	if (!bts) {
+		fprintf(stderr, "Failed to create BTS structure\n");
+		exit(1);
+	}
+	for (i = 0; i < num_trx; i++)
+		gsm_bts_trx_alloc(bts);
+	if (bts_init(bts) < 0) {
+		fprintf(stderr, "Failed to initialize BTS\n");
+		exit(1);
+	}
+
+	plink = phy_link_create(tall_bts_ctx, 0);
+	for (i = 0; i < num_trx; i++) {
+		struct gsm_bts_trx *trx = gsm_bts_trx_num(bts, i);
+		struct trx_l1h *l1h;
+
+		pinst = phy_instance_create(plink, i);
+		phy_instance_link_to_trx(pinst, trx);
+		l1h = pinst->u.osmotrx.hdl;
+		l1h->config.poweron = 1;
+		l1h->config.slotmask = 0xff;
+		trx_sched_init(&l1h->l1s, trx);
+		for (tn = 0; tn < TRX_NR_TS; tn++)
+			setup_ts(&l1h->l1s, tn);
+	}
+
+	/* the uplink bursts are noise */
+	srand(1);
+	for (i = 0; i < GSM_BURST_LEN; i++)
+		gmsk[i] = (rand() % 255) - 127;
+	for (i = 0; i < EGPRS_BURST_LEN; i++)
+		psk[i] = (rand() % 255) - 127;
+
+	lat = talloc_array(tall_bts_ctx, uint32_t, num_frames);
+	OSMO_ASSERT(lat);
+
+	t_start = now_ns();
+	for (i = 0; i < num_frames; i++) {
+		uint64_t t = now_ns();
+		uint32_t dl_fn = (fn + plink->u.osmotrx.clock_advance) % GSM_HYPERFRAME;
+		uint32_t rts_fn = (dl_fn + plink->u.osmotrx.rts_advance) % GSM_HYPERFRAME;
+
+		llist_for_each_entry(pinst, &plink->instances, list) {
+			struct trx_l1h *l1h = pinst->u.osmotrx.hdl;
+			feed_pdtch(&l1h->l1s, rts_fn);
+		}
+
+		trx_sched_fn(plink, fn);
+
+		llist_for_each_entry(pinst, &plink->instances, list) {
+			struct trx_l1h *l1h = pinst->u.osmotrx.hdl;
+			struct l1sched_trx *l1t = &l1h->l1s;
+
+			for (tn = 0; tn < TRX_NR_TS; tn++) {
+				struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+
+				if (!l1ts->mf_period)
+					continue;
+				if (l1ts->mf_plan[fn % l1ts->mf_period].ul_chan == TRXC_PDTCH)
+					trx_sched_ul_burst(l1t, tn, fn, psk,
+							   EGPRS_BURST_LEN, -60, 0);
+				else
+					trx_sched_ul_burst(l1t, tn, fn, gmsk,
+							   GSM_BURST_LEN, -60, 0);
+			}
+		}
+
+		lat[i] = now_ns() - t;
+		fn = (fn + 1) % GSM_HYPERFRAME;
+	}
+	t_total = now_ns() - t_start;
+
+	/* a TDMA frame lasts 120/26 ms */
+	fn_s = (double)num_frames * 1e9 / t_total;
+	printf("%u TRX, %u frames:", num_trx, num_frames);
+	for (tn = 0; tn < TRX_NR_TS; tn++)
+		printf(" %s", get_value_string(pchan_names, ts_pchan[tn]));
+	printf("\n");
+	printf(" %.1f FN/s, %.1f times real time\n", fn_s, fn_s * 120 / 26 / 1000);
+
+	qsort(lat, num_frames, sizeof(*lat), cmp_u32);
+	printf(" per-FN latency: p50 %.1f us, p90 %.1f us, p99 %.1f us, "
+	       "p99.9 %.1f us, max %.1f us\n",
+	       lat[num_frames * 50 / 100] / 1000.0,
+	       lat[num_frames * 90 / 100] / 1000.0,
+	       lat[num_frames * 99 / 100] / 1000.0,
+	       lat[num_frames * 999 / 1000] / 1000.0,
+	       lat[num_frames - 1] / 1000.0);
+
+	for (c = 0; c < _TRX_CHAN_MAX; c++)
+		for (h = 0; h < _H_MAX; h++)
+			t_handlers += h_stat[c][h].ticks;
+
+	printf(" %-16s %-4s %10s %14s %7s\n", "handler", "", "calls",
+	       TICKS_UNIT "/call", "share");
+	for (c = 0; c < _TRX_CHAN_MAX; c++) {
+		for (h = 0; h < _H_MAX; h++) {
+			if (!h_stat[c][h].calls)
+				continue;
+			printf(" %-16s %-4s %10"PRIu64" %14.0f %6.1f%%\n",
+			       trx_chan_desc[c].name, h_name[h],
+			       h_stat[c][h].calls,
+			       (double)h_stat[c][h].ticks / h_stat[c][h].calls,
+			       t_handlers ? 100.0 * h_stat[c][h].ticks / t_handlers : 0);
+		}
+	}
+
+	return 0;
+}
@@ -21,11 +21,13 @@
  *
  */
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <errno.h>
 #include <stdint.h>
 #include <ctype.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <sys/timerfd.h>
 
 #include <osmocom/core/msgb.h>
@@ -34,6 +36,7 @@
 #include <osmocom/codec/codec.h>
 #include <osmocom/codec/ecu.h>
 #include <osmocom/core/bits.h>
+#include <osmocom/core/rate_ctr.h>
 #include <osmocom/gsm/a5.h>
 #include <osmocom/coding/gsm0503_coding.h>
 
@@ -48,12 +51,9 @@
 
 #include "l1_if.h"
 #include "trx_if.h"
+#include "trx_dec.h"
 #include "loops.h"
 
-extern void *tall_bts_ctx;
-
-/* Maximum size of a EGPRS message in bytes */
-#define EGPRS_0503_MAX_BYTES		155
 
 
 /* Compute the bit error rate in 1/10000 units */
@@ -95,11 +95,20 @@ ubit_t *tx_fcch_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	return (ubit_t *) _sched_fcch_burst;
 }
 
+/* the backend may want the burst composed right where it is sent from,
+ * otherwise it goes into the handler's own buffer */
+static inline ubit_t *tx_burst_buf(struct l1sched_trx *l1t, ubit_t *bits)
+{
+	return l1t->dl_burst_out ? l1t->dl_burst_out : bits;
+}
+
 /* obtain a to-be-transmitted SCH (synchronization channel) burst */
 ubit_t *tx_sch_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	enum trx_chan_type chan, uint8_t bid, uint16_t *nbits)
 {
-	static ubit_t bits[GSM_BURST_LEN], burst[78];
+	static ubit_t _bits[GSM_BURST_LEN];
+	ubit_t *bits = tx_burst_buf(l1t, _bits);
+	ubit_t burst[78];
 	uint8_t sb_info[4];
 	struct	gsm_time t;
 	uint8_t t3p, bsic;
@@ -140,6 +149,47 @@ ubit_t *tx_sch_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	return bits;
 }
 
+/* encode a BCCH, CCCH or SACCH block, or take it from the cache if the
+ * same block has been encoded before */
+static void tx_xcch_encode_cached(struct l1sched_trx *l1t, ubit_t *bursts,
+				  const uint8_t *l2)
+{
+	struct trx_l1h *l1h = trx_phy_instance(l1t->trx)->u.osmotrx.hdl;
+	struct trx_enc_cache *cache = &l1h->enc_cache;
+	struct trx_enc_cache_entry *e;
+	uint32_t hash = 2166136261u;
+	int i;
+
+	/* FNV-1a */
+	for (i = 0; i < GSM_MACBLOCK_LEN; i++)
+		hash = (hash ^ l2[i]) * 16777619u;
+	e = &cache->entry[hash & (TRX_ENC_CACHE_SIZE - 1)];
+
+	if (e->valid && !memcmp(e->l2, l2, GSM_MACBLOCK_LEN)) {
+		osmo_pbit2ubit(bursts, e->bits, 464);
+		if (e->credit < 255)
+			e->credit++;
+		if (l1h->ctrs)
+			rate_ctr_inc2(l1h->ctrs, TRX_CTR_ENC_CACHE_HIT);
+		return;
+	}
+
+	gsm0503_xcch_encode(bursts, l2);
+	if (l1h->ctrs)
+		rate_ctr_inc2(l1h->ctrs, TRX_CTR_ENC_CACHE_MISS);
+
+	/* a block which keeps repeating only gives way after as many
+	 * misses on its slot as it had hits */
+	if (e->valid && e->credit) {
+		e->credit--;
+		return;
+	}
+	memcpy(e->l2, l2, GSM_MACBLOCK_LEN);
+	osmo_ubit2pbit(e->bits, bursts, 464);
+	e->credit = 0;
+	e->valid = 1;
+}
+
 /* obtain a to-be-transmitted data (SACCH/SDCCH) burst */
 ubit_t *tx_data_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	enum trx_chan_type chan, uint8_t bid, uint16_t *nbits)
@@ -150,11 +200,12 @@ ubit_t *tx_data_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	uint8_t chan_nr = trx_chan_desc[chan].chan_nr | tn;
 	struct msgb *msg = NULL; /* make GCC happy */
 	ubit_t *burst, **bursts_p = &l1ts->chan_state[chan].dl_bursts;
-	static ubit_t bits[GSM_BURST_LEN];
+	static ubit_t _bits[GSM_BURST_LEN];
+	ubit_t *bits = tx_burst_buf(l1t, _bits);
 
 	/* send burst, if we already got a frame */
 	if (bid > 0) {
-		if (!*bursts_p)
+		if (!l1ts->chan_state[chan].dl_valid)
 			return NULL;
 		goto send_burst;
 	}
@@ -171,11 +222,8 @@ ubit_t *tx_data_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	LOGL1S(DL1P, LOGL_INFO, l1t, tn, chan, fn, "No prim for transmit.\n");
 
 no_msg:
-	/* free burst memory */
-	if (*bursts_p) {
-		talloc_free(*bursts_p);
-		*bursts_p = NULL;
-	}
+	/* nothing to send in the remaining bursts of this block */
+	l1ts->chan_state[chan].dl_valid = 0;
 	return NULL;
 
 got_msg:
@@ -184,7 +232,7 @@ got_msg:
 		LOGL1S(DL1P, LOGL_FATAL, l1t, tn, chan, fn, "Prim not 23 bytes, please FIX! "
 			"(len=%d)\n", msgb_l2len(msg));
 		/* free message */
-		msgb_free(msg);
+		l1sap_msgb_free(msg);
 		goto no_msg;
 	}
 
@@ -207,18 +255,15 @@ got_msg:
 		}
 	}
 
-	/* allocate burst memory, if not already */
-	if (!*bursts_p) {
-		*bursts_p = talloc_zero_size(tall_bts_ctx, 464);
-		if (!*bursts_p)
-			return NULL;
-	}
-
-	/* encode bursts */
-	gsm0503_xcch_encode(*bursts_p, msg->l2h);
+	/* encode bursts, BCCH, CCCH and SACCH blocks mostly repeat */
+	if (chan == TRXC_BCCH || chan == TRXC_CCCH || L1SAP_IS_LINK_SACCH(link_id))
+		tx_xcch_encode_cached(l1t, *bursts_p, msg->l2h);
+	else
+		gsm0503_xcch_encode(*bursts_p, msg->l2h);
+	l1ts->chan_state[chan].dl_valid = 1;
 
 	/* free message */
-	msgb_free(msg);
+	l1sap_msgb_free(msg);
 
 send_burst:
 	/* compose burst */
@@ -246,12 +291,13 @@ ubit_t *tx_pdtch_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	struct msgb *msg = NULL; /* make GCC happy */
 	ubit_t *burst, **bursts_p = &l1ts->chan_state[chan].dl_bursts;
 	enum trx_burst_type *burst_type = &l1ts->chan_state[chan].dl_burst_type;
-	static ubit_t bits[EGPRS_BURST_LEN];
+	static ubit_t _bits[EGPRS_BURST_LEN];
+	ubit_t *bits = tx_burst_buf(l1t, _bits);
 	int rc = 0;
 
 	/* send burst, if we already got a frame */
 	if (bid > 0) {
-		if (!*bursts_p)
+		if (!l1ts->chan_state[chan].dl_valid)
 			return NULL;
 		goto send_burst;
 	}
@@ -264,24 +310,13 @@ ubit_t *tx_pdtch_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	LOGL1S(DL1P, LOGL_INFO, l1t, tn, chan, fn, "No prim for transmit.\n");
 
 no_msg:
-	/* free burst memory */
-	if (*bursts_p) {
-		talloc_free(*bursts_p);
-		*bursts_p = NULL;
-	}
+	/* nothing to send in the remaining bursts of this block */
+	l1ts->chan_state[chan].dl_valid = 0;
 	return NULL;
 
 got_msg:
 	/* BURST BYPASS */
 
-	/* allocate burst memory, if not already */
-	if (!*bursts_p) {
-		*bursts_p = talloc_zero_size(tall_bts_ctx,
-					     GSM0503_EGPRS_BURSTS_NBITS);
-		if (!*bursts_p)
-			return NULL;
-	}
-
 	/* encode bursts */
 	rc = gsm0503_pdtch_egprs_encode(*bursts_p, msg->l2h, msg->tail - msg->l2h);
 	if (rc < 0)
@@ -292,16 +327,17 @@ got_msg:
 		LOGL1S(DL1P, LOGL_FATAL, l1t, tn, chan, fn, "Prim invalid length, please FIX! "
 			"(len=%ld)\n", msg->tail - msg->l2h);
 		/* free message */
-		msgb_free(msg);
+		l1sap_msgb_free(msg);
 		goto no_msg;
 	} else if (rc == GSM0503_EGPRS_BURSTS_NBITS) {
 		*burst_type = TRX_BURST_8PSK;
 	} else {
 		*burst_type = TRX_BURST_GMSK;
 	}
+	l1ts->chan_state[chan].dl_valid = 1;
 
 	/* free message */
-	msgb_free(msg);
+	l1sap_msgb_free(msg);
 
 send_burst:
 	/* compose burst */
@@ -407,7 +443,7 @@ inval_mode1:
 				if (l1sap->oph.primitive == PRIM_TCH) {
 					LOGL1S(DL1P, LOGL_FATAL, l1t, tn, chan, fn,
 						"TCH twice, please FIX!\n");
-					msgb_free(msg2);
+					l1sap_msgb_free(msg2);
 				} else
 					msg_facch = msg2;
 			}
@@ -418,7 +454,7 @@ inval_mode1:
 				if (l1sap->oph.primitive != PRIM_TCH) {
 					LOGL1S(DL1P, LOGL_FATAL, l1t, tn, chan, fn,
 						"FACCH twice, please FIX!\n");
-					msgb_free(msg2);
+					l1sap_msgb_free(msg2);
 				} else
 					msg_tch = msg2;
 			}
@@ -436,7 +472,7 @@ inval_mode1:
 		LOGL1S(DL1P, LOGL_FATAL, l1t, tn, chan, fn, "Prim not 23 bytes, please FIX! "
 			"(len=%d)\n", msgb_l2len(msg_facch));
 		/* free message */
-		msgb_free(msg_facch);
+		l1sap_msgb_free(msg_facch);
 		msg_facch = NULL;
 	}
 
@@ -519,7 +555,7 @@ inval_mode2:
 				len, msgb_l2len(msg_tch));
 free_bad_msg:
 			/* free message */
-			msgb_free(msg_tch);
+			l1sap_msgb_free(msg_tch);
 			msg_tch = NULL;
 			goto send_frame;
 		}
@@ -540,11 +576,12 @@ ubit_t *tx_tchf_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	struct l1sched_chan_state *chan_state = &l1ts->chan_state[chan];
 	uint8_t tch_mode = chan_state->tch_mode;
 	ubit_t *burst, **bursts_p = &chan_state->dl_bursts;
-	static ubit_t bits[GSM_BURST_LEN];
+	static ubit_t _bits[GSM_BURST_LEN];
+	ubit_t *bits = tx_burst_buf(l1t, _bits);
 
 	/* send burst, if we already got a frame */
 	if (bid > 0) {
-		if (!*bursts_p)
+		if (!chan_state->dl_valid)
 			return NULL;
 		goto send_burst;
 	}
@@ -553,16 +590,10 @@ ubit_t *tx_tchf_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 
 	/* BURST BYPASS */
 
-	/* allocate burst memory, if not already,
-	 * otherwise shift buffer by 4 bursts for interleaving */
-	if (!*bursts_p) {
-		*bursts_p = talloc_zero_size(tall_bts_ctx, 928);
-		if (!*bursts_p)
-			return NULL;
-	} else {
-		memcpy(*bursts_p, *bursts_p + 464, 464);
-		memset(*bursts_p + 464, 0, 464);
-	}
+	/* shift buffer by 4 bursts for interleaving */
+	memcpy(*bursts_p, *bursts_p + 464, 464);
+	memset(*bursts_p + 464, 0, 464);
+	chan_state->dl_valid = 1;
 
 	/* no message at all */
 	if (!msg_tch && !msg_facch) {
@@ -588,9 +619,9 @@ ubit_t *tx_tchf_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 
 	/* free message */
 	if (msg_tch)
-		msgb_free(msg_tch);
+		l1sap_msgb_free(msg_tch);
 	if (msg_facch)
-		msgb_free(msg_facch);
+		l1sap_msgb_free(msg_facch);
 
 send_burst:
 	/* compose burst */
@@ -619,11 +650,12 @@ ubit_t *tx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	struct l1sched_chan_state *chan_state = &l1ts->chan_state[chan];
 	uint8_t tch_mode = chan_state->tch_mode;
 	ubit_t *burst, **bursts_p = &chan_state->dl_bursts;
-	static ubit_t bits[GSM_BURST_LEN];
+	static ubit_t _bits[GSM_BURST_LEN];
+	ubit_t *bits = tx_burst_buf(l1t, _bits);
 
 	/* send burst, if we already got a frame */
 	if (bid > 0) {
-		if (!*bursts_p)
+		if (!chan_state->dl_valid)
 			return NULL;
 		goto send_burst;
 	}
@@ -635,27 +667,21 @@ ubit_t *tx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	if (msg_facch && ((((fn + 4) % 26) >> 2) & 1)) {
 		LOGL1S(DL1P, LOGL_ERROR, l1t, tn, chan, fn, "Cannot transmit FACCH starting on "
 			"even frames, please fix RTS!\n");
-		msgb_free(msg_facch);
+		l1sap_msgb_free(msg_facch);
 		msg_facch = NULL;
 	}
 
 	/* BURST BYPASS */
 
-	/* allocate burst memory, if not already,
-	 * otherwise shift buffer by 2 bursts for interleaving */
-	if (!*bursts_p) {
-		*bursts_p = talloc_zero_size(tall_bts_ctx, 696);
-		if (!*bursts_p)
-			return NULL;
+	/* shift buffer by 2 bursts for interleaving */
+	memcpy(*bursts_p, *bursts_p + 232, 232);
+	if (chan_state->dl_ongoing_facch) {
+		memcpy(*bursts_p + 232, *bursts_p + 464, 232);
+		memset(*bursts_p + 464, 0, 232);
 	} else {
-		memcpy(*bursts_p, *bursts_p + 232, 232);
-		if (chan_state->dl_ongoing_facch) {
-			memcpy(*bursts_p + 232, *bursts_p + 464, 232);
-			memset(*bursts_p + 464, 0, 232);
-		} else {
-			memset(*bursts_p + 232, 0, 232);
-		}
+		memset(*bursts_p + 232, 0, 232);
 	}
+	chan_state->dl_valid = 1;
 
 	/* no message at all */
 	if (!msg_tch && !msg_facch && !chan_state->dl_ongoing_facch) {
@@ -683,9 +709,9 @@ ubit_t *tx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 
 	/* free message */
 	if (msg_tch)
-		msgb_free(msg_tch);
+		l1sap_msgb_free(msg_tch);
 	if (msg_facch)
-		msgb_free(msg_facch);
+		l1sap_msgb_free(msg_facch);
 
 send_burst:
 	/* compose burst */
@@ -753,6 +779,61 @@ int rx_rach_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	return 0;
 }
 
+/* Uplink blocks are decoded through a job, either inline or, if the PHY
+ * link has 'osmotrx ul-decoder-threads' configured, in its decoder pool.
+ * The job_get / job_submit pair below hides the difference. */
+static struct trx_dec_pool *rx_dec_pool(struct l1sched_trx *l1t)
+{
+	struct phy_instance *pinst = trx_phy_instance(l1t->trx);
+
+	return pinst->phy_link->u.osmotrx.dec;
+}
+
+static struct trx_dec_job *rx_dec_job_get(struct trx_dec_pool *pool,
+					  struct trx_dec_job *local,
+					  sbit_t *bursts, int len)
+{
+	struct trx_dec_job *job;
+
+	if (!pool) {
+		local->bursts = bursts;
+		return local;
+	}
+
+	/* the ring is full, the caller drops the block */
+	job = trx_dec_job_get(pool);
+	if (!job)
+		return NULL;
+	memcpy(job->bursts_buf, bursts, len);
+	job->bursts = job->bursts_buf;
+	return job;
+}
+
+static int rx_dec_job_submit(struct trx_dec_pool *pool, struct trx_dec_job *job)
+{
+	if (pool) {
+		trx_dec_job_submit(pool, job);
+		return 0;
+	}
+
+	trx_dec_job_run(job);
+	return trx_dec_job_complete(job);
+}
+
+/* a burst of the block was missed in overload, see trx_sched_ul_burst().
+ * The block is indicated bad without decoding it: the result would hardly
+ * be usable, and the time is better spent on catching up. */
+static void rx_block_missed(struct l1sched_trx *l1t, uint8_t tn,
+			    enum trx_chan_type chan, uint32_t fn)
+{
+	struct gsm_bts *bts = l1t->trx->bts;
+
+	LOGL1S(DL1P, LOGL_DEBUG, l1t, tn, chan, fn, "Burst(s) missed in "
+		"overload, indicating bad block without decoding\n");
+	if (bts->ctrs)
+		rate_ctr_inc(&bts->ctrs->ctr[BTS_CTR_UL_BLOCK_MISSED]);
+}
+
 /*! \brief a single (SDCCH/SACCH) burst was received by the PHY, process it */
 int rx_data_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	enum trx_chan_type chan, uint8_t bid, sbit_t *bits, uint16_t nbits,
@@ -767,10 +848,8 @@ int rx_data_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	uint8_t *rssi_num = &chan_state->rssi_num;
 	int32_t *toa256_sum = &chan_state->toa256_sum;
 	uint8_t *toa_num = &chan_state->toa_num;
-	uint8_t l2[GSM_MACBLOCK_LEN], l2_len;
-	int n_errors, n_bits_total;
-	uint16_t ber10k;
-	int rc;
+	struct trx_dec_pool *pool = rx_dec_pool(l1t);
+	struct trx_dec_job local, *job;
 
 	/* handle RACH, if handover RACH detection is turned on */
 	if (chan_state->ho_rach_detect == 1)
@@ -778,17 +857,11 @@ int rx_data_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 
 	LOGL1S(DL1P, LOGL_DEBUG, l1t, tn, chan, fn, "Received Data, bid=%u\n", bid);
 
-	/* allocate burst memory, if not already */
-	if (!*bursts_p) {
-		*bursts_p = talloc_zero_size(tall_bts_ctx, 464);
-		if (!*bursts_p)
-			return -ENOMEM;
-	}
-
 	/* clear burst & store frame number of first burst */
 	if (bid == 0) {
 		memset(*bursts_p, 0, 464);
 		*mask = 0x0;
+		chan_state->ul_missed = 0;
 		*first_fn = fn;
 		*rssi_sum = 0;
 		*rssi_num = 0;
@@ -796,30 +869,40 @@ int rx_data_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 		*toa_num = 0;
 	}
 
-	/* update mask + RSSI */
-	*mask |= (1 << bid);
+	/* update RSSI, a missed burst counts with the values it was given */
 	*rssi_sum += rssi;
 	(*rssi_num)++;
 	*toa256_sum += toa256;
 	(*toa_num)++;
 
-	/* copy burst to buffer of 4 bursts */
-	burst = *bursts_p + bid * 116;
-	memcpy(burst, bits + 3, 58);
-	memcpy(burst + 58, bits + 87, 58);
+	if (!bits) {
+		chan_state->ul_missed = 1;
+	} else {
+		/* update mask */
+		*mask |= (1 << bid);
 
-	/* send burst information to loops process */
-	if (L1SAP_IS_LINK_SACCH(trx_chan_desc[chan].link_id)) {
-		trx_loop_sacch_input(l1t, trx_chan_desc[chan].chan_nr | tn,
-			chan_state, rssi, toa256);
+		/* copy burst to buffer of 4 bursts */
+		burst = *bursts_p + bid * 116;
+		memcpy(burst, bits + 3, 58);
+		memcpy(burst + 58, bits + 87, 58);
+
+		/* send burst information to loops process */
+		if (L1SAP_IS_LINK_SACCH(trx_chan_desc[chan].link_id)) {
+			trx_loop_sacch_input(l1t, trx_chan_desc[chan].chan_nr | tn,
+				chan_state, rssi, toa256);
+		}
 	}
 
 	/* wait until complete set of bursts */
 	if (bid != 3)
 		return 0;
 
-	/* check for complete set of bursts */
-	if ((*mask & 0xf) != 0xf) {
+	/* a burst was missed in overload: indicate the block as bad, even if
+	 * it is the first one, so that L2 and the measurements see the gap */
+	if (chan_state->ul_missed) {
+		rx_block_missed(l1t, tn, chan, fn);
+	} else if ((*mask & 0xf) != 0xf) {
+		/* check for complete set of bursts */
 		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, chan, fn, "Received incomplete data (%u/%u)\n",
 			*first_fn, (*first_fn) % l1ts->mf_period);
 
@@ -832,21 +915,54 @@ int rx_data_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	*mask = 0x0;
 
 	/* decode */
-	rc = gsm0503_xcch_decode(l2, *bursts_p, &n_errors, &n_bits_total);
-	if (rc) {
-		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, chan, fn, "Received bad data (%u/%u)\n",
-			*first_fn, (*first_fn) % l1ts->mf_period);
+	job = rx_dec_job_get(pool, &local, *bursts_p,
+			     chan_state->ul_missed ? 0 : 464);
+	if (!job) {
+		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, chan, fn, "Decoder queue full, dropping block\n");
+		chan_state->ul_missed = 0;
+		return 0;
+	}
+	job->skip = chan_state->ul_missed;
+	chan_state->ul_missed = 0;
+	job->type = TRX_DEC_XCCH;
+	job->l1t = l1t;
+	job->tn = tn;
+	job->chan = chan;
+	job->gen = chan_state->act_gen;
+	job->fn = fn;
+	job->first_fn = *first_fn;
+	job->rssi_sum = *rssi_sum;
+	job->rssi_num = *rssi_num;
+	job->toa256_sum = *toa256_sum;
+	job->toa_num = *toa_num;
+
+	return rx_dec_job_submit(pool, job);
+}
+
+static int rx_data_complete(struct trx_dec_job *job)
+{
+	struct l1sched_trx *l1t = job->l1t;
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, job->tn);
+	uint8_t tn = job->tn;
+	enum trx_chan_type chan = job->chan;
+	uint8_t l2_len;
+	uint16_t ber10k;
+
+	if (job->rc) {
+		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, chan, job->fn, "Received bad data (%u/%u)\n",
+			job->first_fn, job->first_fn % l1ts->mf_period);
 		l2_len = 0;
 	} else
 		l2_len = GSM_MACBLOCK_LEN;
 
 	/* Send uplink measurement information to L2 */
-	l1if_process_meas_res(l1t->trx, tn, *first_fn, trx_chan_desc[chan].chan_nr | tn,
-		n_errors, n_bits_total, *rssi_sum / *rssi_num, *toa256_sum / *toa_num);
-	ber10k = compute_ber10k(n_bits_total, n_errors);
-	return _sched_compose_ph_data_ind(l1t, tn, *first_fn, chan, l2, l2_len,
-					  *rssi_sum / *rssi_num,
-					  4 * (*toa256_sum) / *toa_num, 0, ber10k,
+	l1if_process_meas_res(l1t->trx, tn, job->first_fn, trx_chan_desc[chan].chan_nr | tn,
+		job->n_errors, job->n_bits_total, job->rssi_sum / job->rssi_num,
+		job->toa256_sum / job->toa_num);
+	ber10k = compute_ber10k(job->n_bits_total, job->n_errors);
+	return _sched_compose_ph_data_ind(l1t, tn, job->first_fn, chan, job->data, l2_len,
+					  job->rssi_sum / job->rssi_num,
+					  4 * job->toa256_sum / job->toa_num, 0, ber10k,
 					  PRES_INFO_UNKNOWN);
 }
 
@@ -864,25 +980,17 @@ int rx_pdtch_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	uint8_t *rssi_num = &chan_state->rssi_num;
 	int32_t *toa256_sum = &chan_state->toa256_sum;
 	uint8_t *toa_num = &chan_state->toa_num;
-	uint8_t l2[EGPRS_0503_MAX_BYTES];
-	int n_errors, n_bursts_bits, n_bits_total;
-	uint16_t ber10k;
-	int rc;
+	struct trx_dec_pool *pool = rx_dec_pool(l1t);
+	struct trx_dec_job local, *job;
+	int n_bursts_bits;
 
 	LOGL1S(DL1P, LOGL_DEBUG, l1t, tn, chan, fn, "Received PDTCH bid=%u\n", bid);
 
-	/* allocate burst memory, if not already */
-	if (!*bursts_p) {
-		*bursts_p = talloc_zero_size(tall_bts_ctx,
-					     GSM0503_EGPRS_BURSTS_NBITS);
-		if (!*bursts_p)
-			return -ENOMEM;
-	}
-
 	/* clear burst */
 	if (bid == 0) {
 		memset(*bursts_p, 0, GSM0503_EGPRS_BURSTS_NBITS);
 		*mask = 0x0;
+		chan_state->ul_missed = 0;
 		*first_fn = fn;
 		*rssi_sum = 0;
 		*rssi_num = 0;
@@ -890,20 +998,24 @@ int rx_pdtch_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 		*toa_num = 0;
 	}
 
-	/* update mask + rssi */
-	*mask |= (1 << bid);
+	/* update rssi */
 	*rssi_sum += rssi;
 	(*rssi_num)++;
 	*toa256_sum += toa256;
 	(*toa_num)++;
 
 	/* copy burst to buffer of 4 bursts */
-	if (nbits == EGPRS_BURST_LEN) {
+	if (!bits) {
+		chan_state->ul_missed = 1;
+		n_bursts_bits = 0;
+	} else if (nbits == EGPRS_BURST_LEN) {
+		*mask |= (1 << bid);
 		burst = *bursts_p + bid * 348;
 		memcpy(burst, bits + 9, 174);
 		memcpy(burst + 174, bits + 261, 174);
 		n_bursts_bits = GSM0503_EGPRS_BURSTS_NBITS;
 	} else {
+		*mask |= (1 << bid);
 		burst = *bursts_p + bid * 116;
 		memcpy(burst, bits + 3, 58);
 		memcpy(burst + 58, bits + 87, 58);
@@ -915,40 +1027,62 @@ int rx_pdtch_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 		return 0;
 
 	/* check for complete set of bursts */
-	if ((*mask & 0xf) != 0xf) {
+	if (chan_state->ul_missed) {
+		rx_block_missed(l1t, tn, chan, fn);
+		n_bursts_bits = 0;
+	} else if ((*mask & 0xf) != 0xf) {
 		LOGL1S(DL1P, LOGL_DEBUG, l1t, tn, chan, fn, "Received incomplete frame (%u/%u)\n",
 			fn % l1ts->mf_period, l1ts->mf_period);
 	}
 	*mask = 0x0;
 
-	/*
-	 * Attempt to decode EGPRS bursts first. For 8-PSK EGPRS this is all we
-	 * do. Attempt GPRS decoding on EGPRS failure. If the burst is GPRS,
-	 * then we incur decoding overhead of 31 bits on the Type 3 EGPRS
-	 * header, which is tolerable.
-	 */
-	rc = gsm0503_pdtch_egprs_decode(l2, *bursts_p, n_bursts_bits,
-				NULL, &n_errors, &n_bits_total);
-
-	if ((nbits == GSM_BURST_LEN) && (rc < 0)) {
-		rc = gsm0503_pdtch_decode(l2, *bursts_p, NULL,
-				  &n_errors, &n_bits_total);
+	job = rx_dec_job_get(pool, &local, *bursts_p, n_bursts_bits);
+	if (!job) {
+		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, chan, fn, "Decoder queue full, dropping block\n");
+		chan_state->ul_missed = 0;
+		return 0;
 	}
+	job->skip = chan_state->ul_missed;
+	chan_state->ul_missed = 0;
+	job->type = TRX_DEC_PDTCH;
+	job->l1t = l1t;
+	job->tn = tn;
+	job->chan = chan;
+	job->gen = chan_state->act_gen;
+	job->fn = fn;
+	job->first_fn = *first_fn;
+	job->rssi_sum = *rssi_sum;
+	job->rssi_num = *rssi_num;
+	job->toa256_sum = *toa256_sum;
+	job->toa_num = *toa_num;
+	job->nbits = nbits;
+
+	return rx_dec_job_submit(pool, job);
+}
 
+static int rx_pdtch_complete(struct trx_dec_job *job)
+{
+	struct l1sched_trx *l1t = job->l1t;
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, job->tn);
+	uint8_t tn = job->tn;
+	enum trx_chan_type chan = job->chan;
+	uint32_t fn = job->fn;
+	uint16_t ber10k;
 
 	/* Send uplink measurement information to L2 */
-	l1if_process_meas_res(l1t->trx, tn, *first_fn, trx_chan_desc[chan].chan_nr | tn,
-		n_errors, n_bits_total, *rssi_sum / *rssi_num, *toa256_sum / *toa_num);
+	l1if_process_meas_res(l1t->trx, tn, job->first_fn, trx_chan_desc[chan].chan_nr | tn,
+		job->n_errors, job->n_bits_total, job->rssi_sum / job->rssi_num,
+		job->toa256_sum / job->toa_num);
 
-	if (rc <= 0) {
+	if (job->rc <= 0) {
 		LOGL1S(DL1P, LOGL_DEBUG, l1t, tn, chan, fn, "Received bad PDTCH (%u/%u)\n",
 			fn % l1ts->mf_period, l1ts->mf_period);
 		return 0;
 	}
-	ber10k = compute_ber10k(n_bits_total, n_errors);
+	ber10k = compute_ber10k(job->n_bits_total, job->n_errors);
 	return _sched_compose_ph_data_ind(l1t, tn, (fn + GSM_HYPERFRAME - 3) % GSM_HYPERFRAME, chan,
-		l2, rc, *rssi_sum / *rssi_num, 4 * (*toa256_sum) / *toa_num, 0,
-					  ber10k, PRES_INFO_BOTH);
+		job->data, job->rc, job->rssi_sum / job->rssi_num,
+		4 * job->toa256_sum / job->toa_num, 0, ber10k, PRES_INFO_BOTH);
 }
 
 /*! \brief a single TCH/F burst was received by the PHY, process it */
@@ -958,17 +1092,11 @@ int rx_tchf_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 {
 	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
 	struct l1sched_chan_state *chan_state = &l1ts->chan_state[chan];
-	sbit_t *burst, **bursts_p = &chan_state->ul_bursts;
+	sbit_t *bursts;
 	uint32_t *first_fn = &chan_state->ul_first_fn;
 	uint8_t *mask = &chan_state->ul_mask;
-	uint8_t rsl_cmode = chan_state->rsl_cmode;
-	uint8_t tch_mode = chan_state->tch_mode;
-	uint8_t tch_data[128]; /* just to be safe */
-	int rc, amr = 0;
-	int n_errors, n_bits_total;
-	bool bfi_flag = false;
-	struct gsm_lchan *lchan =
-		get_lchan_by_chan_nr(l1t->trx, trx_chan_desc[chan].chan_nr | tn);
+	struct trx_dec_pool *pool = rx_dec_pool(l1t);
+	struct trx_dec_job local, *job;
 
 	/* handle rach, if handover rach detection is turned on */
 	if (chan_state->ho_rach_detect == 1)
@@ -976,61 +1104,104 @@ int rx_tchf_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 
 	LOGL1S(DL1P, LOGL_DEBUG, l1t, tn, chan, fn, "Received TCH/F, bid=%u\n", bid);
 
-	/* allocate burst memory, if not already */
-	if (!*bursts_p) {
-		*bursts_p = talloc_zero_size(tall_bts_ctx, 928);
-		if (!*bursts_p)
-			return -ENOMEM;
-	}
-
-	/* clear burst */
+	/* first burst of a block */
 	if (bid == 0) {
-		memset(*bursts_p + 464, 0, 464);
 		*mask = 0x0;
+		chan_state->ul_missed = 0;
 		*first_fn = fn;
 	}
 
-	/* update mask */
-	*mask |= (1 << bid);
-
-	/* copy burst to end of buffer of 8 bursts */
-	burst = *bursts_p + bid * 116 + 464;
-	memcpy(burst, bits + 3, 58);
-	memcpy(burst + 58, bits + 87, 58);
+	/* store burst in the de-interleaving ring, a missed one is cleared
+	 * as an erasure when the block is complete */
+	if (!bits) {
+		chan_state->ul_missed = 1;
+	} else {
+		*mask |= (1 << bid);
+		_sched_ul_ring_burst(chan_state, chan, bid, bits);
+	}
 
 	/* wait until complete set of bursts */
 	if (bid != 3)
 		return 0;
 
 	/* check for complete set of bursts */
-	if ((*mask & 0xf) != 0xf) {
+	if (chan_state->ul_missed) {
+		rx_block_missed(l1t, tn, chan, fn);
+	} else if ((*mask & 0xf) != 0xf) {
 		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, chan, fn, "Received incomplete frame (%u/%u)\n",
 			fn % l1ts->mf_period, l1ts->mf_period);
 	}
+	bursts = _sched_ul_ring_block(chan_state, chan);
 	*mask = 0x0;
 
-	/* decode
-	 * also shift buffer by 4 bursts for interleaving */
+	job = rx_dec_job_get(pool, &local, bursts,
+			     chan_state->ul_missed ? 0 : 928);
+	if (!job) {
+		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, chan, fn, "Decoder queue full, dropping block\n");
+		chan_state->ul_missed = 0;
+		return 0;
+	}
+	job->skip = chan_state->ul_missed;
+	chan_state->ul_missed = 0;
+	job->type = TRX_DEC_TCHF;
+	job->l1t = l1t;
+	job->tn = tn;
+	job->chan = chan;
+	job->gen = chan_state->act_gen;
+	job->fn = fn;
+	job->first_fn = *first_fn;
+	job->rssi = rssi;
+	job->toa256 = toa256;
+	job->rsl_cmode = chan_state->rsl_cmode;
+	job->tch_mode = chan_state->tch_mode;
+	/* the first FN 0,8,17 defines that CMI is included in frame,
+	 * the first FN 4,13,21 defines that CMR is included in frame.
+	 * NOTE: A frame ends 7 FN after start.
+	 */
+	job->amr_cmi = (((fn + 26 - 7) % 26) >> 2) & 1;
+	memcpy(job->codec, chan_state->codec, sizeof(job->codec));
+	job->codecs = chan_state->codecs;
+	job->ul_ft = chan_state->ul_ft;
+	job->ul_cmr = chan_state->ul_cmr;
+	/* the AMR codec mode of this frame depends on the previous one,
+	 * which may still be in the decoder pool */
+	job->amr_chain = job->rsl_cmode == RSL_CMOD_SPD_SPEECH
+		      && job->tch_mode == GSM48_CMODE_SPEECH_AMR;
+
+	return rx_dec_job_submit(pool, job);
+}
+
+static int rx_tchf_complete(struct trx_dec_job *job)
+{
+	struct l1sched_trx *l1t = job->l1t;
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, job->tn);
+	uint8_t tn = job->tn;
+	enum trx_chan_type chan = job->chan;
+	uint32_t fn = job->fn;
+	struct l1sched_chan_state *chan_state = &l1ts->chan_state[chan];
+	uint8_t rsl_cmode = job->rsl_cmode;
+	uint8_t tch_mode = job->tch_mode;
+	uint8_t *tch_data = job->data;
+	int8_t rssi = job->rssi;
+	int16_t toa256 = job->toa256;
+	int n_errors = job->n_errors, n_bits_total = job->n_bits_total;
+	int rc = job->rc, amr = 0;
+	bool bfi_flag = false;
+	struct gsm_lchan *lchan =
+		get_lchan_by_chan_nr(l1t->trx, trx_chan_desc[chan].chan_nr | tn);
+
 	switch ((rsl_cmode != RSL_CMOD_SPD_SPEECH) ? GSM48_CMODE_SPEECH_V1
 								: tch_mode) {
 	case GSM48_CMODE_SPEECH_V1: /* FR */
-		rc = gsm0503_tch_fr_decode(tch_data, *bursts_p, 1, 0, &n_errors, &n_bits_total);
 		if (rc >= 0)
 			lchan_set_marker(osmo_fr_check_sid(tch_data, rc), lchan); /* DTXu */
 		break;
 	case GSM48_CMODE_SPEECH_EFR: /* EFR */
-		rc = gsm0503_tch_fr_decode(tch_data, *bursts_p, 1, 1, &n_errors, &n_bits_total);
 		break;
 	case GSM48_CMODE_SPEECH_AMR: /* AMR */
-		/* the first FN 0,8,17 defines that CMI is included in frame,
-		 * the first FN 4,13,21 defines that CMR is included in frame.
-		 * NOTE: A frame ends 7 FN after start.
-		 */
-		rc = gsm0503_tch_afs_decode(tch_data + 2, *bursts_p,
-			(((fn + 26 - 7) % 26) >> 2) & 1, chan_state->codec,
-			chan_state->codecs, &chan_state->ul_ft,
-			&chan_state->ul_cmr, &n_errors, &n_bits_total);
-		if (rc)
+		chan_state->ul_ft = job->ul_ft;
+		chan_state->ul_cmr = job->ul_cmr;
+		if (rc && n_bits_total)
 			trx_loop_amr_input(l1t,
 				trx_chan_desc[chan].chan_nr | tn, chan_state,
 				(float)n_errors/(float)n_bits_total);
@@ -1047,10 +1218,9 @@ int rx_tchf_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 			tch_mode);
 		return -EINVAL;
 	}
-	memcpy(*bursts_p, *bursts_p + 464, 464);
 
 	/* Send uplink measurement information to L2 */
-	l1if_process_meas_res(l1t->trx, tn, *first_fn, trx_chan_desc[chan].chan_nr|tn,
+	l1if_process_meas_res(l1t->trx, tn, job->first_fn, trx_chan_desc[chan].chan_nr|tn,
 		n_errors, n_bits_total, rssi, toa256);
 
 	/* Check if the frame is bad */
@@ -1128,6 +1298,89 @@ compose_l1sap:
 		tch_data, rc);
 }
 
+/*! decode a complete set of bursts; runs on a decoder thread if the pool
+ *  is in use, so it must not touch anything but the job itself */
+void trx_dec_job_run(struct trx_dec_job *job)
+{
+	int n_bursts_bits;
+
+	/* a burst was missed in overload, indicate a bad block */
+	if (job->skip) {
+		job->rc = -1;
+		job->n_errors = 0;
+		job->n_bits_total = 0;
+		return;
+	}
+
+	switch (job->type) {
+	case TRX_DEC_XCCH:
+		job->rc = gsm0503_xcch_decode(job->data, job->bursts,
+					      &job->n_errors, &job->n_bits_total);
+		break;
+	case TRX_DEC_PDTCH:
+		/*
+		 * Attempt to decode EGPRS bursts first. For 8-PSK EGPRS this is all we
+		 * do. Attempt GPRS decoding on EGPRS failure. If the burst is GPRS,
+		 * then we incur decoding overhead of 31 bits on the Type 3 EGPRS
+		 * header, which is tolerable.
+		 */
+		n_bursts_bits = job->nbits == EGPRS_BURST_LEN ?
+			GSM0503_EGPRS_BURSTS_NBITS : GSM0503_GPRS_BURSTS_NBITS;
+		job->rc = gsm0503_pdtch_egprs_decode(job->data, job->bursts, n_bursts_bits,
+					NULL, &job->n_errors, &job->n_bits_total);
+
+		if ((job->nbits == GSM_BURST_LEN) && (job->rc < 0)) {
+			job->rc = gsm0503_pdtch_decode(job->data, job->bursts, NULL,
+					  &job->n_errors, &job->n_bits_total);
+		}
+		break;
+	case TRX_DEC_TCHF:
+		switch ((job->rsl_cmode != RSL_CMOD_SPD_SPEECH) ? GSM48_CMODE_SPEECH_V1
+								: job->tch_mode) {
+		case GSM48_CMODE_SPEECH_V1: /* FR */
+			job->rc = gsm0503_tch_fr_decode(job->data, job->bursts, 1, 0,
+					&job->n_errors, &job->n_bits_total);
+			break;
+		case GSM48_CMODE_SPEECH_EFR: /* EFR */
+			job->rc = gsm0503_tch_fr_decode(job->data, job->bursts, 1, 1,
+					&job->n_errors, &job->n_bits_total);
+			break;
+		case GSM48_CMODE_SPEECH_AMR: /* AMR */
+			job->rc = gsm0503_tch_afs_decode(job->data + 2, job->bursts,
+				job->amr_cmi, job->codec, job->codecs, &job->ul_ft,
+				&job->ul_cmr, &job->n_errors, &job->n_bits_total);
+			break;
+		default:
+			/* reported on completion */
+			job->rc = -EINVAL;
+		}
+		break;
+	}
+}
+
+/*! hand the result of a decoded block to L2; on the main thread */
+int trx_dec_job_complete(struct trx_dec_job *job)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(job->l1t, job->tn);
+
+	/* the channel was released (and maybe activated again) while the
+	 * block was being decoded */
+	if (!l1ts->chan_state[job->chan].active
+	 || l1ts->chan_state[job->chan].act_gen != job->gen)
+		return 0;
+
+	switch (job->type) {
+	case TRX_DEC_XCCH:
+		return rx_data_complete(job);
+	case TRX_DEC_PDTCH:
+		return rx_pdtch_complete(job);
+	case TRX_DEC_TCHF:
+		return rx_tchf_complete(job);
+	}
+
+	return -EINVAL;
+}
+
 /*! \brief a single TCH/H burst was received by the PHY, process it */
 int rx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	enum trx_chan_type chan, uint8_t bid, sbit_t *bits, uint16_t nbits,
@@ -1135,7 +1388,7 @@ int rx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 {
 	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
 	struct l1sched_chan_state *chan_state = &l1ts->chan_state[chan];
-	sbit_t *burst, **bursts_p = &chan_state->ul_bursts;
+	sbit_t *bursts;
 	uint32_t *first_fn = &chan_state->ul_first_fn;
 	uint8_t *mask = &chan_state->ul_mask;
 	uint8_t rsl_cmode = chan_state->rsl_cmode;
@@ -1157,49 +1410,51 @@ int rx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 
 	LOGL1S(DL1P, LOGL_DEBUG, l1t, tn, chan, fn, "Received TCH/H, bid=%u\n", bid);
 
-	/* allocate burst memory, if not already */
-	if (!*bursts_p) {
-		*bursts_p = talloc_zero_size(tall_bts_ctx, 696);
-		if (!*bursts_p)
-			return -ENOMEM;
-	}
-
-	/* clear burst */
+	/* first burst of a block */
 	if (bid == 0) {
-		memset(*bursts_p + 464, 0, 232);
 		*mask = 0x0;
+		chan_state->ul_missed = 0;
 		*first_fn = fn;
 	}
 
-	/* update mask */
-	*mask |= (1 << bid);
-
-	/* copy burst to end of buffer of 6 bursts */
-	burst = *bursts_p + bid * 116 + 464;
-	memcpy(burst, bits + 3, 58);
-	memcpy(burst + 58, bits + 87, 58);
+	/* store burst in the de-interleaving ring, a missed one is cleared
+	 * as an erasure when the block is complete */
+	if (!bits) {
+		chan_state->ul_missed = 1;
+	} else {
+		*mask |= (1 << bid);
+		_sched_ul_ring_burst(chan_state, chan, bid, bits);
+	}
 
 	/* wait until complete set of bursts */
 	if (bid != 1)
 		return 0;
 
 	/* check for complete set of bursts */
-	if ((*mask & 0x3) != 0x3) {
+	if (!chan_state->ul_missed && (*mask & 0x3) != 0x3) {
 		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, chan, fn, "Received incomplete frame (%u/%u)\n",
 			fn % l1ts->mf_period, l1ts->mf_period);
 	}
+	bursts = _sched_ul_ring_block(chan_state, chan);
 	*mask = 0x0;
 
 	/* skip second of two TCH frames of FACCH was received */
 	if (chan_state->ul_ongoing_facch) {
 		chan_state->ul_ongoing_facch = 0;
-		memcpy(*bursts_p, *bursts_p + 232, 232);
-		memcpy(*bursts_p + 232, *bursts_p + 464, 232);
+		chan_state->ul_missed = 0;
 		goto bfi;
 	}
 
-	/* decode
-	 * also shift buffer by 4 bursts for interleaving */
+	/* a burst was missed in overload, indicate a bad frame */
+	if (chan_state->ul_missed) {
+		chan_state->ul_missed = 0;
+		rx_block_missed(l1t, tn, chan, fn);
+		l1if_process_meas_res(l1t->trx, tn, *first_fn,
+			trx_chan_desc[chan].chan_nr | tn, 0, 0, rssi, toa256);
+		goto bfi;
+	}
+
+	/* decode */
 	switch ((rsl_cmode != RSL_CMOD_SPD_SPEECH) ? GSM48_CMODE_SPEECH_V1
 								: tch_mode) {
 	case GSM48_CMODE_SPEECH_V1: /* HR or signalling */
@@ -1207,7 +1462,7 @@ int rx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 		 * TCH/FACCH frame, because our burst buffer carries 6 bursts.
 		 * Even FN ending at: 10,11,19,20,2,3
 		 */
-		rc = gsm0503_tch_hr_decode(tch_data, *bursts_p,
+		rc = gsm0503_tch_hr_decode(tch_data, bursts,
 			fn_is_odd, &n_errors, &n_bits_total);
 		if (rc) /* DTXu */
 			lchan_set_marker(osmo_hr_check_sid(tch_data, rc), lchan);
@@ -1217,11 +1472,11 @@ int rx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 		 * in frame, the first FN 4,13,21 or 5,14,22 defines that CMR
 		 * is included in frame.
 		 */
-		rc = gsm0503_tch_ahs_decode(tch_data + 2, *bursts_p,
+		rc = gsm0503_tch_ahs_decode(tch_data + 2, bursts,
 			fn_is_odd, fn_is_odd, chan_state->codec,
 			chan_state->codecs, &chan_state->ul_ft,
 			&chan_state->ul_cmr, &n_errors, &n_bits_total);
-		if (rc)
+		if (rc && n_bits_total)
 			trx_loop_amr_input(l1t,
 				trx_chan_desc[chan].chan_nr | tn, chan_state,
 				(float)n_errors/(float)n_bits_total);
@@ -1238,8 +1493,6 @@ int rx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 			tch_mode);
 		return -EINVAL;
 	}
-	memcpy(*bursts_p, *bursts_p + 232, 232);
-	memcpy(*bursts_p + 232, *bursts_p + 464, 232);
 
 	/* Send uplink measurement information to L2 */
 	l1if_process_meas_res(l1t->trx, tn, *first_fn, trx_chan_desc[chan].chan_nr|tn,
@@ -1311,50 +1564,80 @@ compose_l1sap:
 		chan, tch_data, rc);
 }
 
-/* schedule all frames of all TRX for given FN */
-static int trx_sched_fn(struct gsm_bts *bts, uint32_t fn)
+static void trx_adv_frames(struct phy_link *plink, uint32_t fn,
+			   unsigned int *n_dl, unsigned int *n_rts);
+
+/* schedule all frames of all TRX of a PHY link for given FN */
+int trx_sched_fn(struct phy_link *plink, uint32_t fn)
 {
-	struct gsm_bts_trx *trx;
+	struct phy_instance *pinst;
 	uint8_t tn;
 	const ubit_t *bits;
 	uint8_t gain;
 	uint16_t nbits = 0;
+	uint32_t rts_fn, dl_fn;
+	unsigned int n_dl, n_rts, i;
+
+	/* send time indication, if we drive the BCCH carrier */
+	llist_for_each_entry(pinst, &plink->instances, list) {
+		if (pinst->trx && pinst->trx == pinst->trx->bts->c0)
+			l1if_mph_time_ind(pinst->trx->bts, fn);
+	}
 
-	/* send time indication */
-	l1if_mph_time_ind(bts, fn);
+	/* how many frames to request and compose: one, unless the advances
+	 * are being tuned */
+	trx_adv_frames(plink, fn, &n_dl, &n_rts);
+
+	/* advance frame number, so the transceiver has more
+	 * time until it must be transmitted. */
+	fn = (fn + plink->u.osmotrx.clock_advance) % GSM_HYPERFRAME;
+	rts_fn = (fn + plink->u.osmotrx.rts_advance) % GSM_HYPERFRAME;
 
 	/* process every TRX */
-	llist_for_each_entry(trx, &bts->trx_list, list) {
-		struct phy_instance *pinst = trx_phy_instance(trx);
-		struct phy_link *plink = pinst->phy_link;
+	llist_for_each_entry(pinst, &plink->instances, list) {
 		struct trx_l1h *l1h = pinst->u.osmotrx.hdl;
 		struct l1sched_trx *l1t = &l1h->l1s;
 
-		/* advance frame number, so the transceiver has more
-		 * time until it must be transmitted. */
-		fn = (fn + plink->u.osmotrx.clock_advance) % GSM_HYPERFRAME;
+		if (!pinst->trx)
+			continue;
 
 		/* we don't schedule, if power is off */
 		if (!trx_if_powered(l1h))
 			continue;
 
+		l1t->dl_fn = fn;
+		l1t->dl_fn_valid = 1;
+
 		/* process every TS of TRX */
 		for (tn = 0; tn < ARRAY_SIZE(l1t->ts); tn++) {
 			/* ready-to-send */
-			_sched_rts(l1t, tn,
-				(fn + plink->u.osmotrx.rts_advance) % GSM_HYPERFRAME);
-			/* get burst for FN */
-			bits = _sched_dl_burst(l1t, tn, fn, &nbits);
-			if (!bits) {
-				/* if no bits, send no burst */
-				continue;
-			} else
-				gain = 0;
-			if (nbits)
-				trx_if_send_burst(l1h, tn, fn, gain, bits, nbits);
+			for (i = n_rts; i > 0; i--)
+				_sched_rts(l1t, tn, (rts_fn + GSM_HYPERFRAME + 1 - i)
+						% GSM_HYPERFRAME);
+			for (i = n_dl; i > 0; i--) {
+				dl_fn = (fn + GSM_HYPERFRAME + 1 - i) % GSM_HYPERFRAME;
+				/* get burst for FN, composed in the TRXD datagram
+				 * which is going to carry it, if possible */
+				l1t->dl_burst_out = trx_if_burst_buf(l1h);
+				bits = _sched_dl_burst(l1t, tn, dl_fn, &nbits);
+				l1t->dl_burst_out = NULL;
+				if (!bits) {
+					/* if no bits, send no burst */
+					continue;
+				} else
+					gain = 0;
+				if (nbits)
+					trx_if_send_burst(l1h, tn, dl_fn, gain, bits, nbits);
+			}
 		}
 	}
 
+	/* send the bursts of this frame, if they were batched */
+	llist_for_each_entry(pinst, &plink->instances, list) {
+		if (pinst->trx)
+			trx_if_send_burst_flush(pinst->u.osmotrx.hdl);
+	}
+
 	return 0;
 }
 
@@ -1375,9 +1658,14 @@ static int trx_sched_fn(struct gsm_bts *bts, uint32_t fn)
  * accordingly: If we were transmitting too fast, we're delaying the
  * next interval timer accordingly.  If we were too slow, we immediately
  * send burst data for the missing frame numbers.
+ *
+ * To make these corrections the exception rather than the rule, the
+ * interval of the timer is continuously retuned by a PI loop from the
+ * phase error observed at each clock indication, so that our frame
+ * period follows the TRX/SDR clock (see trx_clock_disc_update()).
  */
 
-/*! clock state of a given TRX */
+/*! clock state of a given PHY link */
 struct osmo_trx_clock_state {
 	/*! number of FN periods without TRX clock indication */
 	uint32_t fn_without_clock_ind;
@@ -1395,11 +1683,12 @@ struct osmo_trx_clock_state {
 	} last_clk_ind;
 	/*! Osmocom FD wrapper for timerfd */
 	struct osmo_fd fn_timer_ofd;
+	/*! PI loop retuning the interval of fn_timer_ofd */
+	struct trx_clock_disc disc;
+	/*! auto-tuning of clock_advance and rts_advance */
+	struct trx_adv_tune adv;
 };
 
-/* TODO: This must go and become part of the phy_link */
-static struct osmo_trx_clock_state g_clk_s = { .fn_timer_ofd.fd = -1 };
-
 /*! duration of a GSM frame in nano-seconds. (120ms/26) */
 #define FRAME_DURATION_nS	4615384
 /*! duration of a GSM frame in micro-seconds (120s/26) */
@@ -1408,6 +1697,23 @@ static struct osmo_trx_clock_state g_clk_s = { .fn_timer_ofd.fd = -1 };
 #define MAX_FN_SKEW		50
 /*! maximum number of frame periods we can tolerate without TRX Clock Indication*/
 #define TRX_LOSS_FRAMES		400
+/*! maximum frequency correction applied by the clock discipline (ppm) */
+#define CLOCK_DISC_MAX_PPM	100
+/*! proportional and integral gain of the clock discipline, applied to the
+ *  per-frame phase error; the loop settles within ~20 clock indications */
+#define CLOCK_DISC_KP		0.5
+#define CLOCK_DISC_KI		0.0625
+/*! phase the clock discipline aims for: our FN timer fires half a frame
+ *  before the TRX reports the same FN, leaving maximum margin for the
+ *  jitter of the clock indications in both directions */
+#define CLOCK_DISC_PHASE_uS	(-FRAME_DURATION_uS / 2)
+/*! frames of a measurement window of the advance tuning (~1s) */
+#define TRX_ADV_WINDOW		216
+/*! windows in a row with room to spare before an advance is lowered */
+#define TRX_ADV_QUIET		10
+/*! frames kept between the largest lag of composing a frame and the clock
+ *  advance, and the least slack of a downlink prim */
+#define TRX_ADV_GUARD		2
 
 /*! compute the number of micro-seconds difference elapsed between \a last and \a now */
 static inline int64_t compute_elapsed_us(const struct timespec *last, const struct timespec *now)
@@ -1496,6 +1802,257 @@ static int timer_ofd_setup(struct osmo_fd *ofd, int (*cb)(struct osmo_fd *, unsi
 	return 0;
 }
 
+/*! reset the clock discipline to the nominal frame duration */
+static void trx_clock_disc_reset(struct trx_clock_disc *disc)
+{
+	memset(disc, 0, sizeof(*disc));
+	disc->interval_ns = FRAME_DURATION_nS;
+}
+
+/*! feed the phase error observed at a clock indication into the PI loop
+ *  \param[inout] disc clock discipline state
+ *  \param[in] phase_us how much our FN timer lags behind its target phase (us)
+ *  \param[in] elapsed_fn number of frames since the previous update
+ *  \returns FN timer interval to be used from now on (ns) */
+static int64_t trx_clock_disc_update(struct trx_clock_disc *disc, int64_t phase_us,
+				     int64_t elapsed_fn)
+{
+	const double max_ns = (double)FRAME_DURATION_nS * CLOCK_DISC_MAX_PPM / 1000000;
+	double phase_ns_per_fn, corr_ns;
+
+	if (elapsed_fn <= 0)
+		return disc->interval_ns;
+
+	/* phase error spread over the frames until the next clock indication */
+	phase_ns_per_fn = (double)phase_us * 1000 / elapsed_fn;
+
+	disc->freq_ns += phase_ns_per_fn * CLOCK_DISC_KI;
+	if (disc->freq_ns > max_ns)
+		disc->freq_ns = max_ns;
+	else if (disc->freq_ns < -max_ns)
+		disc->freq_ns = -max_ns;
+
+	corr_ns = disc->freq_ns + phase_ns_per_fn * CLOCK_DISC_KP;
+	if (corr_ns > max_ns)
+		corr_ns = max_ns;
+	else if (corr_ns < -max_ns)
+		corr_ns = -max_ns;
+
+	/* lagging behind means our frames are too long */
+	disc->interval_ns = FRAME_DURATION_nS - (int64_t)corr_ns;
+	disc->ppm = disc->freq_ns * 1000000 / FRAME_DURATION_nS;
+	disc->jitter_us += ((phase_us < 0 ? -phase_us : phase_us) - disc->jitter_us) / 8;
+	disc->updates++;
+
+	return disc->interval_ns;
+}
+
+/*! apply a new interval to the running FN timer without moving its next
+ *  expiration, so that the phase is only corrected gradually */
+static void trx_clock_disc_apply(struct osmo_trx_clock_state *tcs)
+{
+	const struct timespec interval = { .tv_sec = 0, .tv_nsec = tcs->disc.interval_ns };
+	struct itimerspec its;
+
+	if (tcs->fn_timer_ofd.fd < 0 || timerfd_gettime(tcs->fn_timer_ofd.fd, &its) < 0)
+		return;
+	/* timer is disarmed */
+	if (!its.it_value.tv_sec && !its.it_value.tv_nsec)
+		return;
+
+	timer_ofd_schedule(&tcs->fn_timer_ofd, &its.it_value, &interval);
+}
+
+/*
+ * Auto-tuning of clock_advance and rts_advance
+ *
+ * Every frame, we measure how long after its FN timer expiration the
+ * frame was composed.  A lag beyond clock_advance means the bursts went
+ * out too late for the transceiver, so the clock advance is raised at
+ * once.  At the end of each window it is raised to the largest lag seen
+ * plus TRX_ADV_GUARD, and lowered by one frame after TRX_ADV_QUIET
+ * windows in a row with more room than that.
+ *
+ * The rts_advance follows the least slack of the downlink prims of the
+ * window (see sched_enqueue_prim()): late prims raise it, so they would
+ * have arrived TRX_ADV_GUARD frames early, while more slack than that
+ * for TRX_ADV_QUIET windows lowers it by one frame.
+ *
+ * Advances are moved one frame at a time, by requesting and composing
+ * two frames at once, or none, so no frame is skipped or sent twice.
+ */
+
+static uint32_t trx_adv_clamp(uint32_t val, uint32_t min, uint32_t max)
+{
+	if (val < min)
+		return min;
+	if (val > max)
+		return max;
+	return val;
+}
+
+static void trx_adv_set_fn(struct phy_link *plink, struct trx_adv_tune *adv,
+			   uint32_t target, const char *reason)
+{
+	target = trx_adv_clamp(target, plink->u.osmotrx.clock_advance_min,
+			       plink->u.osmotrx.clock_advance_max);
+	if (target == adv->clock_advance_target)
+		return;
+	LOGP(DL1C, LOGL_NOTICE, "PHY %d: %s fn-advance from %u to %u, %s\n",
+		plink->num, target > adv->clock_advance_target ? "Raising" : "Lowering",
+		adv->clock_advance_target, target, reason);
+	if (target > adv->clock_advance_target)
+		adv->raised++;
+	else
+		adv->lowered++;
+	adv->clock_advance_target = target;
+}
+
+static void trx_adv_set_rts(struct phy_link *plink, struct trx_adv_tune *adv,
+			    uint32_t target, const char *reason)
+{
+	target = trx_adv_clamp(target, plink->u.osmotrx.rts_advance_min,
+			       plink->u.osmotrx.rts_advance_max);
+	if (target == adv->rts_advance_target)
+		return;
+	LOGP(DL1C, LOGL_NOTICE, "PHY %d: %s rts-advance from %u to %u, %s\n",
+		plink->num, target > adv->rts_advance_target ? "Raising" : "Lowering",
+		adv->rts_advance_target, target, reason);
+	if (target > adv->rts_advance_target)
+		adv->raised++;
+	else
+		adv->lowered++;
+	adv->rts_advance_target = target;
+}
+
+/* move the advances by at most one frame towards their targets, and tell
+ * trx_sched_fn() how many frames it has to request and compose for fn */
+static void trx_adv_frames(struct phy_link *plink, uint32_t fn,
+			   unsigned int *n_dl, unsigned int *n_rts)
+{
+	struct osmo_trx_clock_state *tcs = plink->u.osmotrx.clk_s;
+	uint32_t *ca = &plink->u.osmotrx.clock_advance;
+	uint32_t *ra = &plink->u.osmotrx.rts_advance;
+	struct trx_adv_tune *adv;
+	uint32_t dl_fn, rts_fn;
+	int d;
+
+	*n_dl = *n_rts = 1;
+	if (!plink->u.osmotrx.auto_advance || !tcs)
+		return;
+	adv = &tcs->adv;
+
+	/* only one of them at a time, so that each range moves by at most
+	 * one frame; raising goes first */
+	if (*ca < adv->clock_advance_target)
+		(*ca)++;
+	else if (*ra < adv->rts_advance_target)
+		(*ra)++;
+	else if (*ca > adv->clock_advance_target)
+		(*ca)--;
+	else if (*ra > adv->rts_advance_target)
+		(*ra)--;
+
+	dl_fn = (fn + *ca) % GSM_HYPERFRAME;
+	rts_fn = (dl_fn + *ra) % GSM_HYPERFRAME;
+	/* anything else is a restart of the clock */
+	if (adv->last_valid) {
+		d = compute_elapsed_fn(adv->last_dl_fn, dl_fn);
+		if (d >= 0 && d <= 2)
+			*n_dl = d;
+		d = compute_elapsed_fn(adv->last_rts_fn, rts_fn);
+		if (d >= 0 && d <= 2)
+			*n_rts = d;
+	}
+	adv->last_dl_fn = dl_fn;
+	adv->last_rts_fn = rts_fn;
+	adv->last_valid = 1;
+}
+
+/* account for a frame composed lag_us after its FN timer expiration,
+ * and retarget the advances at the end of a window */
+static void trx_adv_lag(struct phy_link *plink, struct osmo_trx_clock_state *tcs,
+			int64_t lag_us)
+{
+	struct trx_adv_tune *adv = &tcs->adv;
+	struct phy_instance *pinst;
+	int lag_fn, slack_min = INT_MAX;
+	char reason[64];
+
+	if (lag_us < 0)
+		lag_us = 0;
+	lag_fn = (lag_us + FRAME_DURATION_uS - 1) / FRAME_DURATION_uS;
+	adv->lag_hist[trx_sched_slack_bin(lag_fn)]++;
+	if (lag_us > adv->win_lag_us_max)
+		adv->win_lag_us_max = lag_us;
+
+	/* the bursts of this frame were too late */
+	if (lag_fn > (int)plink->u.osmotrx.clock_advance) {
+		adv->late_frames++;
+		snprintf(reason, sizeof(reason), "a frame was composed %d "
+			 "frames late", lag_fn);
+		trx_adv_set_fn(plink, adv, lag_fn + TRX_ADV_GUARD, reason);
+		adv->quiet_fn = 0;
+	}
+
+	if (++adv->win_frames < TRX_ADV_WINDOW)
+		return;
+
+	lag_fn = (adv->win_lag_us_max + FRAME_DURATION_uS - 1) / FRAME_DURATION_uS;
+	if (lag_fn + TRX_ADV_GUARD > (int)adv->clock_advance_target) {
+		snprintf(reason, sizeof(reason), "frames were composed up to "
+			 "%d frames late", lag_fn);
+		trx_adv_set_fn(plink, adv, lag_fn + TRX_ADV_GUARD, reason);
+		adv->quiet_fn = 0;
+	} else if (lag_fn + TRX_ADV_GUARD < (int)adv->clock_advance_target) {
+		if (++adv->quiet_fn >= TRX_ADV_QUIET) {
+			trx_adv_set_fn(plink, adv, adv->clock_advance_target - 1,
+				       "frames are composed in time");
+			adv->quiet_fn = 0;
+		}
+	} else
+		adv->quiet_fn = 0;
+
+	llist_for_each_entry(pinst, &plink->instances, list) {
+		struct trx_l1h *l1h = pinst->u.osmotrx.hdl;
+
+		if (!pinst->trx || !l1h)
+			continue;
+		if (l1h->l1s.dl_prim_slack_min < slack_min)
+			slack_min = l1h->l1s.dl_prim_slack_min;
+		l1h->l1s.dl_prim_slack_min = INT_MAX;
+	}
+
+	if (slack_min < 1) {
+		snprintf(reason, sizeof(reason), "prims arrived up to %d "
+			 "frames late", 1 - slack_min);
+		trx_adv_set_rts(plink, adv, adv->rts_advance_target
+				+ TRX_ADV_GUARD - slack_min, reason);
+		adv->quiet_rts = 0;
+	} else if (slack_min == INT_MAX) {
+		/* keep counting quiet windows only while prims arrive */
+	} else if (slack_min > TRX_ADV_GUARD && adv->rts_advance_target) {
+		if (++adv->quiet_rts >= TRX_ADV_QUIET) {
+			trx_adv_set_rts(plink, adv, adv->rts_advance_target - 1,
+					"prims arrive in time");
+			adv->quiet_rts = 0;
+		}
+	} else
+		adv->quiet_rts = 0;
+
+	adv->win_frames = 0;
+	adv->win_lag_us_max = 0;
+}
+
+/*! state of the advance tuning of a PHY link, for VTY
+ *  \returns NULL if not tuning, or no clock indication was received yet */
+const struct trx_adv_tune *trx_sched_adv_tune(struct phy_link *plink)
+{
+	if (!plink->u.osmotrx.auto_advance || !plink->u.osmotrx.clk_s)
+		return NULL;
+	return &plink->u.osmotrx.clk_s->adv;
+}
+
 /*! Increment a GSM frame number modulo GSM_HYPERFRAME */
 #define INCREMENT_FN(fn)	(fn) = (((fn) + 1) % GSM_HYPERFRAME)
 
@@ -1504,9 +2061,12 @@ extern int quit;
 /*! this is the timerfd-callback firing for every FN to be processed */
 static int trx_fn_timer_cb(struct osmo_fd *ofd, unsigned int what)
 {
-	struct gsm_bts *bts = ofd->data;
-	struct osmo_trx_clock_state *tcs = &g_clk_s;
-	struct timespec tv_now;
+	struct phy_link *plink = ofd->data;
+	struct osmo_trx_clock_state *tcs = plink->u.osmotrx.clk_s;
+	struct phy_instance *pinst;
+	struct gsm_bts *bts = NULL;
+	struct timespec tv_now, tv_due, tv_done;
+	struct itimerspec its;
 	uint64_t expire_count;
 	int64_t elapsed_us, error_us;
 	int rc, i;
@@ -1548,34 +2108,56 @@ static int trx_fn_timer_cb(struct osmo_fd *ofd, unsigned int what)
 		goto no_clock;
 	}
 
+	/* when the last expiration was due, to measure how late the frames
+	 * are composed */
+	tv_due = tv_now;
+	if (plink->u.osmotrx.auto_advance &&
+	    timerfd_gettime(ofd->fd, &its) == 0) {
+		struct timespec ahead;
+		timespecsub(&its.it_interval, &its.it_value, &ahead);
+		timespecsub(&tv_now, &ahead, &tv_due);
+	}
+
 	/* call trx_sched_fn() for all expired FN */
 	for (i = 0; i < expire_count; i++) {
 		INCREMENT_FN(tcs->last_fn_timer.fn);
-		trx_sched_fn(bts, tcs->last_fn_timer.fn);
+		trx_sched_fn(plink, tcs->last_fn_timer.fn);
+		if (plink->u.osmotrx.auto_advance) {
+			clock_gettime(CLOCK_MONOTONIC, &tv_done);
+			trx_adv_lag(plink, tcs, compute_elapsed_us(&tv_due, &tv_done)
+				    + (expire_count - 1 - i) * FRAME_DURATION_uS);
+		}
 	}
 
 	return 0;
 
 no_clock:
 	timer_ofd_disable(&tcs->fn_timer_ofd);
-	transceiver_available = 0;
+	plink->u.osmotrx.transceiver_available = 0;
 
-	bts_shutdown(bts, "No clock from osmo-trx");
+	llist_for_each_entry(pinst, &plink->instances, list) {
+		if (pinst->trx) {
+			bts = pinst->trx->bts;
+			break;
+		}
+	}
+	if (bts)
+		bts_shutdown(bts, "No clock from osmo-trx");
 
 	return -1;
 }
 
 /*! reset clock with current fn and schedule it. Called when trx becomes
  *  available or when max clock skew is reached */
-static int trx_setup_clock(struct gsm_bts *bts, struct osmo_trx_clock_state *tcs,
+static int trx_setup_clock(struct phy_link *plink, struct osmo_trx_clock_state *tcs,
 	struct timespec *tv_now, const struct timespec *interval, uint32_t fn)
 {
 	tcs->last_fn_timer.fn = fn;
 	/* call trx cheduler function for new 'last' FN */
-	trx_sched_fn(bts, tcs->last_fn_timer.fn);
+	trx_sched_fn(plink, tcs->last_fn_timer.fn);
 
 	/* schedule first FN clock timer */
-	timer_ofd_setup(&tcs->fn_timer_ofd, trx_fn_timer_cb, bts);
+	timer_ofd_setup(&tcs->fn_timer_ofd, trx_fn_timer_cb, plink);
 	timer_ofd_schedule(&tcs->fn_timer_ofd, NULL, interval);
 
 	tcs->last_fn_timer.tv = *tv_now;
@@ -1585,37 +2167,76 @@ static int trx_setup_clock(struct gsm_bts *bts, struct osmo_trx_clock_state *tcs
 	return 0;
 }
 
+/*! stop the FN timer of a PHY link.  The next clock indication starts
+ *  it over. */
+void trx_sched_clock_stop(struct phy_link *plink)
+{
+	struct osmo_trx_clock_state *tcs = plink->u.osmotrx.clk_s;
+
+	plink->u.osmotrx.transceiver_available = 0;
+
+	if (!tcs || tcs->fn_timer_ofd.fd < 0)
+		return;
+
+	timer_ofd_disable(&tcs->fn_timer_ofd);
+	osmo_fd_unregister(&tcs->fn_timer_ofd);
+	close(tcs->fn_timer_ofd.fd);
+	tcs->fn_timer_ofd.fd = -1;
+}
+
+/*! state of the clock discipline of a PHY link, for VTY/CTRL
+ *  \returns NULL if the PHY link never received a clock indication */
+const struct trx_clock_disc *trx_sched_clock_disc(struct phy_link *plink)
+{
+	if (!plink->u.osmotrx.clk_s)
+		return NULL;
+	return &plink->u.osmotrx.clk_s->disc;
+}
+
 /*! called every time we receive a clock indication from TRX */
-int trx_sched_clock(struct gsm_bts *bts, uint32_t fn)
+int trx_sched_clock(struct phy_link *plink, uint32_t fn)
 {
-	struct osmo_trx_clock_state *tcs = &g_clk_s;
+	struct osmo_trx_clock_state *tcs = plink->u.osmotrx.clk_s;
 	struct timespec tv_now;
 	int elapsed_fn;
 	int64_t elapsed_us, elapsed_us_since_clk, elapsed_fn_since_clk, error_us_since_clk;
 	unsigned int fn_caught_up = 0;
-	const struct timespec interval = { .tv_sec = 0, .tv_nsec = FRAME_DURATION_nS };
+	struct timespec interval = { .tv_sec = 0, .tv_nsec = FRAME_DURATION_nS };
 
 	if (quit)
 		return 0;
 
+	if (!tcs) {
+		tcs = talloc_zero(plink, struct osmo_trx_clock_state);
+		if (!tcs)
+			return -ENOMEM;
+		tcs->fn_timer_ofd.fd = -1;
+		trx_clock_disc_reset(&tcs->disc);
+		tcs->adv.clock_advance_target = plink->u.osmotrx.clock_advance;
+		tcs->adv.rts_advance_target = plink->u.osmotrx.rts_advance;
+		plink->u.osmotrx.clk_s = tcs;
+	}
+
 	/* reset lost counter */
 	tcs->fn_without_clock_ind = 0;
 
 	clock_gettime(CLOCK_MONOTONIC, &tv_now);
 
 	/* clock becomes valid */
-	if (!transceiver_available) {
-		LOGP(DL1C, LOGL_NOTICE, "initial GSM clock received: fn=%u\n", fn);
+	if (!plink->u.osmotrx.transceiver_available) {
+		LOGP(DL1C, LOGL_NOTICE, "initial GSM clock received on PHY %d: "
+			"fn=%u\n", plink->num, fn);
 
-		transceiver_available = 1;
+		plink->u.osmotrx.transceiver_available = 1;
 
 		/* start provisioning transceiver */
-		l1if_provision_transceiver(bts);
+		l1if_provision_transceiver(plink);
 
 		/* tell BSC */
-		check_transceiver_availability(bts, 1);
+		check_transceiver_availability(plink, 1);
 
-		return trx_setup_clock(bts, tcs, &tv_now, &interval, fn);
+		trx_clock_disc_reset(&tcs->disc);
+		return trx_setup_clock(plink, tcs, &tv_now, &interval, fn);
 	}
 
 	/* calculate elapsed time +fn since last timer */
@@ -1639,11 +2260,6 @@ int trx_sched_clock(struct gsm_bts *bts, uint32_t fn)
 		"elapsed_fn=%3"PRId64", error_us=%+5"PRId64"\n",
 		elapsed_us_since_clk, elapsed_fn_since_clk, error_us_since_clk);
 
-	/* TODO: put this computed error_us_since_clk into some filter
-	 * function and use that to adjust our regular timer interval to
-	 * compensate for clock drift between the PC clock and the
-	 * TRX/SDR clock */
-
 	tcs->last_clk_ind.tv = tv_now;
 	tcs->last_clk_ind.fn = fn;
 
@@ -1651,12 +2267,28 @@ int trx_sched_clock(struct gsm_bts *bts, uint32_t fn)
 	if (elapsed_fn > MAX_FN_SKEW || elapsed_fn < -MAX_FN_SKEW) {
 		LOGP(DL1C, LOGL_NOTICE, "GSM clock skew: old fn=%u, "
 			"new fn=%u\n", tcs->last_fn_timer.fn, fn);
-		return trx_setup_clock(bts, tcs, &tv_now, &interval, fn);
+		/* keep the frequency estimate, but start over with the phase */
+		if (plink->u.osmotrx.clock_discipline)
+			interval.tv_nsec = tcs->disc.interval_ns = FRAME_DURATION_nS
+					- (int64_t)tcs->disc.freq_ns;
+		return trx_setup_clock(plink, tcs, &tv_now, &interval, fn);
 	}
 
 	LOGP(DL1C, LOGL_INFO, "GSM clock jitter: %" PRId64 "us (elapsed_fn=%d)\n",
 		elapsed_fn * FRAME_DURATION_uS - elapsed_us, elapsed_fn);
 
+	/* retune the FN timer to the TRX clock: the phase is the time by
+	 * which the TRX is ahead of our last processed frame */
+	if (plink->u.osmotrx.clock_discipline) {
+		interval.tv_nsec = trx_clock_disc_update(&tcs->disc,
+				elapsed_fn * FRAME_DURATION_uS - elapsed_us - CLOCK_DISC_PHASE_uS,
+				elapsed_fn_since_clk);
+		trx_clock_disc_apply(tcs);
+		LOGP(DL1C, LOGL_DEBUG, "Clock discipline: interval=%"PRId64"ns, "
+			"offset=%+.3fppm, jitter=%.0fus\n", tcs->disc.interval_ns,
+			tcs->disc.ppm, tcs->disc.jitter_us);
+	}
+
 	/* too many frames have been processed already */
 	if (elapsed_fn < 0) {
 		struct timespec first = interval;
@@ -1673,8 +2305,12 @@ int trx_sched_clock(struct gsm_bts *bts, uint32_t fn)
 	/* transmit what we still need to transmit */
 	while (fn != tcs->last_fn_timer.fn) {
 		INCREMENT_FN(tcs->last_fn_timer.fn);
-		trx_sched_fn(bts, tcs->last_fn_timer.fn);
+		trx_sched_fn(plink, tcs->last_fn_timer.fn);
 		fn_caught_up++;
+		/* these frames are late by the ones still to catch up */
+		if (plink->u.osmotrx.auto_advance)
+			trx_adv_lag(plink, tcs, (elapsed_fn - fn_caught_up + 1)
+				    * FRAME_DURATION_uS);
 	}
 
 	if (fn_caught_up) {
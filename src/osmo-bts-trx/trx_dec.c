@@ -0,0 +1,282 @@
+/* Uplink channel decoder worker pool of OsmoBTS-TRX */
+
+/* This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Once the last burst of a block is received, the scheduler copies the
+ * interleaved bursts and everything the decoder needs into a job.  The
+ * job is decoded on one of the worker threads, which must not log nor
+ * touch any other state.  Completed jobs are handed back to the scheduler
+ * on the main thread strictly in the order they were submitted, so the
+ * order of indications per logical channel (and between channels) stays
+ * the same as with inline decoding.
+ *
+ * The main thread never waits for a worker.  If the ring is full, the
+ * block is dropped.  The AMR codec mode a frame is decoded with depends
+ * on the previous frame of the channel; the job of the previous frame
+ * passes it on to the next one, which waits for it on its worker.
+ */
+
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include <osmocom/core/select.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+
+#include <osmo-bts/phy_link.h>
+#include <osmo-bts/logging.h>
+
+#include "trx_dec.h"
+
+static uint64_t trx_dec_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void *trx_dec_worker(void *arg)
+{
+	struct trx_dec_pool *pool = arg;
+	struct trx_dec_job *job;
+	uint64_t one = 1;
+
+	while (1) {
+		pthread_mutex_lock(&pool->lock);
+		while (!pool->stop && pool->run == pool->head)
+			pthread_cond_wait(&pool->work_cond, &pool->lock);
+		if (pool->stop) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		job = &pool->job[pool->run++ % TRX_DEC_RING_SIZE];
+		/* the job of the previous frame is on another worker */
+		while (job->amr_wait && !pool->stop)
+			pthread_cond_wait(&pool->chain_cond, &pool->lock);
+		pthread_mutex_unlock(&pool->lock);
+
+		trx_dec_job_run(job);
+
+		pthread_mutex_lock(&pool->lock);
+		__atomic_store_n(&job->done, 1, __ATOMIC_RELEASE);
+		if (job->amr_next) {
+			job->amr_next->ul_ft = job->ul_ft;
+			job->amr_next->ul_cmr = job->ul_cmr;
+			job->amr_next->amr_wait = 0;
+			job->amr_next = NULL;
+			pthread_cond_broadcast(&pool->chain_cond);
+		}
+		pthread_mutex_unlock(&pool->lock);
+		if (write(pool->done_ofd.fd, &one, sizeof(one)) != sizeof(one)) {
+			/* the main thread is woken up by the next job anyway */
+		}
+	}
+
+	return NULL;
+}
+
+/* hand completed jobs to the scheduler, in submission order */
+static void trx_dec_deliver(struct trx_dec_pool *pool)
+{
+	struct trx_dec_job *job;
+	uint64_t latency;
+
+	while (pool->tail != pool->head) {
+		job = &pool->job[pool->tail % TRX_DEC_RING_SIZE];
+		if (!__atomic_load_n(&job->done, __ATOMIC_ACQUIRE))
+			break;
+
+		latency = trx_dec_now_us() - job->submit_us;
+		pool->latency_us_sum += latency;
+		if (latency > pool->latency_us_max)
+			pool->latency_us_max = latency;
+
+		trx_dec_job_complete(job);
+		pool->tail++;
+	}
+}
+
+static int trx_dec_done_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct trx_dec_pool *pool = ofd->data;
+	uint64_t count;
+
+	if (read(ofd->fd, &count, sizeof(count)) != sizeof(count))
+		return 0;
+
+	trx_dec_deliver(pool);
+
+	return 0;
+}
+
+/*! start the uplink decoder worker pool of a PHY link
+ *  \param[in] plink PHY link with 'osmotrx ul-decoder-threads' configured
+ *  \returns pool on success; NULL on error */
+struct trx_dec_pool *trx_dec_pool_start(struct phy_link *plink)
+{
+	struct trx_dec_pool *pool;
+	unsigned int i;
+	int rc;
+
+	pool = talloc_zero(plink, struct trx_dec_pool);
+	if (!pool)
+		return NULL;
+
+	pool->threads = talloc_zero_array(pool, pthread_t,
+					  plink->u.osmotrx.ul_dec_threads);
+	if (!pool->threads)
+		goto err_free;
+
+	pool->done_ofd.fd = eventfd(0, EFD_NONBLOCK);
+	if (pool->done_ofd.fd < 0) {
+		LOGP(DL1C, LOGL_ERROR, "Cannot create decoder pool eventfd: %s\n",
+			strerror(errno));
+		goto err_free;
+	}
+	pool->done_ofd.when = BSC_FD_READ;
+	pool->done_ofd.cb = trx_dec_done_cb;
+	pool->done_ofd.data = pool;
+	if (osmo_fd_register(&pool->done_ofd) < 0)
+		goto err_close;
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->chain_cond, NULL);
+
+	for (i = 0; i < plink->u.osmotrx.ul_dec_threads; i++) {
+		rc = pthread_create(&pool->threads[i], NULL, trx_dec_worker, pool);
+		if (rc != 0) {
+			LOGP(DL1C, LOGL_ERROR, "Cannot start decoder thread %u: %s\n",
+				i, strerror(rc));
+			break;
+		}
+		pool->num_threads++;
+	}
+	if (!pool->num_threads) {
+		trx_dec_pool_stop(pool);
+		return NULL;
+	}
+
+	LOGP(DL1C, LOGL_NOTICE, "Started %u uplink decoder threads for "
+		"PHY link %d\n", pool->num_threads, plink->num);
+
+	return pool;
+
+err_close:
+	close(pool->done_ofd.fd);
+err_free:
+	talloc_free(pool);
+	return NULL;
+}
+
+/*! stop and free the pool; outstanding jobs are discarded, the PHY link
+ *  is going down anyway */
+void trx_dec_pool_stop(struct trx_dec_pool *pool)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_cond_broadcast(&pool->chain_cond);
+	pthread_mutex_unlock(&pool->lock);
+	for (i = 0; i < pool->num_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	osmo_fd_unregister(&pool->done_ofd);
+	close(pool->done_ofd.fd);
+	pthread_cond_destroy(&pool->chain_cond);
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_mutex_destroy(&pool->lock);
+	talloc_free(pool);
+}
+
+/*! get a free job slot
+ *  \returns job; NULL if all slots are busy, the block is to be dropped */
+struct trx_dec_job *trx_dec_job_get(struct trx_dec_pool *pool)
+{
+	struct trx_dec_job *job;
+
+	if (pool->head - pool->tail >= TRX_DEC_RING_SIZE) {
+		pool->dropped++;
+		return NULL;
+	}
+
+	job = &pool->job[pool->head % TRX_DEC_RING_SIZE];
+	job->done = 0;
+	job->amr_chain = 0;
+	job->amr_wait = 0;
+	job->amr_next = NULL;
+
+	return job;
+}
+
+/* find the newest job of the same logical channel which is not delivered
+ * yet; called with the lock held */
+static struct trx_dec_job *trx_dec_job_prev(struct trx_dec_pool *pool,
+					    const struct trx_dec_job *job)
+{
+	struct trx_dec_job *prev;
+	unsigned int idx;
+
+	for (idx = pool->head; idx != pool->tail; idx--) {
+		prev = &pool->job[(idx - 1) % TRX_DEC_RING_SIZE];
+		if (prev->l1t == job->l1t && prev->tn == job->tn
+		 && prev->chan == job->chan)
+			return prev;
+	}
+
+	return NULL;
+}
+
+/*! queue a job obtained by trx_dec_job_get() for decoding.  If amr_chain
+ *  is set and the previous job of the channel was not delivered yet, the
+ *  ul_ft/ul_cmr of the job are taken from that one. */
+void trx_dec_job_submit(struct trx_dec_pool *pool, struct trx_dec_job *job)
+{
+	struct trx_dec_job *prev;
+	unsigned int depth;
+
+	job->submit_us = trx_dec_now_us();
+
+	pthread_mutex_lock(&pool->lock);
+	if (job->amr_chain) {
+		prev = trx_dec_job_prev(pool, job);
+		if (prev && prev->amr_chain && prev->gen == job->gen) {
+			if (prev->done) {
+				job->ul_ft = prev->ul_ft;
+				job->ul_cmr = prev->ul_cmr;
+			} else {
+				prev->amr_next = job;
+				job->amr_wait = 1;
+			}
+		}
+	}
+	pool->head++;
+	pthread_cond_signal(&pool->work_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	pool->jobs++;
+	depth = pool->head - pool->tail;
+	if (depth > pool->depth_max)
+		pool->depth_max = depth;
+}
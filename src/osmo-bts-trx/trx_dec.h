@@ -0,0 +1,111 @@
+#ifndef _TRX_DEC_H
+#define _TRX_DEC_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <osmocom/core/select.h>
+#include <osmocom/coding/gsm0503_coding.h>
+
+#include <osmo-bts/scheduler.h>
+
+struct phy_link;
+
+/* Maximum size of a EGPRS message in bytes */
+#ifndef EGPRS_0503_MAX_BYTES
+#define EGPRS_0503_MAX_BYTES		155
+#endif
+
+/*! number of decoder jobs which can be in flight, must be a power of two */
+#define TRX_DEC_RING_SIZE	128
+
+enum trx_dec_type {
+	TRX_DEC_XCCH,
+	TRX_DEC_PDTCH,
+	TRX_DEC_TCHF,
+};
+
+/*! one complete set of interleaved bursts of a logical channel */
+struct trx_dec_job {
+	/* filled by the main thread, read-only for the worker */
+	enum trx_dec_type	type;
+	struct l1sched_trx	*l1t;
+	uint8_t			tn;
+	enum trx_chan_type	chan;
+	uint32_t		gen;		/* act_gen of the channel */
+	uint32_t		fn;		/* FN of the last burst */
+	uint32_t		first_fn;	/* FN of the first burst */
+	float			rssi_sum;
+	uint8_t			rssi_num;
+	int32_t			toa256_sum;
+	uint8_t			toa_num;
+	int8_t			rssi;		/* of the last burst */
+	int16_t			toa256;		/* of the last burst */
+	uint16_t		nbits;		/* length of the bursts */
+	int			skip;		/* burst missed, don't decode */
+	uint8_t			rsl_cmode, tch_mode;
+	uint8_t			amr_cmi;	/* AMR frame contains CMI */
+	uint8_t			amr_chain;	/* ul_ft/ul_cmr follow the previous job */
+	uint8_t			codec[4];
+	int			codecs;
+	/* the interleaved bursts: the scheduler's buffer when decoding
+	 * inline, a copy in bursts_buf when decoding in the pool */
+	sbit_t			*bursts;
+	sbit_t			bursts_buf[GSM0503_EGPRS_BURSTS_NBITS];
+
+	/* filled by the decoder */
+	int			rc;
+	int			n_errors;
+	int			n_bits_total;
+	uint8_t			ul_ft;		/* in/out for AMR */
+	uint8_t			ul_cmr;		/* in/out for AMR */
+	uint8_t			data[EGPRS_0503_MAX_BYTES];
+
+	/* pool bookkeeping */
+	int			done;
+	uint64_t		submit_us;
+	/* AMR: set until the previous job of the channel has passed its
+	 * ul_ft/ul_cmr, which it does through amr_next.  Protected by the
+	 * lock of the pool. */
+	int			amr_wait;
+	struct trx_dec_job	*amr_next;
+};
+
+/*! uplink channel decoder worker pool of a PHY link */
+struct trx_dec_pool {
+	unsigned int		num_threads;
+	pthread_t		*threads;
+	pthread_mutex_t		lock;
+	pthread_cond_t		work_cond;	/* signalled on submit */
+	pthread_cond_t		chain_cond;	/* signalled when amr_wait clears */
+	int			stop;
+
+	/* eventfd waking up the main thread on completion */
+	struct osmo_fd		done_ofd;
+
+	/* ring of jobs: [tail, run) are taken by workers, [run, head)
+	 * are waiting for a worker.  head and run are protected by lock,
+	 * tail is only used by the main thread. */
+	unsigned int		head;
+	unsigned int		run;
+	unsigned int		tail;
+	struct trx_dec_job	job[TRX_DEC_RING_SIZE];
+
+	/* statistics, main thread only */
+	uint64_t		jobs;
+	unsigned int		depth_max;
+	uint64_t		latency_us_sum;
+	uint64_t		latency_us_max;
+	uint64_t		dropped;	/* blocks dropped on a full ring */
+};
+
+struct trx_dec_pool *trx_dec_pool_start(struct phy_link *plink);
+void trx_dec_pool_stop(struct trx_dec_pool *pool);
+struct trx_dec_job *trx_dec_job_get(struct trx_dec_pool *pool);
+void trx_dec_job_submit(struct trx_dec_pool *pool, struct trx_dec_job *job);
+
+/* implemented by the scheduler */
+void trx_dec_job_run(struct trx_dec_job *job);
+int trx_dec_job_complete(struct trx_dec_job *job);
+
+#endif /* _TRX_DEC_H */
@@ -24,20 +24,34 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdint.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
 
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include <osmocom/core/select.h>
 #include <osmocom/core/socket.h>
 #include <osmocom/core/timer.h>
+#include <osmocom/core/timer_compat.h>
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/bits.h>
+#include <osmocom/core/rate_ctr.h>
 
 #include <osmo-bts/phy_link.h>
 #include <osmo-bts/logging.h>
@@ -46,13 +60,50 @@
 
 #include "l1_if.h"
 #include "trx_if.h"
+#include "trx_dec.h"
 
 /* enable to print RSSI level graph */
 //#define TOA_RSSI_DEBUG
 
-int transceiver_available = 0;
-
-#define TRX_MAX_BURST_LEN	512
+/*! batch of downlink bursts of one TDMA frame, sent with a single sendmmsg() */
+struct trx_tx_batch {
+	/*! number of bursts queued for the current tick */
+	unsigned int num;
+	/*! TRXD datagrams (header + bits), bursts may be composed in place.
+	 *  Room for two frames, which are composed in one tick while the
+	 *  auto-advance raises the clock advance. */
+	uint8_t buf[2 * TRX_NR_TS][TRX_MAX_BURST_LEN];
+	struct iovec iov[2 * TRX_NR_TS];
+	struct mmsghdr msg[2 * TRX_NR_TS];
+};
+
+/*! preallocated buffers to drain uplink bursts with recvmmsg() */
+struct trx_rx_batch {
+	/*! number of entries in the arrays below */
+	unsigned int size;
+	uint8_t (*buf)[TRX_MAX_BURST_LEN];
+	struct iovec *iov;
+	struct mmsghdr *msg;
+};
+
+static const struct rate_ctr_desc trx_ctr_desc[] = {
+	[TRX_CTR_TX_BATCH] =		{"trxd:tx_batch", "Downlink burst batches sent (sendmmsg)"},
+	[TRX_CTR_TX_BURST] =		{"trxd:tx_burst", "Downlink bursts sent in batches"},
+	[TRX_CTR_TX_PARTIAL] =		{"trxd:tx_partial", "Partially sent batches (send() fallback)"},
+	[TRX_CTR_TX_SEND_US] =		{"trxd:tx_send_us", "Time spent sending batches (us)"},
+	[TRX_CTR_RX_WAKEUP] =		{"trxd:rx_wakeup", "Uplink socket wakeups (recvmmsg)"},
+	[TRX_CTR_RX_BURST] =		{"trxd:rx_burst", "Uplink bursts received"},
+	[TRX_CTR_RX_FULL] =		{"trxd:rx_full", "Wakeups which filled the whole receive batch"},
+	[TRX_CTR_ENC_CACHE_HIT] =	{"sched:enc_cache_hit", "BCCH/CCCH/SACCH blocks taken from the encoded block cache"},
+	[TRX_CTR_ENC_CACHE_MISS] =	{"sched:enc_cache_miss", "BCCH/CCCH/SACCH blocks that had to be encoded"},
+};
+static const struct rate_ctr_group_desc trx_ctrg_desc = {
+	"trx",
+	"osmo-trx transceiver interface",
+	OSMO_STATS_CLASS_GLOBAL,
+	ARRAY_SIZE(trx_ctr_desc),
+	trx_ctr_desc
+};
 
 /*
  * socket helper functions
@@ -98,13 +149,10 @@ static void trx_udp_close(struct osmo_fd *ofd)
 static int trx_clk_read_cb(struct osmo_fd *ofd, unsigned int what)
 {
 	struct phy_link *plink = ofd->data;
-	struct phy_instance *pinst = phy_instance_by_num(plink, 0);
 	char buf[1500];
 	int len;
 	uint32_t fn;
 
-	OSMO_ASSERT(pinst);
-
 	len = recv(ofd->fd, buf, sizeof(buf) - 1, 0);
 	if (len <= 0)
 		return len;
@@ -130,7 +178,7 @@ static int trx_clk_read_cb(struct osmo_fd *ofd, unsigned int what)
 	}
 
 	/* inform core TRX clock handling code that a FN has been received */
-	trx_sched_clock(pinst->trx->bts, fn);
+	trx_sched_clock(plink, fn);
 
 	return 0;
 }
@@ -202,7 +250,7 @@ static int trx_ctrl_cmd(struct trx_l1h *l1h, int critical, const char *cmd,
 	va_list ap;
 	int pending;
 
-	if (!transceiver_available &&
+	if (!l1h->phy_inst->phy_link->u.osmotrx.transceiver_available &&
 	    !(!strcmp(cmd, "POWEROFF") || !strcmp(cmd, "POWERON"))) {
 		LOGP(DTRX, LOGL_ERROR, "CTRL %s ignored: No clock from "
 		     "transceiver, please fix!\n", cmd);
@@ -356,6 +404,13 @@ int trx_if_cmd_txtune(struct trx_l1h *l1h, uint16_t arfcn)
 	return trx_ctrl_cmd(l1h, 1, "TXTUNE", "%d", freq10 * 100);
 }
 
+/*! Send "SETPACKED" command to TRX: downlink bursts with packed bits.
+ *  Only implemented by osmo-bts-trx-fake; osmo-trx rejects it. */
+int trx_if_cmd_setpacked(struct trx_l1h *l1h, int packed)
+{
+	return trx_ctrl_cmd(l1h, 0, "SETPACKED", "%d", packed);
+}
+
 /*! Send "HANDOVER" command to TRX: Enable handover RACH Detection on timeslot/sub-slot */
 int trx_if_cmd_handover(struct trx_l1h *l1h, uint8_t tn, uint8_t ss)
 {
@@ -468,8 +523,13 @@ static int trx_ctrl_read_cb(struct osmo_fd *ofd, unsigned int what)
 	tcm = llist_entry(l1h->trx_ctrl_list.next, struct trx_ctrl_msg,
 		list);
 
-	/* check if response matches command */
-	if (!cmd_matches_rsp(tcm, cmdname, params)) {
+	/* osmo-trx answers a command it does not know with 'RSP ERR 1'.
+	 * SETPACKED is private to osmo-bts-trx-fake, so take that as its
+	 * rejection; for any other command it is a mismatch as before. */
+	if (!strcmp(tcm->cmd, "SETPACKED") && !strcmp(cmdname, "ERR")) {
+		if (!resp)
+			resp = 1;
+	} else if (!cmd_matches_rsp(tcm, cmdname, params)) {
 		/* RSP from a retransmission, skip it */
 		if (l1h->last_acked && cmd_matches_rsp(l1h->last_acked, cmdname, params)) {
 			LOGP(DTRX, LOGL_NOTICE, "Discarding duplicated RSP "
@@ -493,6 +553,14 @@ static int trx_ctrl_read_cb(struct osmo_fd *ofd, unsigned int what)
 			goto rsp_error;
 	}
 
+	/* bursts are sent packed from now on, if the transceiver supports it */
+	if (!strcmp(tcm->cmd, "SETPACKED")) {
+		l1h->trxd_packed = resp ? 0 : atoi(tcm->params);
+		LOGP(DTRX, LOGL_INFO, "Sending %s downlink bursts to %s\n",
+			l1h->trxd_packed ? "packed" : "unpacked",
+			phy_instance_name(pinst));
+	}
+
 	/* remove command from list, save it to last_acked and removed previous last_acked */
 	llist_del(&tcm->list);
 	talloc_free(l1h->last_acked);
@@ -513,22 +581,51 @@ rsp_error:
  * TRX burst data socket
  */
 
-static int trx_data_read_cb(struct osmo_fd *ofd, unsigned int what)
+/*! convert received bits {254..0} to sbits {-127..127} in place.
+ *  255 is mapped to -127 as well, so this is 127 - min(x, 254) on every
+ *  byte, which needs neither a branch nor a widening. */
+static void trx_data_convert_bits(uint8_t *buf, int len)
+{
+	int i = 0;
+
+#if defined(__AVX2__)
+	const __m256i c127_256 = _mm256_set1_epi8(127);
+	const __m256i c254_256 = _mm256_set1_epi8((char) 254);
+	for (; i + 32 <= len; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(buf + i));
+		x = _mm256_sub_epi8(c127_256, _mm256_min_epu8(x, c254_256));
+		_mm256_storeu_si256((__m256i *)(buf + i), x);
+	}
+#endif
+#if defined(__SSE2__)
+	const __m128i c127 = _mm_set1_epi8(127);
+	const __m128i c254 = _mm_set1_epi8((char) 254);
+	for (; i + 16 <= len; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(buf + i));
+		x = _mm_sub_epi8(c127, _mm_min_epu8(x, c254));
+		_mm_storeu_si128((__m128i *)(buf + i), x);
+	}
+#elif defined(__ARM_NEON)
+	const uint8x16_t c127 = vdupq_n_u8(127);
+	const uint8x16_t c254 = vdupq_n_u8(254);
+	for (; i + 16 <= len; i += 16)
+		vst1q_u8(buf + i, vsubq_u8(c127, vminq_u8(vld1q_u8(buf + i), c254)));
+#endif
+	for (; i < len; i++)
+		buf[i] = (uint8_t)(127 - (buf[i] < 254 ? buf[i] : 254));
+}
+
+/*! handle one TRXD datagram.  The soft bits are converted in place in the
+ *  receive buffer, which is then handed to the scheduler as it is. */
+static int trx_data_handle_burst(struct trx_l1h *l1h, uint8_t *buf, int len)
 {
-	struct trx_l1h *l1h = ofd->data;
-	uint8_t buf[TRX_MAX_BURST_LEN];
-	int len;
 	uint8_t tn;
 	int8_t rssi;
 	int16_t toa256 = 0;
 	uint32_t fn;
-	sbit_t bits[EGPRS_BURST_LEN];
-	int i, burst_len = GSM_BURST_LEN;
+	int burst_len = GSM_BURST_LEN;
 
-	len = recv(ofd->fd, buf, sizeof(buf), 0);
-	if (len <= 0) {
-		return len;
-	} else if (len == EGPRS_BURST_LEN + 10) {
+	if (len == EGPRS_BURST_LEN + 10) {
 		burst_len = EGPRS_BURST_LEN;
 	/* Accept bursts ending with 2 bytes of padding (OpenBTS compatible trx) or without them: */
 	} else if (len != GSM_BURST_LEN + 10 && len != GSM_BURST_LEN + 8) {
@@ -541,14 +638,6 @@ static int trx_data_read_cb(struct osmo_fd *ofd, unsigned int what)
 	rssi = -(int8_t)buf[5];
 	toa256 = ((int16_t)(buf[6] << 8) | buf[7]);
 
-	/* copy and convert bits {254..0} to sbits {-127..127} */
-	for (i = 0; i < burst_len; i++) {
-		if (buf[8 + i] == 255)
-			bits[i] = -127;
-		else
-			bits[i] = 127 - buf[8 + i];
-	}
-
 	if (tn >= 8) {
 		LOGP(DTRX, LOGL_ERROR, "Illegal TS %d\n", tn);
 		return -EINVAL;
@@ -558,6 +647,9 @@ static int trx_data_read_cb(struct osmo_fd *ofd, unsigned int what)
 		return -EINVAL;
 	}
 
+	/* convert bits {254..0} to sbits {-127..127} */
+	trx_data_convert_bits(buf + 8, burst_len);
+
 	LOGP(DTRX, LOGL_DEBUG, "RX burst tn=%u fn=%u rssi=%d toa256=%d\n",
 		tn, fn, rssi, toa256);
 
@@ -571,7 +663,33 @@ static int trx_data_read_cb(struct osmo_fd *ofd, unsigned int what)
 #endif
 
 	/* feed received burst into scheduler code */
-	trx_sched_ul_burst(&l1h->l1s, tn, fn, bits, burst_len, rssi, toa256);
+	trx_sched_ul_burst(&l1h->l1s, tn, fn, (sbit_t *) (buf + 8), burst_len,
+			   rssi, toa256);
+
+	return 0;
+}
+
+/*! drain the TRXD socket: read up to rx-batch bursts with one recvmmsg() */
+static int trx_data_read_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct trx_l1h *l1h = ofd->data;
+	struct trx_rx_batch *batch = l1h->rx_batch;
+	int i, n;
+
+	n = recvmmsg(ofd->fd, batch->msg, batch->size, MSG_DONTWAIT, NULL);
+	if (n <= 0)
+		return n;
+
+	rate_ctr_inc2(l1h->ctrs, TRX_CTR_RX_WAKEUP);
+	rate_ctr_add(&l1h->ctrs->ctr[TRX_CTR_RX_BURST], n);
+	if (n == batch->size)
+		rate_ctr_inc2(l1h->ctrs, TRX_CTR_RX_FULL);
+	if (n > l1h->rx_batch_max)
+		l1h->rx_batch_max = n;
+
+	/* bursts are handed to the scheduler in arrival order */
+	for (i = 0; i < n; i++)
+		trx_data_handle_burst(l1h, batch->buf[i], batch->msg[i].msg_len);
 
 	return 0;
 }
@@ -583,11 +701,19 @@ static int trx_data_read_cb(struct osmo_fd *ofd, unsigned int what)
  *  \param[in] pwr Transmit Power to use
  *  \param[in] bits Unpacked bits to be transmitted
  *  \param[in] nbits Number of \a bits
- *  \returns 0 on success; negative on error */
+ *  \returns 0 on success; negative on error
+ *
+ *  If the transceiver accepted SETPACKED, the bits go out packed, MSB
+ *  first, which takes 25 instead of 154 bytes for a GMSK burst.
+ *
+ *  If TX batching is enabled, the burst is only queued here and sent
+ *  together with the other bursts of the frame by trx_if_send_burst_flush(). */
 int trx_if_send_burst(struct trx_l1h *l1h, uint8_t tn, uint32_t fn, uint8_t pwr,
 	const ubit_t *bits, uint16_t nbits)
 {
-	uint8_t buf[TRX_MAX_BURST_LEN];
+	struct trx_tx_batch *batch = l1h->tx_batch;
+	uint8_t _buf[TRX_MAX_BURST_LEN], *buf = _buf;
+	int len;
 
 	if ((nbits != GSM_BURST_LEN) && (nbits != EGPRS_BURST_LEN)) {
 		LOGP(DTRX, LOGL_ERROR, "Tx burst length %u invalid\n", nbits);
@@ -596,6 +722,22 @@ int trx_if_send_burst(struct trx_l1h *l1h, uint8_t tn, uint32_t fn, uint8_t pwr,
 
 	LOGP(DTRX, LOGL_DEBUG, "TX burst tn=%u fn=%u pwr=%u\n", tn, fn, pwr);
 
+	/* we must be sure that we have clock, and we have sent all control
+	 * data */
+	if (!l1h->phy_inst->phy_link->u.osmotrx.transceiver_available ||
+	    !llist_empty(&l1h->trx_ctrl_list)) {
+		LOGP(DTRX, LOGL_DEBUG, "Ignoring TX data, transceiver "
+			"offline.\n");
+		return 0;
+	}
+
+	if (batch) {
+		/* should not happen, as we flush once per tick */
+		if (batch->num == ARRAY_SIZE(batch->buf))
+			trx_if_send_burst_flush(l1h);
+		buf = batch->buf[batch->num];
+	}
+
 	buf[0] = tn;
 	buf[1] = (fn >> 24) & 0xff;
 	buf[2] = (fn >> 16) & 0xff;
@@ -603,20 +745,138 @@ int trx_if_send_burst(struct trx_l1h *l1h, uint8_t tn, uint32_t fn, uint8_t pwr,
 	buf[4] = (fn >>  0) & 0xff;
 	buf[5] = pwr;
 
-	/* copy ubits {0,1} */
-	memcpy(buf + 6, bits, nbits);
+	if (l1h->trxd_packed) {
+		/* pack ubits {0,1}, this works in place as well */
+		len = osmo_ubit2pbit(buf + 6, bits, nbits);
+	} else {
+		/* copy ubits {0,1}, unless they were composed in place */
+		if (bits != buf + 6)
+			memcpy(buf + 6, bits, nbits);
+		len = nbits;
+	}
 
-	/* we must be sure that we have clock, and we have sent all control
-	 * data */
-	if (transceiver_available && llist_empty(&l1h->trx_ctrl_list)) {
-		send(l1h->trx_ofd_data.fd, buf, nbits + 6, 0);
+	if (batch) {
+		batch->iov[batch->num].iov_len = len + 6;
+		batch->num++;
 	} else
-		LOGP(DTRX, LOGL_DEBUG, "Ignoring TX data, transceiver "
-			"offline.\n");
+		send(l1h->trx_ofd_data.fd, buf, len + 6, 0);
 
 	return 0;
 }
 
+/*! Get the buffer the next burst of the current frame can be composed in
+ *  \param[inout] l1h TRX Layer1 handle referring to TX
+ *  \returns where trx_if_send_burst() puts the bits of the next burst;
+ *	     NULL if bursts are not batched
+ *
+ *  Bursts composed there are sent without being copied. */
+ubit_t *trx_if_burst_buf(struct trx_l1h *l1h)
+{
+	struct trx_tx_batch *batch = l1h->tx_batch;
+
+	if (!batch || batch->num == ARRAY_SIZE(batch->buf))
+		return NULL;
+
+	return batch->buf[batch->num] + 6;
+}
+
+/*! Send all bursts queued by trx_if_send_burst() for the current frame
+ *  \param[inout] l1h TRX Layer1 handle referring to TX
+ *  \returns number of bursts sent
+ *
+ *  All queued bursts are handed to the kernel with a single sendmmsg().
+ *  If it does not accept all of them, the remaining ones are sent one by
+ *  one using send(). */
+int trx_if_send_burst_flush(struct trx_l1h *l1h)
+{
+	struct trx_tx_batch *batch = l1h->tx_batch;
+	struct timespec tv_start, tv_end, elapsed;
+	unsigned int sent = 0;
+	uint32_t elapsed_us;
+	int rc;
+
+	if (!batch || !batch->num)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &tv_start);
+
+	rc = sendmmsg(l1h->trx_ofd_data.fd, batch->msg, batch->num, 0);
+	if (rc > 0)
+		sent = rc;
+	if (sent < batch->num) {
+		LOGP(DTRX, LOGL_DEBUG, "sendmmsg() sent %u of %u bursts, "
+			"sending the remaining ones one by one\n", sent, batch->num);
+		rate_ctr_inc2(l1h->ctrs, TRX_CTR_TX_PARTIAL);
+		for (; sent < batch->num; sent++) {
+			if (send(l1h->trx_ofd_data.fd, batch->buf[sent],
+				 batch->iov[sent].iov_len, 0) < 0)
+				break;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &tv_end);
+	timespecsub(&tv_end, &tv_start, &elapsed);
+	elapsed_us = elapsed.tv_sec * 1000000 + elapsed.tv_nsec / 1000;
+	if (elapsed_us > l1h->tx_send_us_max)
+		l1h->tx_send_us_max = elapsed_us;
+
+	rate_ctr_inc2(l1h->ctrs, TRX_CTR_TX_BATCH);
+	rate_ctr_add(&l1h->ctrs->ctr[TRX_CTR_TX_BURST], sent);
+	rate_ctr_add(&l1h->ctrs->ctr[TRX_CTR_TX_SEND_US], elapsed_us);
+
+	batch->num = 0;
+
+	return sent;
+}
+
+/*! allocate the uplink receive batch of a TRX, holding \a size bursts */
+static struct trx_rx_batch *trx_rx_batch_alloc(void *ctx, unsigned int size)
+{
+	struct trx_rx_batch *batch;
+	unsigned int i;
+
+	batch = talloc_zero(ctx, struct trx_rx_batch);
+	if (!batch)
+		return NULL;
+
+	batch->size = size;
+	batch->buf = talloc_zero_size(batch, size * sizeof(*batch->buf));
+	batch->iov = talloc_zero_array(batch, struct iovec, size);
+	batch->msg = talloc_zero_array(batch, struct mmsghdr, size);
+	if (!batch->buf || !batch->iov || !batch->msg) {
+		talloc_free(batch);
+		return NULL;
+	}
+
+	for (i = 0; i < size; i++) {
+		batch->iov[i].iov_base = batch->buf[i];
+		batch->iov[i].iov_len = sizeof(batch->buf[i]);
+		batch->msg[i].msg_hdr.msg_iov = &batch->iov[i];
+		batch->msg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	return batch;
+}
+
+/*! allocate the downlink burst batch of a TRX */
+static struct trx_tx_batch *trx_tx_batch_alloc(void *ctx)
+{
+	struct trx_tx_batch *batch;
+	unsigned int i;
+
+	batch = talloc_zero(ctx, struct trx_tx_batch);
+	if (!batch)
+		return NULL;
+
+	for (i = 0; i < ARRAY_SIZE(batch->buf); i++) {
+		batch->iov[i].iov_base = batch->buf[i];
+		batch->msg[i].msg_hdr.msg_iov = &batch->iov[i];
+		batch->msg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	return batch;
+}
+
 
 /*
  * open/close
@@ -635,6 +895,7 @@ void trx_if_flush(struct trx_l1h *l1h)
 		talloc_free(tcm);
 	}
 	talloc_free(l1h->last_acked);
+	l1h->last_acked = NULL;
 }
 
 /*! close the TRX for given handle (data + control socket) */
@@ -649,6 +910,11 @@ void trx_if_close(struct trx_l1h *l1h)
 	/* close sockets */
 	trx_udp_close(&l1h->trx_ofd_ctrl);
 	trx_udp_close(&l1h->trx_ofd_data);
+
+	talloc_free(l1h->tx_batch);
+	l1h->tx_batch = NULL;
+	talloc_free(l1h->rx_batch);
+	l1h->rx_batch = NULL;
 }
 
 /*! compute UDP port number used for TRX protocol */
@@ -679,6 +945,15 @@ static int trx_if_open(struct trx_l1h *l1h)
 	/* initialize ctrl queue */
 	INIT_LLIST_HEAD(&l1h->trx_ctrl_list);
 
+	/* buffers to drain the data socket, must exist before it is opened */
+	l1h->rx_batch = trx_rx_batch_alloc(l1h, plink->u.osmotrx.rx_batch);
+	if (!l1h->rx_batch)
+		return -ENOMEM;
+
+	if (!l1h->ctrs)
+		l1h->ctrs = rate_ctr_group_alloc(l1h, &trx_ctrg_desc,
+						 (plink->num << 8) | pinst->num);
+
 	/* open sockets */
 	rc = trx_udp_open(l1h, &l1h->trx_ofd_ctrl,
 			  plink->u.osmotrx.local_ip,
@@ -695,6 +970,15 @@ static int trx_if_open(struct trx_l1h *l1h)
 	if (rc < 0)
 		goto err;
 
+	/* batch bursts of a frame into one sendmmsg(), if enabled */
+	if (plink->u.osmotrx.tx_batch) {
+		l1h->tx_batch = trx_tx_batch_alloc(l1h);
+		if (!l1h->tx_batch) {
+			rc = -ENOMEM;
+			goto err;
+		}
+	}
+
 	/* enable all slots */
 	l1h->config.slotmask = 0xff;
 
@@ -771,13 +1055,37 @@ int bts_model_phy_link_open(struct phy_link *plink)
 		if (trx_phy_inst_open(pinst) < 0)
 			goto cleanup;
 	}
+	/* decode uplink blocks in a worker pool, if configured */
+	if (plink->u.osmotrx.ul_dec_threads && !plink->u.osmotrx.dec) {
+		plink->u.osmotrx.dec = trx_dec_pool_start(plink);
+		if (!plink->u.osmotrx.dec)
+			goto cleanup;
+	}
+
 	/* FIXME: is there better way to check/report TRX availability? */
-	transceiver_available = 1;
+	plink->u.osmotrx.transceiver_available = 1;
 	phy_link_state_set(plink, PHY_LINK_CONNECTED);
 	return 0;
 
 cleanup:
+	trx_phy_link_close(plink);
+	return -1;
+}
+
+/*! close the PHY link: stop its FN timer and decoder threads, close the
+ *  instances and the clock socket */
+void trx_phy_link_close(struct phy_link *plink)
+{
+	struct phy_instance *pinst;
+
 	phy_link_state_set(plink, PHY_LINK_SHUTDOWN);
+
+	trx_sched_clock_stop(plink);
+	if (plink->u.osmotrx.dec) {
+		trx_dec_pool_stop(plink->u.osmotrx.dec);
+		plink->u.osmotrx.dec = NULL;
+	}
+
 	llist_for_each_entry(pinst, &plink->instances, list) {
 		if (pinst->u.osmotrx.hdl) {
 			trx_if_close(pinst->u.osmotrx.hdl);
@@ -785,7 +1093,6 @@ cleanup:
 		}
 	}
 	trx_udp_close(&plink->u.osmotrx.trx_ofd_clk);
-	return -1;
 }
 
 /*! determine if the TRX for given handle is powered up */
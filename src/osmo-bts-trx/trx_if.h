@@ -1,9 +1,23 @@
 #ifndef TRX_IF_H
 #define TRX_IF_H
 
-extern int transceiver_available;
+#define TRX_MAX_BURST_LEN	512
 
 struct trx_l1h;
+struct phy_link;
+
+/* TRX interface counters (per phy_instance) */
+enum trx_if_ctr {
+	TRX_CTR_TX_BATCH,
+	TRX_CTR_TX_BURST,
+	TRX_CTR_TX_PARTIAL,
+	TRX_CTR_TX_SEND_US,
+	TRX_CTR_RX_WAKEUP,
+	TRX_CTR_RX_BURST,
+	TRX_CTR_RX_FULL,
+	TRX_CTR_ENC_CACHE_HIT,
+	TRX_CTR_ENC_CACHE_MISS,
+};
 
 struct trx_ctrl_msg {
 	struct llist_head	list;
@@ -25,10 +39,14 @@ int trx_if_cmd_setmaxdlynb(struct trx_l1h *l1h, int dly);
 int trx_if_cmd_setslot(struct trx_l1h *l1h, uint8_t tn, uint8_t type);
 int trx_if_cmd_rxtune(struct trx_l1h *l1h, uint16_t arfcn);
 int trx_if_cmd_txtune(struct trx_l1h *l1h, uint16_t arfcn);
+int trx_if_cmd_setpacked(struct trx_l1h *l1h, int packed);
 int trx_if_cmd_handover(struct trx_l1h *l1h, uint8_t tn, uint8_t ss);
 int trx_if_cmd_nohandover(struct trx_l1h *l1h, uint8_t tn, uint8_t ss);
 int trx_if_send_burst(struct trx_l1h *l1h, uint8_t tn, uint32_t fn, uint8_t pwr,
 	const ubit_t *bits, uint16_t nbits);
+ubit_t *trx_if_burst_buf(struct trx_l1h *l1h);
+int trx_if_send_burst_flush(struct trx_l1h *l1h);
 int trx_if_powered(struct trx_l1h *l1h);
+void trx_phy_link_close(struct phy_link *plink);
 
 #endif /* TRX_IF_H */
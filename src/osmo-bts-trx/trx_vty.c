@@ -32,10 +32,12 @@
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/select.h>
 #include <osmocom/core/bits.h>
+#include <osmocom/core/rate_ctr.h>
 
 #include <osmocom/vty/vty.h>
 #include <osmocom/vty/command.h>
 #include <osmocom/vty/misc.h>
+#include <osmocom/ctrl/control_cmd.h>
 
 #include <osmo-bts/gsm_data.h>
 #include <osmo-bts/logging.h>
@@ -44,6 +46,7 @@
 
 #include "l1_if.h"
 #include "trx_if.h"
+#include "trx_dec.h"
 #include "loops.h"
 
 #define OSMOTRX_STR	"OsmoTRX Transceiver configuration\n"
@@ -56,17 +59,16 @@ DEFUN(show_transceiver, show_transceiver_cmd, "show transceiver",
 	struct gsm_bts *bts = vty_bts;
 	struct gsm_bts_trx *trx;
 	struct trx_l1h *l1h;
-
-	if (!transceiver_available) {
-		vty_out(vty, "transceiver is not connected%s", VTY_NEWLINE);
-	} else {
-		vty_out(vty, "transceiver is connected%s", VTY_NEWLINE);
-	}
+	unsigned int dropped;
+	uint8_t tn;
 
 	llist_for_each_entry(trx, &bts->trx_list, list) {
 		struct phy_instance *pinst = trx_phy_instance(trx);
 		l1h = pinst->u.osmotrx.hdl;
 		vty_out(vty, "TRX %d%s", trx->nr, VTY_NEWLINE);
+		vty_out(vty, " transceiver is %sconnected (PHY %u)%s",
+			pinst->phy_link->u.osmotrx.transceiver_available ? "" : "not ",
+			pinst->phy_link->num, VTY_NEWLINE);
 		vty_out(vty, " %s%s",
 			(l1h->config.poweron) ? "poweron":"poweroff",
 			VTY_NEWLINE);
@@ -87,12 +89,39 @@ DEFUN(show_transceiver, show_transceiver_cmd, "show transceiver",
 				VTY_NEWLINE);
 		else
 			vty_out(vty, " bisc   : undefined%s", VTY_NEWLINE);
+		for (tn = 0, dropped = 0; tn < TRX_NR_TS; tn++)
+			dropped += l1h->l1s.ts[tn].dl_prims_dropped;
+		vty_out(vty, " stale DL prims dropped : %u%s", dropped,
+			VTY_NEWLINE);
+		if (l1h->ctrs)
+			vty_out(vty, " encoded block cache : %"PRIu64" hits, "
+				"%"PRIu64" misses%s",
+				l1h->ctrs->ctr[TRX_CTR_ENC_CACHE_HIT].current,
+				l1h->ctrs->ctr[TRX_CTR_ENC_CACHE_MISS].current,
+				VTY_NEWLINE);
 	}
 
 	return CMD_SUCCESS;
 }
 
 
+/* labels of the bins of trx_sched_slack_bin() */
+static const char *slack_bin_names[TRX_SCHED_SLACK_BINS] = {
+	"<=0", "1", "2", "3-4", "5-8", "9-16", "17-32", ">32"
+};
+
+static void vty_out_slack_hist(struct vty *vty, const char *title,
+			       const uint64_t *hist)
+{
+	int i;
+
+	vty_out(vty, " %s:", title);
+	for (i = 0; i < TRX_SCHED_SLACK_BINS; i++)
+		vty_out(vty, " %s %"PRIu64"%s", slack_bin_names[i], hist[i],
+			i < TRX_SCHED_SLACK_BINS - 1 ? "," : "");
+	vty_out(vty, "%s", VTY_NEWLINE);
+}
+
 static void show_phy_inst_single(struct vty *vty, struct phy_instance *pinst)
 {
 	uint8_t tn;
@@ -121,6 +150,20 @@ static void show_phy_inst_single(struct vty *vty, struct phy_instance *pinst)
 			VTY_NEWLINE);
 	else
 		vty_out(vty, " maxdlynb : undefined%s", VTY_NEWLINE);
+	vty_out(vty, " trxd downlink bursts : %s%s",
+		l1h->trxd_packed ? "packed" : "unpacked", VTY_NEWLINE);
+	/* the maxima start over each time they are shown */
+	if (l1h->tx_batch)
+		vty_out(vty, " tx-batch max send time since last shown : %u us%s",
+			l1h->tx_send_us_max, VTY_NEWLINE);
+	l1h->tx_send_us_max = 0;
+	vty_out(vty, " rx-batch max bursts per wakeup since last shown : %u%s",
+		l1h->rx_batch_max, VTY_NEWLINE);
+	l1h->rx_batch_max = 0;
+	vty_out_slack_hist(vty, "DL prims ahead of their frame (frames)",
+			   l1h->l1s.dl_prim_slack);
+	if (l1h->ctrs)
+		vty_out_rate_ctr_group(vty, " ", l1h->ctrs);
 	for (tn = 0; tn < TRX_NR_TS; tn++) {
 		if (!((1 << tn) & l1h->config.slotmask))
 			vty_out(vty, " slot #%d: unsupported%s", tn,
@@ -141,6 +184,41 @@ static void show_phy_single(struct vty *vty, struct phy_link *plink)
 
 	vty_out(vty, "PHY %u%s", plink->num, VTY_NEWLINE);
 
+	if (plink->u.osmotrx.clock_discipline && trx_sched_clock_disc(plink)) {
+		const struct trx_clock_disc *disc = trx_sched_clock_disc(plink);
+		vty_out(vty, " clock discipline: offset %+.3f ppm, jitter %.0f us, "
+			"interval %"PRId64" ns (%u updates)%s", disc->ppm,
+			disc->jitter_us, disc->interval_ns, disc->updates,
+			VTY_NEWLINE);
+	}
+
+	vty_out(vty, " fn-advance %u, rts-advance %u%s",
+		plink->u.osmotrx.clock_advance, plink->u.osmotrx.rts_advance,
+		VTY_NEWLINE);
+	if (trx_sched_adv_tune(plink)) {
+		const struct trx_adv_tune *adv = trx_sched_adv_tune(plink);
+		vty_out(vty, " auto-advance: fn-advance target %u (%u..%u), "
+			"rts-advance target %u (%u..%u), raised %u, lowered %u, "
+			"late frames %"PRIu64"%s", adv->clock_advance_target,
+			plink->u.osmotrx.clock_advance_min,
+			plink->u.osmotrx.clock_advance_max,
+			adv->rts_advance_target, plink->u.osmotrx.rts_advance_min,
+			plink->u.osmotrx.rts_advance_max, adv->raised,
+			adv->lowered, adv->late_frames, VTY_NEWLINE);
+		vty_out_slack_hist(vty, "frames composed late by (frames)",
+				   adv->lag_hist);
+	}
+
+	if (plink->u.osmotrx.dec) {
+		struct trx_dec_pool *dec = plink->u.osmotrx.dec;
+		vty_out(vty, " UL decoder pool: %u threads, jobs %"PRIu64
+			", max queue depth %u, latency avg %"PRIu64" us max %"PRIu64
+			" us, dropped on full queue %"PRIu64"%s", dec->num_threads,
+			dec->jobs, dec->depth_max,
+			dec->jobs ? dec->latency_us_sum / dec->jobs : 0,
+			dec->latency_us_max, dec->dropped, VTY_NEWLINE);
+	}
+
 	llist_for_each_entry(pinst, &plink->instances, list)
 		show_phy_inst_single(vty, pinst);
 }
@@ -254,6 +332,39 @@ DEFUN(cfg_phyinst_maxdlynb, cfg_phyinst_maxdlynb_cmd,
 	return CMD_SUCCESS;
 }
 
+DEFUN(cfg_phyinst_trxd_packed, cfg_phyinst_trxd_packed_cmd,
+	"osmotrx trxd-packed",
+	OSMOTRX_STR
+	"Ask the transceiver for downlink bursts with packed bits (SETPACKED),"
+	" one eighth of the size on the TRXD socket.  Only osmo-bts-trx-fake"
+	" implements it; bursts are sent unpacked if the transceiver rejects"
+	" it, like osmo-trx does.\n")
+{
+	struct phy_instance *pinst = vty->index;
+	struct trx_l1h *l1h = pinst->u.osmotrx.hdl;
+
+	l1h->config.packed = 1;
+	l1h->config.packed_sent = 0;
+	l1if_provision_transceiver_trx(l1h);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phyinst_no_trxd_packed, cfg_phyinst_no_trxd_packed_cmd,
+	"no osmotrx trxd-packed",
+	NO_STR OSMOTRX_STR
+	"Send downlink bursts with unpacked bits\n")
+{
+	struct phy_instance *pinst = vty->index;
+	struct trx_l1h *l1h = pinst->u.osmotrx.hdl;
+
+	l1h->config.packed = 0;
+	if (l1h->trxd_packed)
+		trx_if_cmd_setpacked(l1h, 0);
+
+	return CMD_SUCCESS;
+}
+
 DEFUN(cfg_phyinst_slotmask, cfg_phyinst_slotmask_cmd,
 	"slotmask (1|0) (1|0) (1|0) (1|0) (1|0) (1|0) (1|0) (1|0)",
 	"Set the supported slots\n"
@@ -493,6 +604,135 @@ DEFUN(cfg_phy_no_setbsic, cfg_phy_no_setbsic_cmd,
 	return CMD_SUCCESS;
 }
 
+DEFUN(cfg_phy_tx_batch, cfg_phy_tx_batch_cmd,
+	"osmotrx tx-batch", OSMOTRX_STR
+	"Send all downlink bursts of a TDMA frame with one sendmmsg() call "
+	"per transceiver (applies when the PHY link is opened)\n")
+{
+	struct phy_link *plink = vty->index;
+	plink->u.osmotrx.tx_batch = true;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_no_tx_batch, cfg_phy_no_tx_batch_cmd,
+	"no osmotrx tx-batch",
+	NO_STR OSMOTRX_STR "Send each downlink burst with its own send() call\n")
+{
+	struct phy_link *plink = vty->index;
+	plink->u.osmotrx.tx_batch = false;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_rx_batch, cfg_phy_rx_batch_cmd,
+	"osmotrx rx-batch <1-64>", OSMOTRX_STR
+	"Set the maximum number of uplink bursts read from the TRXD socket "
+	"per wakeup (applies when the PHY link is opened)\n"
+	"Number of bursts\n")
+{
+	struct phy_link *plink = vty->index;
+	plink->u.osmotrx.rx_batch = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_no_rx_batch, cfg_phy_no_rx_batch_cmd,
+	"no osmotrx rx-batch", NO_STR OSMOTRX_STR
+	"Read one uplink burst from the TRXD socket per wakeup\n")
+{
+	struct phy_link *plink = vty->index;
+
+	plink->u.osmotrx.rx_batch = 1;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_clock_disc, cfg_phy_clock_disc_cmd,
+	"osmotrx clock-discipline", OSMOTRX_STR
+	"Continuously retune the FN timer to the transceiver clock, instead "
+	"of catching up whole frames when it has drifted off (default: off, "
+	"as it changes the timing of existing setups)\n")
+{
+	struct phy_link *plink = vty->index;
+
+	plink->u.osmotrx.clock_discipline = true;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_no_clock_disc, cfg_phy_no_clock_disc_cmd,
+	"no osmotrx clock-discipline", NO_STR OSMOTRX_STR
+	"Only correct the FN timer when it is a whole frame off\n")
+{
+	struct phy_link *plink = vty->index;
+
+	plink->u.osmotrx.clock_discipline = false;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_ul_dec_threads, cfg_phy_ul_dec_threads_cmd,
+	"osmotrx ul-decoder-threads <1-32>", OSMOTRX_STR
+	"Decode uplink blocks of SDCCH, SACCH, PDTCH and TCH/F in a pool of "
+	"worker threads (applies when the PHY link is opened)\n"
+	"Number of threads\n")
+{
+	struct phy_link *plink = vty->index;
+
+	plink->u.osmotrx.ul_dec_threads = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_no_ul_dec_threads, cfg_phy_no_ul_dec_threads_cmd,
+	"no osmotrx ul-decoder-threads", NO_STR OSMOTRX_STR
+	"Decode uplink blocks in the main thread\n")
+{
+	struct phy_link *plink = vty->index;
+
+	plink->u.osmotrx.ul_dec_threads = 0;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_auto_advance, cfg_phy_auto_advance_cmd,
+	"osmotrx auto-advance fn <0-30> <0-30> rts <0-30> <0-30>", OSMOTRX_STR
+	"Tune fn-advance and rts-advance to how late bursts and PCU/L2 "
+	"primitives are, starting from the configured values\n"
+	"Bounds of fn-advance\n" "Lowest fn-advance\n" "Highest fn-advance\n"
+	"Bounds of rts-advance\n" "Lowest rts-advance\n" "Highest rts-advance\n")
+{
+	struct phy_link *plink = vty->index;
+	uint32_t fn_min = atoi(argv[0]), fn_max = atoi(argv[1]);
+	uint32_t rts_min = atoi(argv[2]), rts_max = atoi(argv[3]);
+
+	if (fn_min > fn_max || rts_min > rts_max) {
+		vty_out(vty, "%% Lowest advance must not be above the highest%s",
+			VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	plink->u.osmotrx.auto_advance = true;
+	plink->u.osmotrx.clock_advance_min = fn_min;
+	plink->u.osmotrx.clock_advance_max = fn_max;
+	plink->u.osmotrx.rts_advance_min = rts_min;
+	plink->u.osmotrx.rts_advance_max = rts_max;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_no_auto_advance, cfg_phy_no_auto_advance_cmd,
+	"no osmotrx auto-advance", NO_STR OSMOTRX_STR
+	"Keep fn-advance and rts-advance as configured\n")
+{
+	struct phy_link *plink = vty->index;
+
+	plink->u.osmotrx.auto_advance = false;
+
+	return CMD_SUCCESS;
+}
+
 void bts_model_config_write_phy(struct vty *vty, struct phy_link *plink)
 {
 	if (plink->u.osmotrx.local_ip)
@@ -519,9 +759,25 @@ void bts_model_config_write_phy(struct vty *vty, struct phy_link *plink)
 		plink->u.osmotrx.clock_advance, VTY_NEWLINE);
 	vty_out(vty, " osmotrx rts-advance %d%s",
 		plink->u.osmotrx.rts_advance, VTY_NEWLINE);
+	if (plink->u.osmotrx.auto_advance)
+		vty_out(vty, " osmotrx auto-advance fn %u %u rts %u %u%s",
+			plink->u.osmotrx.clock_advance_min,
+			plink->u.osmotrx.clock_advance_max,
+			plink->u.osmotrx.rts_advance_min,
+			plink->u.osmotrx.rts_advance_max, VTY_NEWLINE);
 
 	if (plink->u.osmotrx.use_legacy_setbsic)
 		vty_out(vty, " osmotrx legacy-setbsic%s", VTY_NEWLINE);
+	if (plink->u.osmotrx.tx_batch)
+		vty_out(vty, " osmotrx tx-batch%s", VTY_NEWLINE);
+	if (plink->u.osmotrx.rx_batch != 1)
+		vty_out(vty, " osmotrx rx-batch %u%s",
+			plink->u.osmotrx.rx_batch, VTY_NEWLINE);
+	if (plink->u.osmotrx.clock_discipline)
+		vty_out(vty, " osmotrx clock-discipline%s", VTY_NEWLINE);
+	if (plink->u.osmotrx.ul_dec_threads)
+		vty_out(vty, " osmotrx ul-decoder-threads %u%s",
+			plink->u.osmotrx.ul_dec_threads, VTY_NEWLINE);
 }
 
 void bts_model_config_write_phy_inst(struct vty *vty, struct phy_instance *pinst)
@@ -542,6 +798,8 @@ void bts_model_config_write_phy_inst(struct vty *vty, struct phy_instance *pinst
 		vty_out(vty, "  osmotrx maxdly %d%s", l1h->config.maxdly, VTY_NEWLINE);
 	if (l1h->config.maxdlynb_valid)
 		vty_out(vty, "  osmotrx maxdlynb %d%s", l1h->config.maxdlynb, VTY_NEWLINE);
+	if (l1h->config.packed)
+		vty_out(vty, "  osmotrx trxd-packed%s", VTY_NEWLINE);
 	if (l1h->config.slotmask != 0xff)
 		vty_out(vty, "  slotmask %d %d %d %d %d %d %d %d%s",
 			l1h->config.slotmask & 1,
@@ -581,6 +839,16 @@ int bts_model_vty_init(struct gsm_bts *bts)
 	install_element(PHY_NODE, &cfg_phy_osmotrx_ip_cmd);
 	install_element(PHY_NODE, &cfg_phy_setbsic_cmd);
 	install_element(PHY_NODE, &cfg_phy_no_setbsic_cmd);
+	install_element(PHY_NODE, &cfg_phy_tx_batch_cmd);
+	install_element(PHY_NODE, &cfg_phy_no_tx_batch_cmd);
+	install_element(PHY_NODE, &cfg_phy_rx_batch_cmd);
+	install_element(PHY_NODE, &cfg_phy_no_rx_batch_cmd);
+	install_element(PHY_NODE, &cfg_phy_clock_disc_cmd);
+	install_element(PHY_NODE, &cfg_phy_no_clock_disc_cmd);
+	install_element(PHY_NODE, &cfg_phy_ul_dec_threads_cmd);
+	install_element(PHY_NODE, &cfg_phy_no_ul_dec_threads_cmd);
+	install_element(PHY_NODE, &cfg_phy_auto_advance_cmd);
+	install_element(PHY_NODE, &cfg_phy_no_auto_advance_cmd);
 
 	install_element(PHY_INST_NODE, &cfg_phyinst_rxgain_cmd);
 	install_element(PHY_INST_NODE, &cfg_phyinst_tx_atten_cmd);
@@ -593,11 +861,34 @@ int bts_model_vty_init(struct gsm_bts *bts)
 	install_element(PHY_INST_NODE, &cfg_phyinst_no_maxdly_cmd);
 	install_element(PHY_INST_NODE, &cfg_phyinst_maxdlynb_cmd);
 	install_element(PHY_INST_NODE, &cfg_phyinst_no_maxdlynb_cmd);
+	install_element(PHY_INST_NODE, &cfg_phyinst_trxd_packed_cmd);
+	install_element(PHY_INST_NODE, &cfg_phyinst_no_trxd_packed_cmd);
 
 	return 0;
 }
 
+CTRL_CMD_DEFINE_RO(clock_disc, "clock-discipline");
+static int get_clock_disc(struct ctrl_cmd *cmd, void *data)
+{
+	struct gsm_bts_trx *trx = cmd->node;
+	const struct trx_clock_disc *disc = trx_sched_clock_disc(trx_phy_instance(trx)->phy_link);
+
+	if (!disc) {
+		cmd->reply = "No clock from transceiver yet";
+		return CTRL_CMD_ERROR;
+	}
+
+	cmd->reply = talloc_asprintf(cmd, "%.3f,%.0f,%"PRId64,
+		disc->ppm, disc->jitter_us, disc->interval_ns);
+
+	return CTRL_CMD_REPLY;
+}
+
 int bts_model_ctrl_cmds_install(struct gsm_bts *bts)
 {
-	return 0;
+	int rc = 0;
+
+	rc |= ctrl_cmd_install(CTRL_NODE_TRX, &cmd_clock_disc);
+
+	return rc;
 }
@@ -110,7 +110,7 @@ static void tx_to_virt_um(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 		LOGL1S(DL1P, LOGL_ERROR, l1t, tn, chan, fn, "GSMTAP msg could not be created!\n");
 
 	/* free incoming message */
-	msgb_free(msg);
+	l1sap_msgb_free(msg);
 }
 
 /*
@@ -156,7 +156,7 @@ ubit_t *tx_data_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 		LOGL1S(DL1P, LOGL_FATAL, l1t, tn, chan, fn, "Prim not 23 bytes, please FIX! (len=%d)\n",
 			msgb_l2len(msg));
 		/* free message */
-		msgb_free(msg);
+		l1sap_msgb_free(msg);
 		return NULL;
 	}
 
@@ -256,7 +256,7 @@ inval_mode1:
 				if (l1sap->oph.primitive == PRIM_TCH) {
 					LOGL1S(DL1P, LOGL_FATAL, l1t, tn, chan, fn,
 						"TCH twice, please FIX! ");
-					msgb_free(msg2);
+					l1sap_msgb_free(msg2);
 				} else
 					msg_facch = msg2;
 			}
@@ -267,7 +267,7 @@ inval_mode1:
 				if (l1sap->oph.primitive != PRIM_TCH) {
 					LOGL1S(DL1P, LOGL_FATAL, l1t, tn, chan, fn,
 						"FACCH twice, please FIX! ");
-					msgb_free(msg2);
+					l1sap_msgb_free(msg2);
 				} else
 					msg_tch = msg2;
 			}
@@ -285,7 +285,7 @@ inval_mode1:
 		LOGL1S(DL1P, LOGL_FATAL, l1t, tn, chan, fn, "Prim not 23 bytes, please FIX! (len=%d)\n",
 			msgb_l2len(msg_facch));
 		/* free message */
-		msgb_free(msg_facch);
+		l1sap_msgb_free(msg_facch);
 		msg_facch = NULL;
 	}
 
@@ -391,7 +391,7 @@ inval_mode2:
 				"invalid length! (expecing %d, received %d)\n", len, msgb_l2len(msg_tch));
 free_bad_msg:
 			/* free message */
-			msgb_free(msg_tch);
+			l1sap_msgb_free(msg_tch);
 			msg_tch = NULL;
 			goto send_frame;
 		}
@@ -421,7 +421,7 @@ ubit_t *tx_tchf_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 
 	if (msg_facch) {
 		tx_to_virt_um(l1t, tn, fn, chan, msg_facch);
-		msgb_free(msg_tch);
+		l1sap_msgb_free(msg_tch);
 	} else
 		tx_to_virt_um(l1t, tn, fn, chan, msg_tch);
 
@@ -450,7 +450,7 @@ ubit_t *tx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	if (msg_facch && ((((fn + 4) % 26) >> 2) & 1)) {
 		LOGL1S(DL1P, LOGL_ERROR, l1t, tn, chan, fn, "Cannot transmit FACCH starting on "
 			"even frames, please fix RTS!\n");
-		msgb_free(msg_facch);
+		l1sap_msgb_free(msg_facch);
 		msg_facch = NULL;
 	}
 
@@ -462,7 +462,7 @@ ubit_t *tx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 
 	if (msg_facch) {
 		tx_to_virt_um(l1t, tn, fn, chan, msg_facch);
-		msgb_free(msg_tch);
+		l1sap_msgb_free(msg_tch);
 	} else
 		tx_to_virt_um(l1t, tn, fn, chan, msg_tch);
 
@@ -27,7 +27,8 @@
 #include <osmo-bts/gsm_data.h>
 #include <osmo-bts/l1sap.h>
 
-#include <unistd.h>
+#include <errno.h>
+#include <inttypes.h>
 
 static struct gsm_bts *bts;
 
@@ -51,7 +52,7 @@ static void test_paging_smoke(void)
 	printf("Testing that paging messages expire.\n");
 
 	/* add paging entry */
-	rc = paging_add_identity(bts->paging_state, 0, static_ilv, 0);
+	rc = paging_add_identity(bts->paging_state, 0, static_ilv, 0, PAGING_PRIO_NORMAL);
 	ASSERT_TRUE(rc == 0);
 	ASSERT_TRUE(paging_queue_length(bts->paging_state) == 1);
 
@@ -82,33 +83,289 @@ static void test_paging_smoke(void)
 	 */
 }
 
-static void test_paging_sleep(void)
+static int clock_gen_msg(uint32_t fn)
 {
-	int rc;
 	uint8_t out_buf[GSM_MACBLOCK_LEN];
 	struct gsm_time g_time;
 	int is_empty = -1;
-	printf("Testing that paging messages expire with sleep.\n");
 
-	/* add paging entry */
-	rc = paging_add_identity(bts->paging_state, 0, static_ilv, 0);
+	/* group 0 */
+	memset(&g_time, 0, sizeof(g_time));
+	g_time.fn = fn;
+	g_time.t3 = 6;
+	paging_gen_msg(bts->paging_state, out_buf, &g_time, &is_empty);
+
+	return is_empty;
+}
+
+static void test_paging_clock(void)
+{
+	int rc, is_empty;
+
+	printf("Testing that paging messages expire with the frame clock.\n");
+
+	/* 2 s are three ticks of 204 frames */
+	paging_set_lifetime(bts->paging_state, 2);
+	rc = paging_add_identity(bts->paging_state, 0, static_ilv, 0, PAGING_PRIO_NORMAL);
 	ASSERT_TRUE(rc == 0);
-	ASSERT_TRUE(paging_queue_length(bts->paging_state) == 1);
 
-	/* sleep */
-	sleep(1);
+	is_empty = clock_gen_msg(0);
+	printf(" fn=0: %s, queue length %d\n", is_empty ? "empty" : "paged",
+		paging_queue_length(bts->paging_state));
+	is_empty = clock_gen_msg(2 * 204);
+	printf(" fn=408: %s, queue length %d\n", is_empty ? "empty" : "paged",
+		paging_queue_length(bts->paging_state));
+	is_empty = clock_gen_msg(3 * 204);
+	printf(" fn=612: %s, queue length %d\n", is_empty ? "empty" : "paged",
+		paging_queue_length(bts->paging_state));
 
-	/* generate messages */
-	g_time.fn = 0;
-	g_time.t1 = 0;
-	g_time.t2 = 0;
+	paging_set_lifetime(bts->paging_state, 0);
+}
+
+/* queue the identities given by a string of 'T' (TMSI) and 'I' (IMSI) in
+ * group 0, the first one at the head, and page them until the queue is
+ * empty (lifetime 0) */
+static void pack_queue(const char *ids)
+{
+	uint8_t tmsi_lv[] = { 0x05, 0xf4, 0x00, 0x00, 0x00, 0x00 };
+	uint8_t imsi_lv[sizeof(static_ilv)];
+	uint8_t out_buf[GSM_MACBLOCK_LEN];
+	struct gsm_time g_time;
+	int i, rc, len, is_empty;
+
+	printf(" %s:", ids);
+
+	/* records are queued at the head */
+	for (i = strlen(ids) - 1; i >= 0; i--) {
+		if (ids[i] == 'T') {
+			tmsi_lv[5] = i;
+			rc = paging_add_identity(bts->paging_state, 0, tmsi_lv, 0, PAGING_PRIO_NORMAL);
+		} else {
+			memcpy(imsi_lv, static_ilv, sizeof(imsi_lv));
+			imsi_lv[8] = i;
+			rc = paging_add_identity(bts->paging_state, 0, imsi_lv, 0, PAGING_PRIO_NORMAL);
+		}
+		ASSERT_TRUE(rc == 0);
+	}
+
+	memset(&g_time, 0, sizeof(g_time));
 	g_time.t3 = 6;
-	rc = paging_gen_msg(bts->paging_state, out_buf, &g_time, &is_empty);
-	ASSERT_TRUE(rc == 13);
-	ASSERT_TRUE(is_empty == 0);
+	while (!paging_group_queue_empty(bts->paging_state, 0)) {
+		len = paging_queue_length(bts->paging_state);
+		paging_gen_msg(bts->paging_state, out_buf, &g_time, &is_empty);
+		printf(" type %u (%d)", out_buf[2] == GSM48_MT_RR_PAG_REQ_3 ? 3 :
+			out_buf[2] == GSM48_MT_RR_PAG_REQ_2 ? 2 : 1,
+			len - paging_queue_length(bts->paging_state));
+	}
+	printf("\n");
+}
+
+static void test_paging_packing(void)
+{
+	struct rate_ctr *ctr = bts->ctrs->ctr;
+	uint64_t ids[4];
+	int i;
+
+	printf("Testing packing of paging blocks.\n");
+
+	for (i = 0; i < 4; i++)
+		ids[i] = ctr[BTS_CTR_PAGING_IDS_1 + i].current;
+
+	pack_queue("ITITTTT");
+	pack_queue("TITTT");
+	pack_queue("TTTI");
+	pack_queue("IIT");
+
+	for (i = 0; i < 4; i++)
+		printf(" blocks with %d identities: %"PRIu64"\n", i + 1,
+			ctr[BTS_CTR_PAGING_IDS_1 + i].current - ids[i]);
+}
+
+static int prio_add(uint8_t id, enum paging_prio prio)
+{
+	uint8_t imsi_lv[sizeof(static_ilv)];
+
+	memcpy(imsi_lv, static_ilv, sizeof(imsi_lv));
+	imsi_lv[8] = id;
+	return paging_add_identity(bts->paging_state, 0, imsi_lv, 0, prio);
+}
+
+static void test_paging_prio(void)
+{
+	struct rate_ctr *ctr = bts->ctrs->ctr;
+	uint8_t out_buf[GSM_MACBLOCK_LEN];
+	struct gsm_time g_time;
+	uint64_t first_n, first_e, delay_n, delay_e, drop_n;
+	int i, rc, is_empty;
+
+	printf("Testing priority classes of paging.\n");
+
+	first_n = ctr[BTS_CTR_PAGING_FIRST_NORMAL].current;
+	first_e = ctr[BTS_CTR_PAGING_FIRST_EMERG].current;
+	delay_n = ctr[BTS_CTR_PAGING_DELAY_NORMAL].current;
+	delay_e = ctr[BTS_CTR_PAGING_DELAY_EMERG].current;
+
+	/* queue at fn 0 */
+	memset(&g_time, 0, sizeof(g_time));
+	g_time.t3 = 6;
+	paging_gen_msg(bts->paging_state, out_buf, &g_time, &is_empty);
 
+	for (i = 0; i < 4; i++)
+		ASSERT_TRUE(prio_add(i, PAGING_PRIO_NORMAL) == 0);
+	for (i = 4; i < 6; i++)
+		ASSERT_TRUE(prio_add(i, PAGING_PRIO_EMERG) == 0);
+
+	/* the emergency pages go first, though queued last */
+	g_time.fn = 102;
+	for (i = 1; !paging_group_queue_empty(bts->paging_state, 0); i++) {
+		paging_gen_msg(bts->paging_state, out_buf, &g_time, &is_empty);
+		printf(" block %d: emergency %"PRIu64", normal %"PRIu64"\n", i,
+			ctr[BTS_CTR_PAGING_FIRST_EMERG].current - first_e,
+			ctr[BTS_CTR_PAGING_FIRST_NORMAL].current - first_n);
+	}
+	printf(" delay: emergency %"PRIu64" ms, normal %"PRIu64" ms\n",
+		ctr[BTS_CTR_PAGING_DELAY_EMERG].current - delay_e,
+		ctr[BTS_CTR_PAGING_DELAY_NORMAL].current - delay_n);
+
+	/* a full queue makes room for a higher class only */
+	drop_n = ctr[BTS_CTR_PAGING_DROP_NORMAL].current;
+	paging_set_queue_max(bts->paging_state, 2);
+	ASSERT_TRUE(prio_add(0, PAGING_PRIO_NORMAL) == 0);
+	ASSERT_TRUE(prio_add(1, PAGING_PRIO_NORMAL) == 0);
+	rc = prio_add(2, PAGING_PRIO_EMERG);
+	printf(" full queue: emergency rc=%d", rc);
+	rc = prio_add(3, PAGING_PRIO_NORMAL);
+	printf(", normal rc=%d, normal drops %"PRIu64", queue length %d\n", rc,
+		ctr[BTS_CTR_PAGING_DROP_NORMAL].current - drop_n,
+		paging_queue_length(bts->paging_state));
+
+	paging_reset(bts->paging_state);
+	paging_set_queue_max(bts->paging_state, 200);
+}
+
+static void print_load(void)
+{
+	unsigned int pch_load, lifetime, group_len_max;
+
+	paging_load_stats(bts->paging_state, &pch_load, &lifetime, &group_len_max);
+	printf(" load %u%%: lifetime %u s, group queue limit %u\n",
+		pch_load, lifetime, group_len_max);
+}
+
+static void test_paging_load(void)
+{
+	uint8_t out_buf[GSM_MACBLOCK_LEN];
+	struct gsm_time g_time;
+	int i, rc, is_empty;
+
+	printf("Testing load-adaptive paging limits.\n");
+
+	paging_reset(bts->paging_state);
+	paging_set_queue_max(bts->paging_state, 20);
+	paging_set_lifetime(bts->paging_state, 10);
+
+	paging_update_load(bts->paging_state, 100);
+	print_load();
+	paging_update_load(bts->paging_state, 100);
+	print_load();
+
+	/* the group is full of pages not sent yet */
+	for (i = 0; i < 10; i++)
+		ASSERT_TRUE(prio_add(i, PAGING_PRIO_NORMAL) == 0);
+	rc = prio_add(10, PAGING_PRIO_NORMAL);
+	printf(" group queue limit: rc=%d", rc);
+
+	/* the two pages sent make room */
+	memset(&g_time, 0, sizeof(g_time));
+	g_time.t3 = 6;
+	paging_gen_msg(bts->paging_state, out_buf, &g_time, &is_empty);
+	printf(", after a block");
+	for (i = 10; i < 13; i++)
+		printf(" rc=%d", prio_add(i, PAGING_PRIO_NORMAL));
+	printf(", queue length %d\n", paging_queue_length(bts->paging_state));
+
+	paging_update_load(bts->paging_state, 100);
+	print_load();
+	paging_update_load(bts->paging_state, 100);
+	print_load();
+	paging_update_load(bts->paging_state, 0);
+	print_load();
+
+	paging_reset(bts->paging_state);
+	paging_set_queue_max(bts->paging_state, 200);
+	paging_set_lifetime(bts->paging_state, 0);
+}
+
+/* identity number i of the high volume test: TMSIs, then IMSIs */
+static const uint8_t *volume_ilv(unsigned int i)
+{
+	static uint8_t ilv[9];
+	uint32_t tmsi = i * 2654435761U;
+
+	if (i < 2000) {
+		ilv[0] = 0x05;
+		ilv[1] = 0xf4;
+		memcpy(ilv + 2, &tmsi, sizeof(tmsi));
+	} else {
+		memcpy(ilv, static_ilv, sizeof(static_ilv));
+		ilv[7] = i >> 8;
+		ilv[8] = i & 0xff;
+	}
+
+	return ilv;
+}
+
+static void volume_add(const char *what, unsigned int n)
+{
+	unsigned int i, added = 0, dups = 0;
+	int rc;
+
+	for (i = 0; i < n; i++) {
+		rc = paging_add_identity(bts->paging_state, i % 2, volume_ilv(i), 0, PAGING_PRIO_NORMAL);
+		if (rc == 0)
+			added++;
+		else if (rc == -EEXIST)
+			dups++;
+	}
+
+	printf(" %s: %u added, %u duplicates, queue length %d\n", what,
+		added, dups, paging_queue_length(bts->paging_state));
+}
+
+static void test_paging_high_volume(void)
+{
+	uint8_t out_buf[GSM_MACBLOCK_LEN];
+	struct gsm_time g_time;
+	unsigned int size, used, used_max;
+	int i, is_empty;
+
+	printf("Testing duplicate detection with many paging records.\n");
+
+	paging_set_queue_max(bts->paging_state, 3000);
+
+	volume_add("first", 3000);
+	volume_add("again", 3000);
+
+	/* send all of group 0, which expires them (lifetime 0) */
+	memset(&g_time, 0, sizeof(g_time));
+	g_time.t3 = 6;
+	for (i = 0; i < 3000; i++) {
+		if (paging_group_queue_empty(bts->paging_state, 0))
+			break;
+		paging_gen_msg(bts->paging_state, out_buf, &g_time, &is_empty);
+	}
 	ASSERT_TRUE(paging_group_queue_empty(bts->paging_state, 0));
+	volume_add("group 0 expired", 3000);
+
+	paging_reset(bts->paging_state);
 	ASSERT_TRUE(paging_queue_length(bts->paging_state) == 0);
+	volume_add("after reset", 3000);
+
+	paging_reset(bts->paging_state);
+	paging_set_queue_max(bts->paging_state, 200);
+
+	paging_pool_stats(bts->paging_state, &size, &used, &used_max);
+	printf(" pool: %u records, %u in use, peak %u\n", size, used, used_max);
 }
 
 /* Set up a dummy trx with a valid setting for bs_ag_blks_res in SI3 */
@@ -178,7 +435,11 @@ int main(int argc, char **argv)
 	}
 
 	test_paging_smoke();
-	test_paging_sleep();
+	test_paging_clock();
+	test_paging_packing();
+	test_paging_prio();
+	test_paging_load();
+	test_paging_high_volume();
 	test_is_ccch_for_agch();
 	printf("Success\n");
 
@@ -0,0 +1,786 @@
+/* testing the L1 scheduler's frame dispatch */
+
+/* This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/application.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/gsm/a5.h>
+#include <osmocom/gsm/protocol/gsm_08_58.h>
+
+#include <osmo-bts/bts.h>
+#include <osmo-bts/logging.h>
+#include <osmo-bts/l1sap.h>
+#include <osmo-bts/scheduler.h>
+#include <osmo-bts/scheduler_backend.h>
+
+static void *ctx;
+
+/* last call into the backend, as seen by the stubs below */
+struct backend_call {
+	int calls;
+	uint32_t fn;
+	enum trx_chan_type chan;
+	uint8_t bid;
+	const void *func;
+};
+static struct backend_call last;
+
+/* bursts handed out by / to the backend stubs */
+static ubit_t tx_bits[GSM_BURST_LEN];
+static sbit_t rx_bits[GSM_BURST_LEN];
+/* bursts of skipped frames, handed to the backend without bits */
+static unsigned int rx_missed;
+
+static void tx_pattern(ubit_t *bits, uint32_t fn)
+{
+	int i;
+
+	for (i = 0; i < GSM_BURST_LEN; i++)
+		bits[i] = ((fn * 7 + i * 13) >> 2) & 1;
+}
+
+static void rx_pattern(sbit_t *bits, uint32_t fn)
+{
+	int i;
+
+	for (i = 0; i < GSM_BURST_LEN; i++)
+		bits[i] = (int)((fn + i * 31) % 255) - 127;
+}
+
+static void record(const void *func, uint32_t fn, enum trx_chan_type chan, uint8_t bid)
+{
+	last.calls++;
+	last.fn = fn;
+	last.chan = chan;
+	last.bid = bid;
+	last.func = func;
+}
+
+/*
+ * stubs of the scheduler backend
+ */
+
+#define TX_STUB(name)							\
+ubit_t *name(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,		\
+	enum trx_chan_type chan, uint8_t bid, uint16_t *nbits)		\
+{									\
+	record(name, fn, chan, bid);					\
+	if (nbits)							\
+		*nbits = GSM_BURST_LEN;					\
+	tx_pattern(tx_bits, fn);					\
+	return tx_bits;							\
+}
+
+#define RX_STUB(name)							\
+int name(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,		\
+	enum trx_chan_type chan, uint8_t bid, sbit_t *bits, uint16_t nbits, \
+	int8_t rssi, int16_t toa256)					\
+{									\
+	record(name, fn, chan, bid);					\
+	if (bits)							\
+		memcpy(rx_bits, bits, sizeof(rx_bits));			\
+	else								\
+		rx_missed++;						\
+	return 0;							\
+}
+
+TX_STUB(tx_idle_fn)
+TX_STUB(tx_fcch_fn)
+TX_STUB(tx_sch_fn)
+TX_STUB(tx_data_fn)
+TX_STUB(tx_pdtch_fn)
+TX_STUB(tx_tchf_fn)
+TX_STUB(tx_tchh_fn)
+RX_STUB(rx_rach_fn)
+RX_STUB(rx_data_fn)
+RX_STUB(rx_pdtch_fn)
+RX_STUB(rx_tchf_fn)
+RX_STUB(rx_tchh_fn)
+
+void _sched_act_rach_det(struct l1sched_trx *l1t, uint8_t tn, uint8_t ss, int activate)
+{
+}
+
+/*
+ * reference dispatch, looking up the frame layout and the channel
+ * description on every burst, like the scheduler used to do
+ */
+
+static void ref_dl_burst(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+	const struct trx_sched_frame *frame;
+	enum trx_chan_type chan;
+	uint16_t nbits;
+
+	frame = l1ts->mf_frames + fn % l1ts->mf_period;
+	chan = frame->dl_chan;
+
+	if (!trx_chan_desc[chan].auto_active && !l1ts->chan_state[chan].active)
+		return;
+
+	trx_chan_desc[chan].dl_fn(l1t, tn, fn, chan, frame->dl_bid, &nbits);
+}
+
+static void ref_ul_burst(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
+			 sbit_t *bits)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+	const struct trx_sched_frame *frame;
+	enum trx_chan_type chan;
+
+	frame = l1ts->mf_frames + fn % l1ts->mf_period;
+	chan = frame->ul_chan;
+
+	if (!trx_chan_desc[chan].auto_active && !l1ts->chan_state[chan].active)
+		return;
+	if (!trx_chan_desc[chan].ul_fn)
+		return;
+
+	trx_chan_desc[chan].ul_fn(l1t, tn, fn, chan, frame->ul_bid,
+				  bits, GSM_BURST_LEN, -60, 0);
+}
+
+/* (de)activate every other logical channel of a timeslot, so that both
+ * the active and the inactive case of the plan are covered */
+static void set_lchans(struct l1sched_trx *l1t, uint8_t tn, int odd)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+	int pdch = trx_sched_multiframes[l1ts->mf_index].pchan == GSM_PCHAN_PDCH;
+	int i;
+
+	for (i = 0; i < _TRX_CHAN_MAX; i++) {
+		if (trx_chan_desc[i].auto_active || trx_chan_desc[i].pdch != pdch)
+			continue;
+		trx_sched_set_lchan(l1t, trx_chan_desc[i].chan_nr | tn,
+				    trx_chan_desc[i].link_id, (i & 1) == odd);
+	}
+}
+
+static int check_plan(struct l1sched_trx *l1t, uint8_t tn)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+	int i;
+
+	for (i = 0; i < l1ts->mf_period; i++) {
+		const struct trx_sched_frame *frame = &l1ts->mf_frames[i];
+		const struct l1sched_frame_plan *plan = &l1ts->mf_plan[i];
+		trx_sched_rts_func *rts_fn;
+
+		rts_fn = frame->dl_bid ? NULL : trx_chan_desc[frame->dl_chan].rts_fn;
+		OSMO_ASSERT(plan->rts_fn == rts_fn);
+		OSMO_ASSERT(plan->dl_fn == trx_chan_desc[frame->dl_chan].dl_fn);
+		OSMO_ASSERT(plan->ul_fn == trx_chan_desc[frame->ul_chan].ul_fn);
+		OSMO_ASSERT(plan->dl_chan == frame->dl_chan);
+		OSMO_ASSERT(plan->ul_chan == frame->ul_chan);
+		OSMO_ASSERT(plan->dl_bid == frame->dl_bid);
+		OSMO_ASSERT(plan->ul_bid == frame->ul_bid);
+		OSMO_ASSERT(plan->dl_active == (trx_chan_desc[frame->dl_chan].auto_active
+			|| l1ts->chan_state[frame->dl_chan].active));
+		OSMO_ASSERT(plan->ul_active == (trx_chan_desc[frame->ul_chan].auto_active
+			|| l1ts->chan_state[frame->ul_chan].active));
+	}
+
+	return l1ts->mf_period;
+}
+
+/* run two multiframes through the scheduler and the reference dispatch,
+ * both must call the same backend function with the same arguments */
+static int check_dispatch(struct l1sched_trx *l1t, uint8_t tn)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+	sbit_t bits[GSM_BURST_LEN];
+	uint32_t fn, fn_start = 2 * 104 * 51;
+	int calls = 0;
+
+	memset(bits, 0, sizeof(bits));
+	l1ts->mf_last_fn = fn_start - 1;
+
+	for (fn = fn_start; fn < fn_start + 2 * l1ts->mf_period; fn++) {
+		struct backend_call sched;
+		uint16_t nbits;
+
+		memset(&last, 0, sizeof(last));
+		_sched_dl_burst(l1t, tn, fn, &nbits);
+		sched = last;
+		memset(&last, 0, sizeof(last));
+		ref_dl_burst(l1t, tn, fn);
+		OSMO_ASSERT(memcmp(&sched, &last, sizeof(last)) == 0);
+		calls += sched.calls;
+
+		memset(&last, 0, sizeof(last));
+		trx_sched_ul_burst(l1t, tn, fn, bits, GSM_BURST_LEN, -60, 0);
+		sched = last;
+		memset(&last, 0, sizeof(last));
+		ref_ul_burst(l1t, tn, fn, bits);
+		OSMO_ASSERT(memcmp(&sched, &last, sizeof(last)) == 0);
+		calls += sched.calls;
+	}
+
+	return calls;
+}
+
+static const enum gsm_phys_chan_config test_pchans[] = {
+	GSM_PCHAN_CCCH,
+	GSM_PCHAN_CCCH_SDCCH4,
+	GSM_PCHAN_CCCH_SDCCH4_CBCH,
+	GSM_PCHAN_SDCCH8_SACCH8C,
+	GSM_PCHAN_SDCCH8_SACCH8C_CBCH,
+	GSM_PCHAN_TCH_F,
+	GSM_PCHAN_TCH_H,
+	GSM_PCHAN_PDCH,
+};
+
+static void test_frame_plan(struct l1sched_trx *l1t)
+{
+	int i, odd;
+	uint8_t tn;
+
+	printf("Testing frame dispatch plan\n");
+
+	for (i = 0; i < ARRAY_SIZE(test_pchans); i++) {
+		enum gsm_phys_chan_config pchan = test_pchans[i];
+		int frames = 0, calls = 0;
+
+		for (tn = 0; tn < TRX_NR_TS; tn++) {
+			if (trx_sched_set_pchan(l1t, tn, pchan) < 0)
+				continue;
+			frames += check_plan(l1t, tn);
+			for (odd = 0; odd < 2; odd++) {
+				set_lchans(l1t, tn, odd);
+				check_plan(l1t, tn);
+				calls += check_dispatch(l1t, tn);
+			}
+			set_lchans(l1t, tn, -1);
+			check_plan(l1t, tn);
+			trx_sched_set_pchan(l1t, tn, GSM_PCHAN_NONE);
+		}
+
+		printf(" %s: %d frames planned, dispatch %s\n",
+			gsm_pchan_name(pchan), frames, calls ? "matches" : "missing");
+	}
+}
+
+/* size of the burst buffers the trx backend expects */
+static unsigned int bursts_size(enum trx_chan_type chan, int ul)
+{
+	switch (chan) {
+	case TRXC_IDLE:
+	case TRXC_FCCH:
+	case TRXC_SCH:
+	case TRXC_RACH:
+		return 0;
+	case TRXC_TCHF:
+		return ul ? 1392 : 928;
+	case TRXC_TCHH_0:
+	case TRXC_TCHH_1:
+		return ul ? 1160 : 696;
+	case TRXC_PDTCH:
+		return 1392;	/* 4 8PSK bursts, GSM0503_EGPRS_BURSTS_NBITS */
+	default:
+		return 464;
+	}
+}
+
+/* check that all channels of the layout of a timeslot have their burst
+ * buffers, aligned, inside the arena and not overlapping each other */
+static void check_bursts(struct l1sched_trx *l1t, uint8_t tn)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+	const uint8_t *arena = l1t->bursts_arena;
+	const uint8_t *buf[2 * _TRX_CHAN_MAX];
+	unsigned int len[2 * _TRX_CHAN_MAX];
+	int i, j, n = 0;
+
+	for (i = 0; i < l1ts->mf_period; i++) {
+		const struct trx_sched_frame *frame = &l1ts->mf_frames[i];
+		if (bursts_size(frame->dl_chan, 0) && trx_chan_desc[frame->dl_chan].dl_fn)
+			OSMO_ASSERT(l1ts->chan_state[frame->dl_chan].dl_bursts);
+		if (bursts_size(frame->ul_chan, 1) && trx_chan_desc[frame->ul_chan].ul_fn)
+			OSMO_ASSERT(l1ts->chan_state[frame->ul_chan].ul_bursts);
+	}
+
+	for (i = 0; i < _TRX_CHAN_MAX; i++) {
+		const uint8_t *dl = (const uint8_t *)l1ts->chan_state[i].dl_bursts;
+		const uint8_t *ul = (const uint8_t *)l1ts->chan_state[i].ul_bursts;
+		if (dl) {
+			buf[n] = dl;
+			len[n++] = bursts_size(i, 0);
+		}
+		if (ul) {
+			buf[n] = ul;
+			len[n++] = bursts_size(i, 1);
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		OSMO_ASSERT(((uintptr_t)buf[i] & 63) == 0);
+		OSMO_ASSERT(buf[i] >= arena);
+		OSMO_ASSERT(buf[i] + len[i] <= arena + talloc_get_size(arena));
+		for (j = 0; j < i; j++)
+			OSMO_ASSERT(buf[i] + len[i] <= buf[j] || buf[j] + len[j] <= buf[i]);
+	}
+}
+
+static void test_bursts_arena(struct l1sched_trx *l1t)
+{
+	int i;
+	uint8_t tn;
+
+	printf("Testing burst buffer arena\n");
+
+	for (i = 0; i < ARRAY_SIZE(test_pchans); i++) {
+		enum gsm_phys_chan_config pchan = test_pchans[i];
+		struct l1sched_ts *l1ts;
+		ubit_t *dl[_TRX_CHAN_MAX];
+		int c;
+
+		for (tn = 0; tn < TRX_NR_TS; tn++) {
+			if (trx_sched_set_pchan(l1t, tn, pchan) < 0)
+				continue;
+			l1ts = l1sched_trx_get_ts(l1t, tn);
+			check_bursts(l1t, tn);
+
+			/* activation must keep the buffers and clear them */
+			for (c = 0; c < _TRX_CHAN_MAX; c++) {
+				dl[c] = l1ts->chan_state[c].dl_bursts;
+				if (dl[c])
+					memset(dl[c], 1, bursts_size(c, 0));
+			}
+			set_lchans(l1t, tn, 0);
+			set_lchans(l1t, tn, 1);
+			for (c = 0; c < _TRX_CHAN_MAX; c++) {
+				OSMO_ASSERT(l1ts->chan_state[c].dl_bursts == dl[c]);
+				if (dl[c] && !trx_chan_desc[c].auto_active)
+					OSMO_ASSERT(dl[c][0] == 0);
+			}
+			set_lchans(l1t, tn, -1);
+			trx_sched_set_pchan(l1t, tn, GSM_PCHAN_NONE);
+		}
+
+		printf(" %s: burst buffers assigned\n", gsm_pchan_name(pchan));
+	}
+}
+
+static uint32_t ring_rand_state;
+
+static uint32_t ring_rand(void)
+{
+	ring_rand_state = ring_rand_state * 1103515245 + 12345;
+	return ring_rand_state >> 16;
+}
+
+/* feed random TCH blocks into the uplink de-interleaving ring and compare
+ * each window with the buffer as it was kept before: new block at the end,
+ * shifted by one block after decoding */
+static void check_ul_ring(struct l1sched_trx *l1t, uint8_t tn,
+			  enum trx_chan_type chan, unsigned int num_blocks)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+	struct l1sched_chan_state *chan_state = &l1ts->chan_state[chan];
+	unsigned int bursts = chan == TRXC_TCHF ? 4 : 2;
+	unsigned int win = chan == TRXC_TCHF ? 928 : 696;
+	unsigned int last = win - bursts * 116;
+	sbit_t ref[928], zero[116], bits[GSM_BURST_LEN];
+	unsigned int n, bid, i;
+	sbit_t *out;
+
+	trx_sched_set_lchan(l1t, trx_chan_desc[chan].chan_nr | tn,
+			    trx_chan_desc[chan].link_id, 1);
+
+	ring_rand_state = chan;
+	memset(ref, 0, sizeof(ref));
+	memset(zero, 0, sizeof(zero));
+
+	for (n = 0; n < num_blocks; n++) {
+		chan_state->ul_mask = 0;
+		memset(ref + last, 0, bursts * 116);
+		for (bid = 0; bid < bursts; bid++) {
+			/* lose some of the bursts in between */
+			if (bid > 0 && bid < bursts - 1 && ring_rand() % 5 == 0)
+				continue;
+			for (i = 0; i < GSM_BURST_LEN; i++)
+				bits[i] = (sbit_t)ring_rand();
+			chan_state->ul_mask |= 1 << bid;
+			_sched_ul_ring_burst(chan_state, chan, bid, bits);
+			memcpy(ref + last + bid * 116, bits + 3, 58);
+			memcpy(ref + last + bid * 116 + 58, bits + 87, 58);
+		}
+		out = _sched_ul_ring_block(chan_state, chan);
+		OSMO_ASSERT(!memcmp(out, ref, win));
+		memmove(ref, ref + bursts * 116, last);
+	}
+
+	/* a lost first burst is an erasure, not what the ring held before */
+	chan_state->ul_mask = 1 << (bursts - 1);
+	_sched_ul_ring_burst(chan_state, chan, bursts - 1, bits);
+	out = _sched_ul_ring_block(chan_state, chan);
+	OSMO_ASSERT(!memcmp(out, ref, last));
+	OSMO_ASSERT(!memcmp(out + last, zero, 116));
+
+	trx_sched_set_lchan(l1t, trx_chan_desc[chan].chan_nr | tn,
+			    trx_chan_desc[chan].link_id, 0);
+
+	printf(" %s: %u blocks match the shifted buffer\n",
+		trx_chan_desc[chan].name, num_blocks);
+}
+
+static void test_ul_ring(struct l1sched_trx *l1t)
+{
+	printf("Testing UL de-interleaving ring\n");
+
+	trx_sched_set_pchan(l1t, 2, GSM_PCHAN_TCH_F);
+	check_ul_ring(l1t, 2, TRXC_TCHF, 1000);
+	trx_sched_set_pchan(l1t, 2, GSM_PCHAN_TCH_H);
+	check_ul_ring(l1t, 2, TRXC_TCHH_0, 1000);
+	check_ul_ring(l1t, 2, TRXC_TCHH_1, 1000);
+	trx_sched_set_pchan(l1t, 2, GSM_PCHAN_NONE);
+}
+
+static void data_req_msg(struct l1sched_trx *l1t, struct msgb *msg,
+			 enum trx_chan_type chan, uint8_t tn, uint32_t fn)
+{
+	struct osmo_phsap_prim *l1sap = msgb_l1sap_prim(msg);
+
+	osmo_prim_init(&l1sap->oph, SAP_GSM_PH, PRIM_PH_DATA, PRIM_OP_REQUEST, msg);
+	l1sap->u.data.chan_nr = trx_chan_desc[chan].chan_nr | tn;
+	l1sap->u.data.link_id = trx_chan_desc[chan].link_id;
+	l1sap->u.data.fn = fn;
+	msg->l2h = msgb_put(msg, GSM_MACBLOCK_LEN);
+	memset(msg->l2h, 0x2b, GSM_MACBLOCK_LEN);
+
+	trx_sched_ph_data_req(l1t, l1sap);
+}
+
+static void data_req(struct l1sched_trx *l1t, enum trx_chan_type chan,
+		     uint8_t tn, uint32_t fn)
+{
+	data_req_msg(l1t, l1sap_msgb_alloc(GSM_MACBLOCK_LEN), chan, tn, fn);
+}
+
+static void dequeue(struct l1sched_trx *l1t, enum trx_chan_type chan,
+		    uint8_t tn, uint32_t fn)
+{
+	struct msgb *msg = _sched_dequeue_prim(l1t, tn, fn, chan);
+
+	if (msg) {
+		printf(" fn=%u: prim for fn=%u\n", fn, msgb_l1sap_prim(msg)->u.data.fn);
+		l1sap_msgb_free(msg);
+	} else
+		printf(" fn=%u: none\n", fn);
+}
+
+static void test_prim_ring(struct l1sched_trx *l1t)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, 0);
+	uint32_t fn = 1000;
+	uint16_t nbits;
+
+	printf("Testing DL prim ring\n");
+
+	trx_sched_set_pchan(l1t, 0, GSM_PCHAN_CCCH);
+
+	/* same bucket as fn, but out of range */
+	data_req(l1t, TRXC_BCCH, 0, fn + TRX_SCHED_PRIM_RING);
+	data_req(l1t, TRXC_BCCH, 0, fn + 2);
+	data_req(l1t, TRXC_BCCH, 0, fn);
+	data_req(l1t, TRXC_BCCH, 0, fn + 1);
+
+	dequeue(l1t, TRXC_BCCH, 0, fn);
+	dequeue(l1t, TRXC_BCCH, 0, fn + 1);
+	printf(" %u stale prims dropped\n", l1ts->dl_prims_dropped);
+
+	/* prim of fn + 2 is not picked up and expires one frame later */
+	_sched_dl_burst(l1t, 0, fn + 3, &nbits);
+	dequeue(l1t, TRXC_BCCH, 0, fn + 2);
+	printf(" %u stale prims dropped\n", l1ts->dl_prims_dropped);
+
+	/* wrap around at the end of the hyperframe */
+	data_req(l1t, TRXC_BCCH, 0, GSM_HYPERFRAME - 1);
+	data_req(l1t, TRXC_BCCH, 0, 0);
+	dequeue(l1t, TRXC_BCCH, 0, GSM_HYPERFRAME - 1);
+	_sched_dl_burst(l1t, 0, 0, &nbits);
+	dequeue(l1t, TRXC_BCCH, 0, 0);
+	printf(" %u stale prims dropped\n", l1ts->dl_prims_dropped);
+
+	trx_sched_set_pchan(l1t, 0, GSM_PCHAN_NONE);
+}
+
+/* a preallocated msgb survives being freed, and is only marked free */
+static void test_prim_slot(struct l1sched_trx *l1t)
+{
+	struct msgb *msg = l1sap_msgb_alloc(GSM_MACBLOCK_LEN);
+	void *ctx = talloc_parent(msg);
+	size_t blocks;
+
+	printf("Testing DL prim in a preallocated msgb\n");
+
+	l1sap_msgb_slot(msg) = L1SAP_MSGB_SLOT_BUSY;
+	blocks = talloc_total_blocks(ctx);
+	l1sap_msgb_free(msg);
+	printf(" handed back: %s, still allocated: %s\n",
+	       l1sap_msgb_slot(msg) == L1SAP_MSGB_SLOT_FREE ? "yes" : "no",
+	       talloc_total_blocks(ctx) == blocks ? "yes" : "no");
+
+	/* reused for a prim which goes through the prim ring */
+	l1sap_msgb_reset(msg);
+	l1sap_msgb_slot(msg) = L1SAP_MSGB_SLOT_BUSY;
+	trx_sched_set_pchan(l1t, 0, GSM_PCHAN_CCCH);
+	data_req_msg(l1t, msg, TRXC_BCCH, 0, 2000);
+	dequeue(l1t, TRXC_BCCH, 0, 2000);
+	printf(" handed back: %s\n",
+	       l1sap_msgb_slot(msg) == L1SAP_MSGB_SLOT_FREE ? "yes" : "no");
+	trx_sched_set_pchan(l1t, 0, GSM_PCHAN_NONE);
+
+	msgb_free(msg);
+}
+
+static void test_prim_slack(struct l1sched_trx *l1t)
+{
+	const int frames[] = { -1, 0, 1, 2, 3, 4, 5, 8, 9, 16, 17, 32, 33, 1000 };
+	unsigned int i;
+
+	printf("Testing DL prim slack\n");
+
+	printf(" bins:");
+	for (i = 0; i < ARRAY_SIZE(frames); i++)
+		printf(" %d->%u", frames[i], trx_sched_slack_bin(frames[i]));
+	printf("\n");
+
+	trx_sched_set_pchan(l1t, 0, GSM_PCHAN_CCCH);
+
+	l1t->dl_fn = 1000;
+	l1t->dl_fn_valid = 1;
+	data_req(l1t, TRXC_BCCH, 0, 1005);
+	data_req(l1t, TRXC_BCCH, 0, 1001);
+	data_req(l1t, TRXC_BCCH, 0, 1000);
+	data_req(l1t, TRXC_BCCH, 0, 999);
+	/* across the wrap of the hyperframe */
+	l1t->dl_fn = GSM_HYPERFRAME - 1;
+	data_req(l1t, TRXC_BCCH, 0, 1);
+
+	for (i = 0; i < TRX_SCHED_SLACK_BINS; i++) {
+		if (l1t->dl_prim_slack[i])
+			printf(" bin %u: %"PRIu64"\n", i, l1t->dl_prim_slack[i]);
+	}
+	printf(" least slack: %d\n", l1t->dl_prim_slack_min);
+
+	l1t->dl_fn_valid = 0;
+	trx_sched_set_pchan(l1t, 0, GSM_PCHAN_NONE);
+}
+
+/* run ciphered TCH/F bursts through the scheduler and compare them with
+ * the keystream of osmo_a5() applied bit by bit */
+static void check_cipher(struct l1sched_trx *l1t, int algo, uint8_t *ul_key)
+{
+	uint8_t key[8] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6 };
+	const uint8_t tn = 1;
+	ubit_t dl_ref[GSM_BURST_LEN], ks[114];
+	sbit_t ul[GSM_BURST_LEN], ul_ref[GSM_BURST_LEN];
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+	uint16_t nbits;
+	int i, n;
+
+	trx_sched_set_pchan(l1t, tn, GSM_PCHAN_TCH_F);
+	trx_sched_set_lchan(l1t, RSL_CHAN_Bm_ACCHs | tn, trx_chan_desc[TRXC_TCHF].link_id, 1);
+	trx_sched_set_lchan(l1t, RSL_CHAN_Bm_ACCHs | tn, trx_chan_desc[TRXC_SACCHTF].link_id, 1);
+	trx_sched_set_cipher(l1t, RSL_CHAN_Bm_ACCHs | tn, 1, algo, key, sizeof(key));
+	trx_sched_set_cipher(l1t, RSL_CHAN_Bm_ACCHs | tn, 0, algo,
+			     ul_key ? ul_key : key, sizeof(key));
+	l1ts->mf_last_fn = GSM_HYPERFRAME - 200 - 1;
+
+	/* the uplink of a frame is processed 20 frames after its downlink,
+	 * like with the default clock-advance.  Cross the hyperframe wrap. */
+	for (n = 0; n < 400; n++) {
+		uint32_t fn = (GSM_HYPERFRAME - 200 + n) % GSM_HYPERFRAME;
+		uint32_t ul_fn = (fn + GSM_HYPERFRAME - 20) % GSM_HYPERFRAME;
+		const struct l1sched_frame_plan *plan;
+
+		plan = &l1ts->mf_plan[fn % l1ts->mf_period];
+		memset(&last, 0, sizeof(last));
+		_sched_dl_burst(l1t, tn, fn, &nbits);
+		if (last.calls && plan->dl_cs->dl_encr_algo) {
+			tx_pattern(dl_ref, fn);
+			osmo_a5(algo, key, fn, ks, NULL);
+			for (i = 0; i < 57; i++) {
+				dl_ref[i + 3] ^= ks[i];
+				dl_ref[i + 88] ^= ks[i + 57];
+			}
+			OSMO_ASSERT(memcmp(tx_bits, dl_ref, sizeof(dl_ref)) == 0);
+		}
+
+		if (n < 20)
+			continue;
+
+		plan = &l1ts->mf_plan[ul_fn % l1ts->mf_period];
+		rx_pattern(ul, ul_fn);
+		memset(&last, 0, sizeof(last));
+		trx_sched_ul_burst(l1t, tn, ul_fn, ul, GSM_BURST_LEN, -60, 0);
+		if (last.calls && plan->ul_cs->ul_encr_algo) {
+			rx_pattern(ul_ref, ul_fn);
+			osmo_a5(algo, ul_key ? ul_key : key, ul_fn, NULL, ks);
+			for (i = 0; i < 57; i++) {
+				if (ks[i])
+					ul_ref[i + 3] = - ul_ref[i + 3];
+				if (ks[i + 57])
+					ul_ref[i + 88] = - ul_ref[i + 88];
+			}
+			OSMO_ASSERT(memcmp(rx_bits, ul_ref, sizeof(ul_ref)) == 0);
+		}
+	}
+
+	trx_sched_set_lchan(l1t, RSL_CHAN_Bm_ACCHs | tn, trx_chan_desc[TRXC_TCHF].link_id, 0);
+	trx_sched_set_lchan(l1t, RSL_CHAN_Bm_ACCHs | tn, trx_chan_desc[TRXC_SACCHTF].link_id, 0);
+	trx_sched_set_pchan(l1t, tn, GSM_PCHAN_NONE);
+}
+
+/* frames skipped in overload are handed to the backend without bits */
+static void test_ul_missed(struct l1sched_trx *l1t)
+{
+	const uint32_t fn0 = 100 * 104;
+	const uint32_t fns[] = { fn0 + 1, fn0 + 5, fn0 + 11, fn0 + 40 };
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, 1);
+	sbit_t bits[GSM_BURST_LEN];
+	int i;
+
+	printf("Testing UL bursts of skipped frames\n");
+
+	trx_sched_set_pchan(l1t, 1, GSM_PCHAN_TCH_F);
+	trx_sched_set_lchan(l1t, RSL_CHAN_Bm_ACCHs | 1, trx_chan_desc[TRXC_TCHF].link_id, 1);
+	memset(bits, 0, sizeof(bits));
+	l1ts->mf_last_fn = fn0;
+	l1ts->ul_bursts_missed = 0;
+	rx_missed = 0;
+
+	for (i = 0; i < ARRAY_SIZE(fns); i++) {
+		memset(&last, 0, sizeof(last));
+		trx_sched_ul_burst(l1t, 1, fns[i], bits, GSM_BURST_LEN, -60, 0);
+		OSMO_ASSERT(last.fn == fns[i]);
+		OSMO_ASSERT(l1ts->ul_bursts_missed == rx_missed);
+		printf(" fn=%u: %d calls, %u bursts missed so far\n",
+			fns[i] - fn0, last.calls, rx_missed);
+	}
+
+	trx_sched_set_lchan(l1t, RSL_CHAN_Bm_ACCHs | 1, trx_chan_desc[TRXC_TCHF].link_id, 0);
+	trx_sched_set_pchan(l1t, 1, GSM_PCHAN_NONE);
+}
+
+static void test_cipher(struct l1sched_trx *l1t)
+{
+	uint8_t ul_key[8] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef };
+	int algo;
+
+	printf("Testing A5 ciphering of bursts\n");
+
+	for (algo = 1; algo <= 3; algo++) {
+		check_cipher(l1t, algo, NULL);
+		printf(" A5/%d: matches osmo_a5()\n", algo);
+		check_cipher(l1t, algo, ul_key);
+		printf(" A5/%d with separate UL key: matches osmo_a5()\n", algo);
+	}
+}
+
+static inline uint64_t ts_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* rough cost of the per-burst dispatch, not part of the test suite */
+static void bench_frame_plan(struct l1sched_trx *l1t, unsigned int bursts)
+{
+	uint64_t t_ref, t_plan;
+	uint32_t fn;
+	uint16_t nbits;
+	uint8_t tn;
+
+	for (tn = 0; tn < TRX_NR_TS; tn++) {
+		trx_sched_set_pchan(l1t, tn, tn ? GSM_PCHAN_TCH_F : GSM_PCHAN_CCCH_SDCCH4);
+		set_lchans(l1t, tn, 0);
+		set_lchans(l1t, tn, 1);
+	}
+
+	t_ref = ts_ns();
+	for (fn = 0; fn < bursts / TRX_NR_TS; fn++) {
+		for (tn = 0; tn < TRX_NR_TS; tn++)
+			ref_dl_burst(l1t, tn, fn);
+	}
+	t_ref = ts_ns() - t_ref;
+
+	t_plan = ts_ns();
+	for (fn = 0; fn < bursts / TRX_NR_TS; fn++) {
+		for (tn = 0; tn < TRX_NR_TS; tn++)
+			_sched_dl_burst(l1t, tn, fn, &nbits);
+	}
+	t_plan = ts_ns() - t_plan;
+
+	printf("%u DL bursts: layout lookup %.1f ns/burst, "
+		"dispatch plan %.1f ns/burst\n", bursts,
+		(double)t_ref / bursts, (double)t_plan / bursts);
+}
+
+int main(int argc, char **argv)
+{
+	struct l1sched_trx l1t;
+	struct gsm_bts *bts;
+	struct gsm_bts_trx *trx;
+
+	ctx = talloc_named_const(NULL, 0, "sched_test");
+	msgb_talloc_ctx_init(ctx, 0);
+
+	osmo_init_logging2(ctx, &bts_log_info);
+	log_set_log_level(osmo_stderr_target, LOGL_ERROR);
+
+	bts = gsm_bts_alloc(ctx, 0);
+	if (!bts) {
+		fprintf(stderr, "Failed to create BTS structure\n");
+		exit(1);
+	}
+	trx = gsm_bts_trx_alloc(bts);
+	if (!trx) {
+		fprintf(stderr, "Failed to create TRX structure\n");
+		exit(1);
+	}
+
+	memset(&l1t, 0, sizeof(l1t));
+	trx_sched_init(&l1t, trx);
+
+	if (argc > 1 && !strcmp(argv[1], "--bench"))
+		bench_frame_plan(&l1t, argc > 2 ? atoi(argv[2]) : 8000000);
+	else {
+		test_frame_plan(&l1t);
+		test_bursts_arena(&l1t);
+		test_ul_ring(&l1t);
+		test_prim_ring(&l1t);
+		test_prim_slot(&l1t);
+		test_prim_slack(&l1t);
+		test_ul_missed(&l1t);
+		test_cipher(&l1t);
+	}
+
+	printf("Success\n");
+
+	return 0;
+}
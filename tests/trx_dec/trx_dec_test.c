@@ -0,0 +1,225 @@
+/* testing the uplink decoder worker pool of OsmoBTS-TRX */
+
+/* This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/application.h>
+#include <osmocom/core/select.h>
+#include <osmocom/core/utils.h>
+
+#include <osmo-bts/gsm_data.h>
+#include <osmo-bts/phy_link.h>
+#include <osmo-bts/logging.h>
+
+#include "trx_dec.h"
+
+#define ASSERT_TRUE(rc) \
+	if (!(rc)) { \
+		printf("Assert failed in %s:%d.\n",  \
+		       __FILE__, __LINE__);          \
+		abort();			     \
+	}
+
+static void *ctx;
+
+/* the workers block in trx_dec_job_run() until the gate is opened, so that
+ * the ring can be filled up */
+static pthread_mutex_t gate_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gate_cond = PTHREAD_COND_INITIALIZER;
+static int gate_open;
+
+static void gate_set(int open)
+{
+	pthread_mutex_lock(&gate_lock);
+	gate_open = open;
+	pthread_cond_broadcast(&gate_cond);
+	pthread_mutex_unlock(&gate_lock);
+}
+
+/* "decodes" an AMR frame by taking the next codec mode */
+void trx_dec_job_run(struct trx_dec_job *job)
+{
+	pthread_mutex_lock(&gate_lock);
+	while (!gate_open)
+		pthread_cond_wait(&gate_cond, &gate_lock);
+	pthread_mutex_unlock(&gate_lock);
+
+	job->rc = 0;
+	if (job->amr_chain)
+		job->ul_ft++;
+}
+
+/* jobs handed back to the main thread */
+static unsigned int completed;
+static uint32_t next_fn;
+static int out_of_order;
+static uint8_t ul_ft[8];
+
+int trx_dec_job_complete(struct trx_dec_job *job)
+{
+	if (job->fn != next_fn)
+		out_of_order++;
+	next_fn = job->fn + 1;
+	if (job->fn < ARRAY_SIZE(ul_ft))
+		ul_ft[job->fn] = job->ul_ft;
+	completed++;
+
+	return 0;
+}
+
+static struct trx_dec_pool *pool_start(void)
+{
+	struct phy_link *plink;
+	struct trx_dec_pool *pool;
+
+	plink = talloc_zero(ctx, struct phy_link);
+	plink->u.osmotrx.ul_dec_threads = 2;
+	pool = trx_dec_pool_start(plink);
+	ASSERT_TRUE(pool);
+
+	completed = 0;
+	next_fn = 0;
+	out_of_order = 0;
+
+	return pool;
+}
+
+static void submit(struct trx_dec_pool *pool, struct trx_dec_job *job,
+		   uint32_t fn, uint32_t gen, int amr)
+{
+	job->type = TRX_DEC_TCHF;
+	job->l1t = NULL;
+	job->tn = 2;
+	job->chan = TRXC_TCHF;
+	job->gen = gen;
+	job->fn = fn;
+	job->skip = 0;
+	job->ul_ft = 0;
+	job->ul_cmr = 0;
+	job->amr_chain = amr;
+	job->bursts = job->bursts_buf;
+	trx_dec_job_submit(pool, job);
+}
+
+static void test_ring_full(void)
+{
+	struct trx_dec_pool *pool;
+	struct trx_dec_job *job;
+	unsigned int i;
+
+	printf("Testing a full decoder ring.\n");
+
+	gate_set(0);
+	pool = pool_start();
+
+	for (i = 0; i < TRX_DEC_RING_SIZE; i++) {
+		job = trx_dec_job_get(pool);
+		ASSERT_TRUE(job);
+		submit(pool, job, i, 1, 0);
+	}
+
+	/* the main thread must not wait for the workers */
+	for (i = 0; i < 3; i++)
+		ASSERT_TRUE(trx_dec_job_get(pool) == NULL);
+	printf(" %u jobs queued, %"PRIu64" dropped, max queue depth %u\n",
+		TRX_DEC_RING_SIZE, pool->dropped, pool->depth_max);
+
+	gate_set(1);
+	while (completed < TRX_DEC_RING_SIZE)
+		osmo_select_main(0);
+	printf(" %u jobs completed, %d out of order\n", completed, out_of_order);
+
+	/* there is room again */
+	job = trx_dec_job_get(pool);
+	ASSERT_TRUE(job);
+
+	trx_dec_pool_stop(pool);
+}
+
+static void test_amr_chain(void)
+{
+	struct trx_dec_pool *pool;
+	struct trx_dec_job *job;
+	unsigned int i;
+
+	printf("Testing AMR codec mode passed between jobs.\n");
+
+	gate_set(0);
+	pool = pool_start();
+
+	/* four frames of one activation, then one of the next, all
+	 * submitted before the first is decoded */
+	for (i = 0; i < 5; i++) {
+		job = trx_dec_job_get(pool);
+		ASSERT_TRUE(job);
+		submit(pool, job, i, i < 4 ? 1 : 2, 1);
+	}
+
+	gate_set(1);
+	while (completed < 5)
+		osmo_select_main(0);
+	for (i = 0; i < 5; i++)
+		printf(" frame %u: ul_ft %u\n", i, ul_ft[i]);
+
+	trx_dec_pool_stop(pool);
+}
+
+static void test_stop(void)
+{
+	struct trx_dec_pool *pool;
+	struct trx_dec_job *job;
+	unsigned int i;
+
+	printf("Testing stopping the pool with jobs in flight.\n");
+
+	gate_set(0);
+	pool = pool_start();
+
+	for (i = 0; i < 10; i++) {
+		job = trx_dec_job_get(pool);
+		ASSERT_TRUE(job);
+		submit(pool, job, i, 1, 1);
+	}
+
+	/* let the workers go, without ever delivering */
+	gate_set(1);
+	trx_dec_pool_stop(pool);
+	printf(" %u jobs completed\n", completed);
+}
+
+int main(int argc, char **argv)
+{
+	ctx = talloc_named_const(NULL, 0, "trx_dec_test");
+	msgb_talloc_ctx_init(ctx, 0);
+
+	osmo_init_logging2(ctx, &bts_log_info);
+	log_set_log_level(osmo_stderr_target, LOGL_ERROR);
+
+	test_ring_full();
+	test_amr_chain();
+	test_stop();
+
+	printf("Success\n");
+
+	return 0;
+}